@@ -0,0 +1,62 @@
+#include "CameraTrigger.h"
+
+#include <string.h>
+#include <zephyr/logging/log.h>
+
+#ifdef CONFIG_RAIL_TRIGGER_GPIO
+#include "GpioTrigger.h"
+#endif
+#ifdef CONFIG_RAIL_TRIGGER_IR
+#include "IrTrigger.h"
+#endif
+
+LOG_MODULE_REGISTER(camera_trigger, LOG_LEVEL_INF);
+
+static CameraTrigger *triggers[4];
+static int num_triggers = 0;
+
+CameraTrigger *init_triggers(SonyRemote *remote) {
+  static SonyRemoteTrigger ble_trigger(remote);
+  CameraTrigger *default_trigger = &ble_trigger;
+
+  triggers[num_triggers++] = &ble_trigger;
+#if defined(CONFIG_BT) && CONFIG_RAIL_CAMERAS > 1
+  static SonyGroupTrigger group_trigger;
+  triggers[num_triggers++] = &group_trigger;
+#endif
+#ifdef CONFIG_RAIL_TRIGGER_GPIO
+  static GpioTrigger gpio_trigger;
+  if (gpio_trigger.init() == 0) {
+    triggers[num_triggers++] = &gpio_trigger;
+    if (IS_ENABLED(CONFIG_RAIL_TRIGGER_GPIO_DEFAULT)) {
+      default_trigger = &gpio_trigger;
+    }
+  }
+#endif
+#ifdef CONFIG_RAIL_TRIGGER_IR
+  static IrTrigger ir_trigger;
+  if (ir_trigger.ready()) {
+    triggers[num_triggers++] = &ir_trigger;
+  }
+#endif
+
+  LOG_INF("%d trigger backends, using %s", num_triggers,
+          default_trigger->name());
+  return default_trigger;
+}
+
+CameraTrigger *get_trigger(int index) {
+  if (index < 0 || index >= num_triggers) {
+    return nullptr;
+  }
+  return triggers[index];
+}
+
+int find_trigger(const char *name) {
+  for (int i = 0; i < num_triggers; i++) {
+    if (strcmp(triggers[i]->name(), name) == 0) {
+      return i;
+    }
+  }
+  return -ENOENT;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_BT
+#include "sony_remote/sony_remote.h"
+#else
+#include "sony_remote/fake_sony_remote.h"
+#endif
+
+/* Called once the shutter was released, from ISR or Bluetooth context */
+typedef void (*trigger_done_cb_t)(int err, void *user_data);
+
+/**
+ * @brief Something that makes the camera take a frame.
+ *
+ * The state machine shoots through this interface only, so that the backend
+ * can be chosen at build time and switched at run time ("cam trigger").
+ */
+class CameraTrigger {
+public:
+  virtual ~CameraTrigger() = default;
+
+  virtual const char *name() const = 0;
+  virtual bool ready() = 0;
+
+  /**
+   * @brief Start one frame, never blocks.
+   *
+   * @param done called once the shutter was released
+   * @return 0 on success, negative error code otherwise
+   */
+  virtual int shoot(trigger_done_cb_t done = nullptr,
+                    void *user_data = nullptr) = 0;
+
+  /**
+   * @brief Signal raised when the camera reports a frame as done, nullptr if
+   * the backend cannot tell.
+   */
+  virtual struct k_poll_signal *captureSignal() { return nullptr; }
+
+  virtual void setCaptureProfile(CaptureProfile profile) {
+    profile_ = profile;
+  }
+  CaptureProfile captureProfile() const { return profile_; }
+  virtual int beginSeries() { return 0; }
+  virtual int endSeries() { return 0; }
+  virtual int setLowLatency(bool enable) { return 0; }
+
+  // Frames started but not released yet
+  virtual uint32_t pendingCommands() = 0;
+
+protected:
+  CaptureProfile profile_ = CaptureProfile::FULL_AF;
+};
+
+/**
+ * @brief Shoots through the Sony Bluetooth remote (or the fake one).
+ */
+class SonyRemoteTrigger : public CameraTrigger {
+  SonyRemote *remote;
+
+public:
+  explicit SonyRemoteTrigger(SonyRemote *_remote) : remote(_remote) {}
+
+  const char *name() const override { return "ble"; }
+  bool ready() override { return remote->ready(); }
+  int shoot(trigger_done_cb_t done, void *user_data) override {
+    return remote->shoot(done, user_data);
+  }
+  struct k_poll_signal *captureSignal() override {
+    return remote->hasStatus() ? remote->captureSignal() : nullptr;
+  }
+  void setCaptureProfile(CaptureProfile profile) override {
+    profile_ = profile;
+    remote->setCaptureProfile(profile);
+  }
+  int beginSeries() override { return remote->beginSeries(); }
+  int endSeries() override { return remote->endSeries(); }
+  int setLowLatency(bool enable) override {
+    return remote->setLowLatency(enable);
+  }
+  uint32_t pendingCommands() override { return remote->pendingCommands(); }
+};
+
+#if defined(CONFIG_BT) && CONFIG_RAIL_CAMERAS > 1
+/**
+ * @brief Shoots all connected Sony cameras on each frame.
+ */
+class SonyGroupTrigger : public CameraTrigger {
+  SonyRemoteGroup group;
+
+public:
+  SonyGroupTrigger() {
+    for (size_t i = 0; SonyRemote::get(i); i++) {
+      group.add(SonyRemote::get(i));
+    }
+  }
+
+  const char *name() const override { return "group"; }
+  bool ready() override { return group.ready(); }
+  int shoot(trigger_done_cb_t done, void *user_data) override {
+    return group.shoot(done, user_data);
+  }
+  struct k_poll_signal *captureSignal() override {
+    return group.captureSignal();
+  }
+  void setCaptureProfile(CaptureProfile profile) override {
+    profile_ = profile;
+    group.setCaptureProfile(profile);
+  }
+  int beginSeries() override { return group.beginSeries(); }
+  int endSeries() override { return group.endSeries(); }
+  int setLowLatency(bool enable) override {
+    return group.setLowLatency(enable);
+  }
+  uint32_t pendingCommands() override { return group.pendingCommands(); }
+};
+#endif
+
+/**
+ * @brief Create the trigger backends available in this build.
+ *
+ * @return the default backend, the wired one with
+ *         CONFIG_RAIL_TRIGGER_GPIO_DEFAULT
+ */
+CameraTrigger *init_triggers(SonyRemote *remote);
+
+/**
+ * @brief Backend by index, nullptr past the last one.
+ */
+CameraTrigger *get_trigger(int index);
+
+/**
+ * @brief Index of the backend called @p name, -ENOENT if there is none.
+ */
+int find_trigger(const char *name);
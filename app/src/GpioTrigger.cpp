@@ -0,0 +1,117 @@
+#include "GpioTrigger.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(gpio_trigger, LOG_LEVEL_INF);
+
+#define CAMERA_TRIGGER_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(gpio_camera_trigger)
+
+GpioTrigger::GpioTrigger()
+    : focus(GPIO_DT_SPEC_GET_OR(CAMERA_TRIGGER_NODE, focus_gpios, {0})),
+      shutter(GPIO_DT_SPEC_GET(CAMERA_TRIGGER_NODE, shutter_gpios)),
+      focus_lead_us(DT_PROP(CAMERA_TRIGGER_NODE, focus_lead_us)),
+      shutter_pulse_us(DT_PROP(CAMERA_TRIGGER_NODE, shutter_pulse_us)) {
+  k_timer_init(&pulse_timer, pulse_timer_handler, nullptr);
+  k_timer_user_data_set(&pulse_timer, this);
+}
+
+int GpioTrigger::init() {
+  if (!gpio_is_ready_dt(&shutter) ||
+      (has_focus() && !gpio_is_ready_dt(&focus))) {
+    LOG_ERR("Trigger GPIOs not ready");
+    return -ENODEV;
+  }
+
+  int ret = gpio_pin_configure_dt(&shutter, GPIO_OUTPUT_INACTIVE);
+  if (ret == 0 && has_focus()) {
+    ret = gpio_pin_configure_dt(&focus, GPIO_OUTPUT_INACTIVE);
+  }
+  if (ret < 0) {
+    LOG_ERR("Failed to configure trigger GPIOs: %d", ret);
+    return ret;
+  }
+
+  initialized = true;
+  LOG_INF("Wired trigger ready (focus %s, lead %u us, pulse %u us)",
+          has_focus() ? "yes" : "no", focus_lead_us, shutter_pulse_us);
+  return 0;
+}
+
+int GpioTrigger::shoot(trigger_done_cb_t _done, void *user_data) {
+  if (!initialized) {
+    return -ENODEV;
+  }
+  if (phase != Phase::IDLE) {
+    return -EBUSY;
+  }
+
+  done = _done;
+  done_user_data = user_data;
+
+  // Only the full AF cycle gives the camera time to focus first
+  const bool lead = has_focus() && !focus_held && focus_lead_us > 0 &&
+                    (profile_ == CaptureProfile::FULL_AF ||
+                     profile_ == CaptureProfile::HALF_PRESS_HELD);
+  if (has_focus() && !focus_held) {
+    gpio_pin_set_dt(&focus, 1);
+  }
+  if (lead) {
+    phase = Phase::FOCUS;
+    k_timer_start(&pulse_timer, K_USEC(focus_lead_us), K_NO_WAIT);
+    return 0;
+  }
+  press_shutter();
+  return 0;
+}
+
+void GpioTrigger::press_shutter() {
+  phase = Phase::SHUTTER;
+  gpio_pin_set_dt(&shutter, 1);
+  press_cycles = k_cycle_get_32();
+  k_timer_start(&pulse_timer, K_USEC(shutter_pulse_us), K_NO_WAIT);
+}
+
+void GpioTrigger::release() {
+  gpio_pin_set_dt(&shutter, 0);
+  if (has_focus() && !focus_held) {
+    gpio_pin_set_dt(&focus, 0);
+  }
+  LOG_DBG("Shutter held %u us",
+          k_cyc_to_us_floor32(k_cycle_get_32() - press_cycles));
+  phase = Phase::IDLE;
+  if (done) {
+    done(0, done_user_data);
+  }
+}
+
+// Runs in ISR context
+void GpioTrigger::pulse_timer_handler(struct k_timer *timer) {
+  GpioTrigger *trigger = (GpioTrigger *)k_timer_user_data_get(timer);
+
+  if (trigger->phase == Phase::FOCUS) {
+    trigger->press_shutter();
+  } else if (trigger->phase == Phase::SHUTTER) {
+    trigger->release();
+  }
+}
+
+int GpioTrigger::beginSeries() {
+  if (profile_ != CaptureProfile::HALF_PRESS_HELD || !has_focus() ||
+      focus_held) {
+    return 0;
+  }
+  focus_held = true;
+  return gpio_pin_set_dt(&focus, 1);
+}
+
+int GpioTrigger::endSeries() {
+  if (!focus_held) {
+    return 0;
+  }
+  focus_held = false;
+  if (phase != Phase::IDLE) {
+    // released together with the shutter
+    return 0;
+  }
+  return gpio_pin_set_dt(&focus, 0);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+
+#include "CameraTrigger.h"
+
+/**
+ * @brief Shoots through the wired remote port of the camera.
+ *
+ * The lines are pressed right in shoot() and released from a k_timer, so
+ * the press is not delayed by any radio link and the pulse widths are exact
+ * to one kernel tick. The camera does not report back, so there is no
+ * capture signal.
+ */
+class GpioTrigger : public CameraTrigger {
+  enum class Phase { IDLE, FOCUS, SHUTTER };
+
+  const struct gpio_dt_spec focus;
+  const struct gpio_dt_spec shutter;
+  const uint32_t focus_lead_us;
+  const uint32_t shutter_pulse_us;
+
+  bool initialized = false;
+  bool focus_held = false;
+  volatile Phase phase = Phase::IDLE;
+  struct k_timer pulse_timer;
+  trigger_done_cb_t done = nullptr;
+  void *done_user_data = nullptr;
+  uint32_t press_cycles = 0;
+
+  bool has_focus() const { return focus.port != nullptr; }
+  void press_shutter();
+  void release();
+  static void pulse_timer_handler(struct k_timer *timer);
+
+public:
+  GpioTrigger();
+  int init();
+
+  const char *name() const override { return "gpio"; }
+  bool ready() override { return initialized; }
+  int shoot(trigger_done_cb_t done, void *user_data) override;
+  int beginSeries() override;
+  int endSeries() override;
+  uint32_t pendingCommands() override { return phase != Phase::IDLE; }
+};
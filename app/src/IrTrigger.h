@@ -0,0 +1,23 @@
+#pragma once
+
+#include "CameraTrigger.h"
+#include "sony_ir_remote/IrSony.h"
+
+/**
+ * @brief Shoots through the Sony infrared remote code.
+ *
+ * The code is sent from a timer, done is called once the first of the
+ * repeated frames is out. Sony cameras do not answer on IR, so there is no
+ * capture signal.
+ */
+class IrTrigger : public CameraTrigger {
+  IrSony ir;
+
+public:
+  const char *name() const override { return "ir"; }
+  bool ready() override { return ir.ready(); }
+  int shoot(trigger_done_cb_t done, void *user_data) override {
+    return ir.shoot(done, user_data);
+  }
+  uint32_t pendingCommands() override { return ir.is_busy(); }
+};
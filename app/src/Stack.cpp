@@ -34,25 +34,23 @@ bool Stack::compute_by_step_size(const int start, const int end) {
             step_size, start, end);
     return false;
   }
-  if (end < start) {
+  int64_t distance = (int64_t)end - (int64_t)start;
+  if (distance < 0) {
     LOG_DBG("Reversing step size for descending stack");
+    distance = -distance;
     step_size = -step_size;
   }
 
-  length_of_stack = 0;
-  stepps_of_stack[length_of_stack] = start;
-  while ((step_size > 0 && stepps_of_stack[length_of_stack] <= end) ||
-         (step_size < 0 && stepps_of_stack[length_of_stack] >= end)) {
-    length_of_stack++;
-    if (length_of_stack > 3999) {
-      LOG_ERR("Exceeded maximum stack size of 4000");
-      return false;
-    }
-    stepps_of_stack[length_of_stack] =
-        stepps_of_stack[length_of_stack - 1] + step_size;
-  }
-  stepps_of_stack[length_of_stack] = end;
-  length_of_stack++;
+  // All full steps plus the end, which may be closer than one step size
+  int64_t length = (distance + expected_step_size - 1) / expected_step_size + 1;
+  if (length > INT32_MAX) {
+    LOG_ERR("Stack of %lld steps is too long", (long long)length);
+    return false;
+  }
+  start_of_stack = start;
+  end_of_stack = end;
+  step_of_stack = step_size;
+  length_of_stack = (int)length;
   LOG_DBG("Computed %d steps for stack of size %d", length_of_stack, step_size);
   return true;
 }
@@ -64,21 +62,85 @@ bool Stack::compute_by_expected_length_of_stack(const int start,
     LOG_WRN("Invalid expected length or start equals end");
     return false;
   }
-  int step_size = (end - start) / (expected_length - 1);
+  int step_size =
+      (int)(((int64_t)end - (int64_t)start) / (expected_length - 1));
   if (step_size == 0) {
     LOG_WRN("Computed step size is zero");
     return false;
   }
-  stepps_of_stack[0] = start;
-  for (int i = 1; i < expected_length; i++) {
-    stepps_of_stack[i] = stepps_of_stack[i - 1] + step_size;
-  }
-  stepps_of_stack[expected_length - 1] = end;
+  start_of_stack = start;
+  end_of_stack = end;
+  step_of_stack = step_size;
   length_of_stack = expected_length;
   LOG_DBG("Computed %d steps for stack of size %d", length_of_stack, step_size);
   return true;
 }
 
+bool Stack::compute_by_positions() {
+  if (!positions || length_of_positions < 2) {
+    LOG_WRN("No plan of positions to stack");
+    return false;
+  }
+  start_of_stack = positions[0];
+  end_of_stack = positions[length_of_positions - 1];
+  step_of_stack = (int)(((int64_t)end_of_stack - (int64_t)start_of_stack) /
+                        (length_of_positions - 1));
+  length_of_stack = length_of_positions;
+  LOG_DBG("Using %d planned positions", length_of_stack);
+  return true;
+}
+
+bool Stack::compute_by_segments() {
+  int32_t start;
+  num_segments = plan_get_segments(&start, segments, ARRAY_SIZE(segments));
+  if (num_segments == 0) {
+    LOG_WRN("No segment plan to stack");
+    return false;
+  }
+  int64_t length = 1;
+  int32_t end = start;
+  for (int i = 0; i < num_segments; i++) {
+    length += plan_segment_frames(end, &segments[i]);
+    end = segments[i].end_nm;
+  }
+  start_of_stack = start;
+  end_of_stack = end;
+  step_of_stack = (int)(((int64_t)end - (int64_t)start) / (length - 1));
+  length_of_stack = (int)length;
+
+  segment_cursor = 0;
+  segment_first_index = 0;
+  segment_from = start;
+  segment_length = (int)plan_segment_frames(start, &segments[0]);
+  LOG_DBG("Computed %d steps in %d segments", length_of_stack, num_segments);
+  return true;
+}
+
+// The index mostly grows during a stack, so the cursor moves forward at most
+// one segment per frame. A look back starts over from the first segment.
+int Stack::segment_target(int index) {
+  if (index == 0) {
+    return start_of_stack;
+  }
+  if (index <= segment_first_index) {
+    segment_cursor = 0;
+    segment_first_index = 0;
+    segment_from = start_of_stack;
+    segment_length = (int)plan_segment_frames(start_of_stack, &segments[0]);
+  }
+  while (index > segment_first_index + segment_length &&
+         segment_cursor + 1 < num_segments) {
+    segment_first_index += segment_length;
+    segment_from = segments[segment_cursor].end_nm;
+    segment_cursor++;
+    // plan_set_segments() kept the sum of the segments within an int
+    segment_length =
+        (int)plan_segment_frames(segment_from, &segments[segment_cursor]);
+  }
+  return plan_segment_target(segment_from, &segments[segment_cursor],
+                             index - segment_first_index);
+}
+
 bool Stack::compute() {
   int start;
   int end;
@@ -90,13 +152,19 @@ bool Stack::compute() {
     start = upper_bound;
   }
   LOG_DBG("Computing stack from %d to %d", start, end);
-  if (compute_via_step_size) {
+  switch (mode) {
+  case StackMode::STEP_SIZE:
     LOG_DBG("Computing via step size");
     return compute_by_step_size(start, end);
-  } else {
-    LOG_DBG("Computing via expected length of stack");
-    return compute_by_expected_length_of_stack(start, end);
+  case StackMode::POSITIONS:
+    return compute_by_positions();
+  case StackMode::SEGMENTS:
+    return compute_by_segments();
+  case StackMode::LENGTH:
+    break;
   }
+  LOG_DBG("Computing via expected length of stack");
+  return compute_by_expected_length_of_stack(start, end);
 }
 
 std::optional<int> Stack::start_stack() {
@@ -112,11 +180,23 @@ std::optional<int> Stack::get_current_target() {
   if (!index_in_stack.has_value()) {
     return {};
   }
-  int actual_index_in_stack = index_in_stack.value();
-  if (actual_index_in_stack < 0 || length_of_stack <= actual_index_in_stack) {
+  return get_target(index_in_stack.value());
+}
+
+std::optional<int> Stack::get_target(int index) {
+  if (!index_in_stack.has_value() || index < 0 || length_of_stack <= index) {
     return {};
   }
-  return stepps_of_stack[actual_index_in_stack];
+  if (mode == StackMode::POSITIONS) {
+    return positions[index];
+  }
+  if (mode == StackMode::SEGMENTS) {
+    return segment_target(index);
+  }
+  if (index == length_of_stack - 1) {
+    return end_of_stack;
+  }
+  return (int)((int64_t)start_of_stack + (int64_t)index * step_of_stack);
 }
 
 std::optional<int> Stack::get_index_in_stack() { return index_in_stack; }
@@ -154,12 +234,21 @@ int Stack::get_upper_bound() { return upper_bound; }
 
 void Stack::set_expected_length_of_stack(int _expected_length_of_stack) {
   expected_length_of_stack = _expected_length_of_stack;
-  compute_via_step_size = false;
+  mode = StackMode::LENGTH;
 }
 
 void Stack::set_expected_step_size(int _expected_step_size) {
   expected_step_size = _expected_step_size;
-  compute_via_step_size = true;
+  mode = StackMode::STEP_SIZE;
+}
+
+void Stack::use_positions() { mode = StackMode::POSITIONS; }
+
+void Stack::use_segments() { mode = StackMode::SEGMENTS; }
+
+void Stack::set_positions(const int32_t *_positions, int _length) {
+  positions = _positions;
+  length_of_positions = _length;
 }
 
 void Stack::flip_start_at() { start_at_lower = !start_at_lower; }
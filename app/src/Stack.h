@@ -8,8 +8,8 @@
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
-#include <zephyr/zbus/zbus.h>
 
+#include "plan.h"
 #include "stepper_with_target/StepperWithTarget.h"
 #include <optional>
 
@@ -20,6 +20,14 @@ struct stack_status {
   int length_of_stack;
 };
 
+// How the targets of a stack are computed
+enum class StackMode {
+  LENGTH,    // between the bounds, a given number of frames
+  STEP_SIZE, // between the bounds, a given step size
+  POSITIONS, // an uploaded list of positions, see plan.h
+  SEGMENTS,  // segments with their own step size or length, see plan.h
+};
+
 class Stack {
   int lower_bound = 0;
   int upper_bound = 0;
@@ -27,14 +35,34 @@ class Stack {
 
   int expected_length_of_stack = 300;
   int expected_step_size = 1;
-  bool compute_via_step_size = false;
+  StackMode mode = StackMode::LENGTH;
+
+  // Uploaded positions, read in place
+  const int32_t *positions = nullptr;
+  int length_of_positions = 0;
 
+  // Segments copied at the start, the cursor segment holds the current index
+  struct plan_segment segments[CONFIG_RAIL_PLAN_SEGMENTS];
+  int num_segments = 0;
+  int segment_cursor = 0;
+  int segment_first_index = 0; // index of the start of the cursor segment
+  int segment_length = 0;
+  int32_t segment_from = 0;
+
+  // The plan is evaluated lazily: target i is start + i * step, except for the
+  // last one which is always the end. With positions, target i is positions[i]
+  // and the step is the mean one.
+  int start_of_stack = 0;
+  int end_of_stack = 0;
+  int step_of_stack = 0;
   int length_of_stack = 0;
   std::optional<int> index_in_stack = {};
-  int *stepps_of_stack = (int *)malloc(sizeof(int) * 4000);
 
   bool compute_by_step_size(const int start, const int end);
   bool compute_by_expected_length_of_stack(const int start, const int end);
+  bool compute_by_positions();
+  bool compute_by_segments();
+  int segment_target(int index);
   bool compute();
 
 public:
@@ -46,8 +74,12 @@ public:
   // stacking
   std::optional<int> start_stack();
   std::optional<int> get_current_target();
+  // Target @p index of the running stack, none past its end
+  std::optional<int> get_target(int index);
   std::optional<int> get_index_in_stack();
   std::optional<int> get_length_of_stack();
+  int get_last_target() { return end_of_stack; }
+  int get_step_size() { return abs(step_of_stack); }
   void increment_target();
   void stop_stack();
   bool stack_in_progress();
@@ -59,6 +91,14 @@ public:
   int get_upper_bound();
   void set_expected_length_of_stack(int _expected_length_of_stack);
   void set_expected_step_size(int _expected_step_size);
+  void use_positions();
+  void set_positions(const int32_t *_positions, int _length);
+  bool uses_positions() { return mode == StackMode::POSITIONS; }
+  // Frames the same distance apart, all but a shorter last step
+  bool has_even_steps() {
+    return mode == StackMode::LENGTH || mode == StackMode::STEP_SIZE;
+  }
+  void use_segments();
   void flip_start_at();
 
   const struct stack_status get_status() {
@@ -1,4 +1,5 @@
 #include "StateMachine.h"
+#include "plan.h"
 #ifdef CONFIG_BT
 #include "pwa_service.h"
 #endif
@@ -8,18 +9,121 @@ LOG_MODULE_REGISTER(state_machine, LOG_LEVEL_INF);
 // Atomic stop flag for interrupting stacking
 
 static atomic_t stop_requested = ATOMIC_INIT(0);
+static uint32_t stop_requested_cycles;
+// Wakes the stacking states from k_poll as soon as a stop is requested
+static struct k_poll_signal stop_signal =
+    K_POLL_SIGNAL_INITIALIZER(stop_signal);
+// Followed moves a stop cut short, see interactive_event_get()
+static atomic_t motion_stopped = ATOMIC_INIT(0);
 
-static void request_stop() { atomic_set(&stop_requested, 1); }
+static void request_stop() {
+  stop_requested_cycles = k_cycle_get_32();
+  atomic_set(&stop_requested, 1);
+  k_poll_signal_raise(&stop_signal, 0);
+}
 static bool stop_is_requested() { return atomic_get(&stop_requested) != 0; }
-static void clear_stop_request() { atomic_set(&stop_requested, 0); }
+static void clear_stop_request() {
+  atomic_set(&stop_requested, 0);
+  k_poll_signal_reset(&stop_signal);
+}
+// Stepper to stop right from the context that requested the stop
+static const StepperWithTarget *stop_stepper = nullptr;
+
+static uint32_t us_since_stop_request() {
+  return k_cyc_to_us_floor32(k_cycle_get_32() - stop_requested_cycles);
+}
 
 // ############################################################################
-// initialize ZBus
+// Event queues
+//
+// Producers (shell, Bluetooth RX, input, ISRs) never block and every message is
+// kept until the state machine takes it. STOP bypasses the queues entirely,
+// queries go through their own queue and overtake queued motion commands.
+
+K_MSGQ_DEFINE(event_prio_msgq, sizeof(struct event_msg), 8, 4);
+K_MSGQ_DEFINE(event_msgq, sizeof(struct event_msg), 32, 4);
 
-ZBUS_CHAN_DEFINE(event_msg_chan, struct event_msg, NULL, NULL,
-                 ZBUS_OBSERVERS(event_sub), ZBUS_MSG_INIT(.evt = {}));
+static atomic_t events_published = ATOMIC_INIT(0);
+static atomic_t events_processed = ATOMIC_INIT(0);
+static atomic_t events_dropped = ATOMIC_INIT(0);
 
-ZBUS_SUBSCRIBER_DEFINE(event_sub, 20);
+// Serializes the threads putting events, so that a batch finds the room it
+// checked for. Recursive, a batch publishes its events while holding it.
+K_MUTEX_DEFINE(event_pub_mutex);
+
+bool event_is_priority(event event) { return event == EVENT_STATUS; }
+
+int event_pub_batch_begin(size_t count, size_t prio_count) {
+  k_mutex_lock(&event_pub_mutex, K_FOREVER);
+  if (k_msgq_num_free_get(&event_msgq) < count - prio_count ||
+      k_msgq_num_free_get(&event_prio_msgq) < prio_count) {
+    k_mutex_unlock(&event_pub_mutex);
+    atomic_add(&events_dropped, count);
+    LOG_ERR("Event queue full, dropped batch of %zu events", count);
+    return -ENOMSG;
+  }
+  return 0;
+}
+
+void event_pub_batch_end() { k_mutex_unlock(&event_pub_mutex); }
+
+// Take the next event, priority queue first
+static int event_get(struct event_msg *msg, k_timeout_t timeout) {
+  struct k_poll_event events[] = {
+      K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                               K_POLL_MODE_NOTIFY_ONLY, &event_prio_msgq),
+      K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                               K_POLL_MODE_NOTIFY_ONLY, &event_msgq),
+  };
+  k_timepoint_t end = sys_timepoint_calc(timeout);
+
+  while (true) {
+    if (k_msgq_get(&event_prio_msgq, msg, K_NO_WAIT) == 0 ||
+        k_msgq_get(&event_msgq, msg, K_NO_WAIT) == 0) {
+      atomic_inc(&events_processed);
+      return 0;
+    }
+    int ret = k_poll(events, ARRAY_SIZE(events), sys_timepoint_timeout(end));
+    if (ret != 0) {
+      return ret;
+    }
+    events[0].state = K_POLL_STATE_NOT_READY;
+    events[1].state = K_POLL_STATE_NOT_READY;
+  }
+}
+
+const struct event_stats get_event_stats() {
+  return {
+      .published = (uint32_t)atomic_get(&events_published),
+      .processed = (uint32_t)atomic_get(&events_processed),
+      .dropped = (uint32_t)atomic_get(&events_dropped),
+  };
+}
+
+// Without ramping, moves have to start and stop slowly to avoid ringing
+static StepperSpeed stack_speed(struct s_object *s) {
+  return s->stepper->has_motion_limits() ? StepperSpeed::MEDIUM
+                                         : StepperSpeed::SLOW;
+}
+
+// Copy of the settings that stacks take, for estimates from other threads
+static struct {
+  uint32_t wait_ms;
+  uint32_t nm_per_s;
+} stack_timing;
+
+static void update_stack_timing(struct s_object *s) {
+  stack_timing.wait_ms = s->wait_before_ms + s->wait_after_ms;
+  stack_timing.nm_per_s = s->stepper->speed_nm_per_s(stack_speed(s));
+}
+
+uint32_t stack_eta_ms(uint32_t frames, uint32_t travel_nm) {
+  uint64_t eta_ms = (uint64_t)frames * stack_timing.wait_ms;
+  if (stack_timing.nm_per_s > 0) {
+    eta_ms += (uint64_t)travel_nm * MSEC_PER_SEC / stack_timing.nm_per_s;
+  }
+  return MIN(eta_ms, UINT32_MAX);
+}
 
 static constexpr int64_t INACTIVITY_AUTO_DISABLE_MS = 5 * 60 * 1000;
 static struct s_object *auto_disable_ctx = nullptr;
@@ -51,25 +155,89 @@ static void auto_disable_work_handler(struct k_work *work) {
   k_work_reschedule(&auto_disable_work, K_SECONDS(30));
 }
 
-static int event_pub(event event, int value) {
+// ############################################################################
+// Command progress
+//
+// Commands sent with a sequence number are reported to the PWA: accepted once
+// queued, started once taken from the queue and completed with 0 or a negative
+// error code once done. Every accepted command is completed exactly once.
+
+static void report_command(uint16_t seq, const char *stage) {
+  if (seq == 0) {
+    return;
+  }
+  LOG_DBG("command %u %s", seq, stage);
+#ifdef CONFIG_BT
+  PwaService::notifyCommand(seq, stage);
+#endif
+}
+
+static void report_started(uint16_t seq) { report_command(seq, "STARTED"); }
+
+static void report_completed(uint16_t seq, int err) {
+  char stage[24];
+  snprintf(stage, sizeof(stage), "COMPLETED:%d", err);
+  report_command(seq, stage);
+}
+
+int event_pub(event event, int value, uint16_t seq) {
+  // Reported before the state machine can start it
+  report_command(seq, "ACCEPTED");
   if (event == EVENT_STOP) {
-    LOG_INF("Stop requested (flag set)");
+    report_started(seq);
     request_stop();
+    atomic_set(&motion_stopped, 1);
+    if (stop_stepper) {
+      stop_stepper->hard_stop();
+    }
+    LOG_INF("Stop requested, stepper stopped %u us after request",
+            us_since_stop_request());
+    report_completed(seq, 0);
     return 0;
   }
   LOG_DBG("send msg: event=%d with value=%d", event, value);
-  struct event_msg msg = {event, value};
-  return zbus_chan_pub(&event_msg_chan, &msg, K_MSEC(200));
+  struct event_msg msg = {event, value, seq};
+  struct k_msgq *msgq =
+      event_is_priority(event) ? &event_prio_msgq : &event_msgq;
+  bool locked = !k_is_in_isr();
+  if (locked) {
+    k_mutex_lock(&event_pub_mutex, K_FOREVER);
+  }
+  int ret = k_msgq_put(msgq, &msg, K_NO_WAIT);
+  if (locked) {
+    k_mutex_unlock(&event_pub_mutex);
+  }
+  if (ret != 0) {
+    atomic_inc(&events_dropped);
+    LOG_ERR("Event queue full, dropped event %d", event);
+    report_completed(seq, ret);
+    return ret;
+  }
+  atomic_inc(&events_published);
+  return 0;
+}
+
+static int event_pub(event event, int value) {
+  return event_pub(event, value, 0);
 }
 
 static int event_pub(event event) { return event_pub(event, 0); }
 
-#ifdef CONFIG_BT
-static void publish_pwa_status(const struct s_object *s) {
-  if (!PwaService::isConnected()) {
-    return;
+#ifdef CONFIG_INPUT
+// First button of the board is an emergency stop
+void input_cb(struct input_event *evt, void *user_data) {
+  ARG_UNUSED(user_data);
+  if (evt->type == INPUT_EV_KEY && evt->code == INPUT_KEY_0 &&
+      evt->value == 1) {
+    event_pub(EVENT_STOP);
   }
+}
+INPUT_CALLBACK_DEFINE(NULL, input_cb, NULL);
+#endif
 
+#ifdef CONFIG_BT
+// Binary frame if the PWA subscribed to it, the JSON text otherwise
+static void publish_pwa_status(const struct s_object *s, bool full = false) {
   const struct stepper_with_target_status stepper_status =
       s->stepper->get_status();
   const struct stack_status stack_status = s->stack.get_status();
@@ -78,6 +246,25 @@ static void publish_pwa_status(const struct s_object *s) {
                               : -1;
   const int stack_running = s->stack.stack_in_progress() ? 1 : 0;
 
+  const struct pwa_state state = {
+      .position_nm = s->stepper->get_position_nm(),
+      .target_nm = s->stepper->get_target_position_nm(),
+      .lower_nm = stack_status.lower_bound,
+      .upper_nm = stack_status.upper_bound,
+      .stack_index = (int16_t)CLAMP(stack_index, -1, INT16_MAX),
+      .stack_length = (uint16_t)CLAMP(stack_status.length_of_stack, 0,
+                                      UINT16_MAX),
+      .wait_before_ms = (uint16_t)CLAMP(s->wait_before_ms, 0, UINT16_MAX),
+      .wait_after_ms = (uint16_t)CLAMP(s->wait_after_ms, 0, UINT16_MAX),
+      .flags = (uint8_t)((stack_running ? PWA_STATE_STACK_RUNNING : 0) |
+                         (stepper_status.is_moving ? PWA_STATE_MOVING : 0) |
+                         (s->remote->ready() ? PWA_STATE_CAM_CONNECTED : 0)),
+  };
+  // Kept for reads even without a connection
+  if (PwaService::notifyState(state, full) || !PwaService::isConnected()) {
+    return;
+  }
+
   char status_payload[240];
   snprintf(status_payload, sizeof(status_payload),
            "STATE {\"position_nm\":%d,\"target_nm\":%d,\"lower_nm\":%d,"
@@ -92,7 +279,9 @@ static void publish_pwa_status(const struct s_object *s) {
   PwaService::notifyStatus(status_payload);
 }
 #else
-static void publish_pwa_status(const struct s_object *s) { ARG_UNUSED(s); }
+static void publish_pwa_status(const struct s_object *s, bool full = false) {
+  ARG_UNUSED(s);
+}
 #endif
 
 // ############################################################################
@@ -104,6 +293,7 @@ struct smf_state *s_stack_ptr;
 struct smf_state *s_stack_move_ptr;
 struct smf_state *s_stack_settle_ptr;
 struct smf_state *s_stack_img_ptr;
+struct smf_state *s_stack_fly_ptr;
 
 static enum smf_state_result s0_run(void *o) {
   smf_set_state(SMF_CTX(o), s_interactive_ptr);
@@ -116,9 +306,230 @@ static void s_log_state(void *o) {
   struct s_object *s = (struct s_object *)o;
   s->stepper->log_state();
   s->remote->log_state();
+  LOG_INF("trigger=%s", s->trigger->name());
   s->stack.log_state();
   LOG_INF("wait_before_ms=%d, wait_after_ms=%d", s->wait_before_ms,
           s->wait_after_ms);
+  // A read of the state right after boot finds the bounds already
+  publish_pwa_status(s);
+}
+
+static bool is_move_event(const struct event_msg &msg) {
+  return msg.evt.has_value() &&
+         (msg.evt.value() == EVENT_GO || msg.evt.value() == EVENT_GO_TO);
+}
+
+// A followed move is done once the rail stopped, at its target or not. Called
+// before each move is started, an earlier stop does not cancel it.
+static void track_motion(struct s_object *s, uint16_t seq) {
+  atomic_clear(&motion_stopped);
+  if (seq == 0) {
+    return;
+  }
+  if (s->num_motion_seqs == ARRAY_SIZE(s->motion_seqs)) {
+    // the oldest one is no longer followed
+    report_completed(s->motion_seqs[0], -ECANCELED);
+    memmove(&s->motion_seqs[0], &s->motion_seqs[1],
+            sizeof(s->motion_seqs) - sizeof(s->motion_seqs[0]));
+    s->num_motion_seqs--;
+  }
+  s->motion_seqs[s->num_motion_seqs++] = seq;
+}
+
+static void complete_motion(struct s_object *s, int err) {
+  for (int i = 0; i < s->num_motion_seqs; i++) {
+    report_completed(s->motion_seqs[i], err);
+  }
+  s->num_motion_seqs = 0;
+}
+
+// Next event, while moves are followed their end is reported in between.
+// A stop leaves the rail on its target too, so it is told apart by its flag.
+static int interactive_event_get(struct s_object *s, struct event_msg *msg) {
+  while (s->num_motion_seqs > 0) {
+    if (atomic_clear(&motion_stopped)) {
+      complete_motion(s, -ECANCELED);
+      break;
+    }
+    int ret = s->stepper->wait_for_target(K_NO_WAIT);
+    if (ret != -EAGAIN) {
+      complete_motion(s, ret);
+      break;
+    }
+    struct k_poll_event events[] = {
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                                 K_POLL_MODE_NOTIFY_ONLY, &event_prio_msgq),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                                 K_POLL_MODE_NOTIFY_ONLY, &event_msgq),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE,
+                                 K_POLL_MODE_NOTIFY_ONLY,
+                                 s->stepper->motion_done_sem()),
+    };
+    k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+    if (events[0].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE ||
+        events[1].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE) {
+      break;
+    }
+  }
+  return event_get(msg, K_FOREVER);
+}
+
+// Fold a jog and all jogs queued right behind it into one target, so that the
+// stepper gets a single command and a running move is retargeted only once
+static void apply_move_events(struct s_object *s, struct event_msg msg) {
+  int merged = 0;
+  while (true) {
+    track_motion(s, msg.seq);
+    if (msg.evt.value() == EVENT_GO) {
+      LOG_INF("go to position %.3fum", nm_as_um(msg.value));
+      s->stepper->go_relative_nm(msg.value);
+    } else {
+      LOG_INF("go to absolute position %.3fum", nm_as_um(msg.value));
+      s->stepper->set_target_position_nm(msg.value);
+    }
+
+    // Queries waiting in the priority queue go first
+    if (k_msgq_num_used_get(&event_prio_msgq) > 0 ||
+        k_msgq_peek(&event_msgq, &msg) != 0 || !is_move_event(msg) ||
+        k_msgq_get(&event_msgq, &msg, K_NO_WAIT) != 0) {
+      break;
+    }
+    atomic_inc(&events_processed);
+    report_started(msg.seq);
+    merged++;
+  }
+  if (merged > 0) {
+    LOG_INF("merged %d queued moves into one", merged);
+  }
+}
+
+static K_SEM_DEFINE(latency_released_sem, 0, 1);
+
+static void latency_released(int err, void *user_data) {
+  k_sem_give(&latency_released_sem);
+}
+
+// Wait for @p event up to the bound of one frame, a stop cuts it short
+static int latency_wait(struct k_poll_event event) {
+  struct k_poll_event events[] = {
+      event,
+      K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+                               &stop_signal),
+  };
+  int ret = k_poll(events, ARRAY_SIZE(events), K_SECONDS(2));
+  return stop_is_requested() ? -ECANCELED : ret;
+}
+
+static bool latency_wait_for_commands(CameraTrigger *trigger) {
+  while (trigger->pendingCommands() > 0 && !stop_is_requested()) {
+    k_msleep(1);
+  }
+  return !stop_is_requested();
+}
+
+// Shoot @p frames per capture profile as a series and log how long each frame
+// takes until the shutter is released and until the camera reports it done.
+// Runs on the state machine thread, so it is bounded and stops on request.
+static int measure_capture_latency(struct s_object *s, int frames) {
+  static const CaptureProfile profiles[] = {CaptureProfile::FULL_AF,
+                                            CaptureProfile::SHUTTER_ONLY,
+                                            CaptureProfile::HALF_PRESS_HELD};
+  CameraTrigger *trigger = s->trigger;
+  const CaptureProfile previous = trigger->captureProfile();
+
+  if (frames < 1) {
+    frames = 10;
+  }
+  frames = MIN(frames, 100); // as "cam latency" allows
+  // A stop from before has been dealt with
+  clear_stop_request();
+  int err = 0;
+  LOG_INF("Measuring %d frames per profile with the %s trigger", frames,
+          trigger->name());
+  for (CaptureProfile profile : profiles) {
+    if (err) {
+      break;
+    }
+    uint64_t release_sum_us = 0;
+    uint64_t capture_sum_us = 0;
+    uint32_t release_max_us = 0;
+    int shot = 0;
+    int timeouts = 0;
+
+    trigger->setCaptureProfile(profile);
+    trigger->beginSeries();
+    if (!latency_wait_for_commands(trigger)) {
+      err = -ECANCELED;
+    }
+    for (int i = 0; i < frames && !err; i++) {
+      k_sem_reset(&latency_released_sem);
+      const uint32_t start = k_cycle_get_32();
+      if (trigger->shoot(latency_released, nullptr) != 0) {
+        continue;
+      }
+      struct k_poll_event released = K_POLL_EVENT_INITIALIZER(
+          K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+          &latency_released_sem);
+      int ret = latency_wait(released);
+      if (ret == -ECANCELED) {
+        err = ret;
+        break;
+      }
+      if (ret != 0 || k_sem_take(&latency_released_sem, K_NO_WAIT) != 0) {
+        timeouts++;
+        continue;
+      }
+      const uint32_t release_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+      struct k_poll_signal *signal = trigger->captureSignal();
+      if (signal) {
+        struct k_poll_event captured = K_POLL_EVENT_INITIALIZER(
+            K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, signal);
+        ret = latency_wait(captured);
+        if (ret == -ECANCELED) {
+          err = ret;
+          break;
+        }
+        if (ret != 0) {
+          timeouts++;
+        }
+      }
+      capture_sum_us += k_cyc_to_us_floor32(k_cycle_get_32() - start);
+      if (!latency_wait_for_commands(trigger)) {
+        err = -ECANCELED;
+      }
+      release_sum_us += release_us;
+      release_max_us = MAX(release_max_us, release_us);
+      shot++;
+    }
+    trigger->endSeries();
+    if (shot == 0) {
+      LOG_WRN("%s: no frame shot", capture_profile_name(profile));
+      continue;
+    }
+    LOG_INF("%s: %d/%d frames, release avg %u us max %u us, capture avg %u us, "
+            "%d timeouts",
+            capture_profile_name(profile), shot, frames,
+            (uint32_t)(release_sum_us / shot), release_max_us,
+            (uint32_t)(capture_sum_us / shot), timeouts);
+  }
+  trigger->setCaptureProfile(previous);
+  if (err) {
+    LOG_INF("Latency measurement stopped");
+    clear_stop_request();
+  }
+  return err;
+}
+
+// A followed stack is done once it ended, followed moves are superseded by it
+static void start_stack(struct s_object *s, uint16_t seq) {
+  complete_motion(s, -ECANCELED);
+  s->stack_seq = seq;
+  smf_set_state(SMF_CTX(s), s_stack_ptr);
+}
+
+static void complete_stack(struct s_object *s, int err) {
+  report_completed(s->stack_seq, err);
+  s->stack_seq = 0;
 }
 
 static void s_parent_interactive_entry(void *o) { LOG_INF("%s", __FUNCTION__); }
@@ -128,175 +539,243 @@ static void s_parent_interactive_exit(void *o) { LOG_INF("%s", __FUNCTION__); }
 static enum smf_state_result s_interactive_run(void *o) {
   struct s_object *s = (struct s_object *)o;
 
-  const struct zbus_channel *chan;
+  struct event_msg msg;
 
   LOG_DBG("%s, wait for input...", __FUNCTION__);
-  if (!zbus_sub_wait(&event_sub, &chan, K_FOREVER)) {
-    if (&event_msg_chan == chan) {
-      struct event_msg msg;
-      zbus_chan_read(&event_msg_chan, &msg, K_MSEC(100));
-
-      if (!msg.evt.has_value()) {
-        LOG_INF("no value in event_msg");
-        return SMF_EVENT_HANDLED;
-      }
+  if (!interactive_event_get(s, &msg)) {
+    if (!msg.evt.has_value()) {
+      LOG_INF("no value in event_msg");
+      return SMF_EVENT_HANDLED;
+    }
 
-      s->last_event_ms = k_uptime_get();
-      switch (msg.evt.value()) {
-      case EVENT_DISABLE:
-      case EVENT_CAMERA_START_SCAN:
-      case EVENT_CAMERA_STOP_SCAN:
-      case EVENT_SHOOT:
-      case EVENT_RECORD:
-      case EVENT_STATUS:
-        break;
-      default:
-        if (!s->stepper->is_enabled()) {
-          int err = s->stepper->enable();
-          if (err != 0) {
-            LOG_WRN("Failed to enable stepper: %d", err);
-          }
-          k_sleep(K_MSEC(300));
+    s->last_event_ms = k_uptime_get();
+    report_started(msg.seq);
+    // Moves and stacks are reported done later
+    bool done = true;
+    int err = 0;
+    switch (msg.evt.value()) {
+    case EVENT_DISABLE:
+    case EVENT_CAMERA_START_SCAN:
+    case EVENT_CAMERA_STOP_SCAN:
+    case EVENT_SHOOT:
+    case EVENT_RECORD:
+    case EVENT_STATUS:
+      break;
+    default:
+      if (!s->stepper->is_enabled()) {
+        int err = s->stepper->enable();
+        if (err != 0) {
+          LOG_WRN("Failed to enable stepper: %d", err);
         }
+        k_sleep(K_MSEC(300));
       }
+    }
 
-      switch (msg.evt.value()) {
-      case EVENT_GO:
-        LOG_INF("go to position %.3fum", nm_as_um(msg.value));
-        s->stepper->go_relative_nm(msg.value);
-        s->stepper->step_towards_target();
-        break;
-      case EVENT_GO_TO:
-        LOG_INF("go to absolute position %.3fum", nm_as_um(msg.value));
-        s->stepper->set_target_position_nm(msg.value);
-        s->stepper->step_towards_target();
-        break;
-      case EVENT_GO_PCT: {
-        if (msg.value < 0 || msg.value > 100) {
-          LOG_ERR("cannot go to pct, value %d out of range [0-100]", msg.value);
-          break;
-        }
-        int lower = s->stack.get_lower_bound();
-        int upper = s->stack.get_upper_bound();
-        int range = upper - lower;
-        int target = lower + (range * msg.value) / 100;
-        LOG_INF("go to relative position %d%% between upper and lower @ %.3fum",
-                msg.value, nm_as_um(target));
-        s->stepper->set_target_position_nm(target);
-        s->stepper->step_towards_target();
-        break;
-      }
-      case EVENT_SET_LOWER_BOUND: {
-        int lower_bound = s->stepper->get_target_position_nm();
-        LOG_INF("set lower bound to %.3fum", nm_as_um(lower_bound),
-                nm_as_um(s->stack.get_upper_bound()));
-        s->stack.set_lower_bound(lower_bound);
-        s->stack.log_state();
+    switch (msg.evt.value()) {
+    case EVENT_GO:
+    case EVENT_GO_TO:
+      apply_move_events(s, msg);
+      s->stepper->step_towards_target();
+      done = false;
+      break;
+    case EVENT_GO_PCT: {
+      if (msg.value < 0 || msg.value > 100) {
+        LOG_ERR("cannot go to pct, value %d out of range [0-100]", msg.value);
+        err = -EINVAL;
         break;
       }
-      case EVENT_SET_UPPER_BOUND: {
-        int upper_bound = s->stepper->get_target_position_nm();
-        LOG_INF("set upper bound to %.3fum", nm_as_um(upper_bound));
-        s->stack.set_upper_bound(upper_bound);
-        s->stack.log_state();
-        break;
-      }
-      case EVENT_SET_LOWER_BOUND_TO:
-        LOG_INF("set lower bound to %.3fum", nm_as_um(msg.value));
-        s->stack.set_lower_bound(msg.value);
-        s->stack.log_state();
-        break;
-      case EVENT_SET_UPPER_BOUND_TO:
-        LOG_INF("set upper bound to %.3fum", nm_as_um(msg.value));
-        s->stack.set_upper_bound(msg.value);
-        s->stack.log_state();
-        break;
-      case EVENT_SET_WAIT_BEFORE_MS:
-        LOG_INF("set wait before ms to %d", msg.value);
-        s->wait_before_ms = msg.value;
-        break;
-      case EVENT_SET_WAIT_AFTER_MS:
-        LOG_INF("set wait after ms to %d", msg.value);
-        s->wait_after_ms = msg.value;
-        break;
-      case EVENT_SET_SPEED:
-        switch (msg.value) {
-        case 1:
-          LOG_INF("Setting movement speed to SLOW");
-          s->stepper->set_speed(StepperSpeed::SLOW);
-          break;
-        case 2:
-          LOG_INF("Setting movement speed to MEDIUM");
-          s->stepper->set_speed(StepperSpeed::MEDIUM);
-          break;
-        case 3:
-          LOG_INF("Setting movement speed to FAST");
-          s->stepper->set_speed(StepperSpeed::FAST);
-          break;
-        default:
-          LOG_WRN("Unsupported speed preset %d (expected 1-3)", msg.value);
-          break;
-        }
+      int lower = s->stack.get_lower_bound();
+      int upper = s->stack.get_upper_bound();
+      int range = upper - lower;
+      int target = lower + (range * msg.value) / 100;
+      LOG_INF("go to relative position %d%% between upper and lower @ %.3fum",
+              msg.value, nm_as_um(target));
+      track_motion(s, msg.seq);
+      s->stepper->set_target_position_nm(target);
+      s->stepper->step_towards_target();
+      done = false;
+      break;
+    }
+    case EVENT_SET_LOWER_BOUND: {
+      int lower_bound = s->stepper->get_target_position_nm();
+      LOG_INF("set lower bound to %.3fum", nm_as_um(lower_bound),
+              nm_as_um(s->stack.get_upper_bound()));
+      s->stack.set_lower_bound(lower_bound);
+      s->stack.log_state();
+      break;
+    }
+    case EVENT_SET_UPPER_BOUND: {
+      int upper_bound = s->stepper->get_target_position_nm();
+      LOG_INF("set upper bound to %.3fum", nm_as_um(upper_bound));
+      s->stack.set_upper_bound(upper_bound);
+      s->stack.log_state();
+      break;
+    }
+    case EVENT_SET_LOWER_BOUND_TO:
+      LOG_INF("set lower bound to %.3fum", nm_as_um(msg.value));
+      s->stack.set_lower_bound(msg.value);
+      s->stack.log_state();
+      break;
+    case EVENT_SET_UPPER_BOUND_TO:
+      LOG_INF("set upper bound to %.3fum", nm_as_um(msg.value));
+      s->stack.set_upper_bound(msg.value);
+      s->stack.log_state();
+      break;
+    case EVENT_SET_WAIT_BEFORE_MS:
+      LOG_INF("set wait before ms to %d", msg.value);
+      s->wait_before_ms = msg.value;
+      break;
+    case EVENT_SET_WAIT_AFTER_MS:
+      LOG_INF("set wait after ms to %d", msg.value);
+      s->wait_after_ms = msg.value;
+      break;
+    case EVENT_SET_SPEED:
+      switch (msg.value) {
+      case 1:
+        LOG_INF("Setting movement speed to SLOW");
+        s->stepper->set_speed(StepperSpeed::SLOW);
         break;
-      case EVENT_SET_SPEED_RPM:
-        if (msg.value < 1) {
-          LOG_WRN("Ignoring RPM update with invalid value %d", msg.value);
-          break;
-        }
-        LOG_INF("Setting movement speed to %d RPM", msg.value);
-        s->stepper->set_speed_rpm(msg.value);
+      case 2:
+        LOG_INF("Setting movement speed to MEDIUM");
+        s->stepper->set_speed(StepperSpeed::MEDIUM);
         break;
-      case EVENT_DISABLE:
-        LOG_INF("Disabling stepper until next event");
-        s->stepper->pause();
-        s->stepper->disable();
+      case 3:
+        LOG_INF("Setting movement speed to FAST");
+        s->stepper->set_speed(StepperSpeed::FAST);
         break;
-      case EVENT_CAMERA_START_SCAN:
-        LOG_INF("Starting camera startScan");
-        if (!s->remote) {
-          LOG_WRN("No remote available");
-        } else {
-          s->remote->startScan();
-          k_msleep(100);
-        }
-        break;
-      case EVENT_CAMERA_STOP_SCAN:
-        LOG_INF("Starting camera stopScan");
-        if (!s->remote) {
-          LOG_WRN("No remote available");
-        } else {
-          s->remote->startScan();
-          k_msleep(100);
-        }
+      default:
+        LOG_WRN("Unsupported speed preset %d (expected 1-3)", msg.value);
+        err = -EINVAL;
         break;
-      case EVENT_START_STACK_WITH_STEP_SIZE:
-        LOG_INF("Starting stack..., %d images", msg.value);
-        s->stack.set_expected_step_size(msg.value);
-        smf_set_state(SMF_CTX(o), s_stack_ptr);
+      }
+      break;
+    case EVENT_SET_SPEED_RPM:
+      if (msg.value < 1) {
+        LOG_WRN("Ignoring RPM update with invalid value %d", msg.value);
+        err = -EINVAL;
         break;
-      case EVENT_START_STACK_WITH_LENGTH:
-        LOG_INF("Starting stack..., %d images", msg.value);
-        s->stack.set_expected_length_of_stack(msg.value);
-        smf_set_state(SMF_CTX(o), s_stack_ptr);
+      }
+      LOG_INF("Setting movement speed to %d RPM", msg.value);
+      s->stepper->set_speed_rpm(msg.value);
+      break;
+    case EVENT_DISABLE:
+      LOG_INF("Disabling stepper until next event");
+      s->stepper->pause();
+      s->stepper->disable();
+      break;
+    case EVENT_CAMERA_START_SCAN:
+      LOG_INF("Starting camera startScan");
+      if (!s->remote) {
+        LOG_WRN("No remote available");
+        err = -ENODEV;
+      } else {
+        s->remote->startScan();
+        k_msleep(100);
+      }
+      break;
+    case EVENT_CAMERA_STOP_SCAN:
+      LOG_INF("Starting camera stopScan");
+      if (!s->remote) {
+        LOG_WRN("No remote available");
+        err = -ENODEV;
+      } else {
+        s->remote->startScan();
+        k_msleep(100);
+      }
+      break;
+    case EVENT_START_STACK_WITH_STEP_SIZE:
+      LOG_INF("Starting stack..., %d images", msg.value);
+      s->fly_fps = 0;
+      s->stack.set_expected_step_size(msg.value);
+      start_stack(s, msg.seq);
+      done = false;
+      break;
+    case EVENT_START_STACK_WITH_LENGTH:
+      LOG_INF("Starting stack..., %d images", msg.value);
+      s->fly_fps = 0;
+      s->stack.set_expected_length_of_stack(msg.value);
+      start_stack(s, msg.seq);
+      done = false;
+      break;
+    case EVENT_START_STACK_WITH_PLAN:
+      LOG_INF("Starting stack along the uploaded plan");
+      s->fly_fps = 0;
+      s->stack.use_positions();
+      start_stack(s, msg.seq);
+      done = false;
+      break;
+    case EVENT_START_STACK_WITH_SEGMENTS:
+      LOG_INF("Starting stack along the segment plan");
+      s->fly_fps = 0;
+      s->stack.use_segments();
+      start_stack(s, msg.seq);
+      done = false;
+      break;
+    case EVENT_START_FLYING_STACK:
+      if (msg.value < 1) {
+        LOG_WRN("Flying stack needs a frame rate >= 1, got %d", msg.value);
+        err = -EINVAL;
         break;
-      case EVENT_SHOOT:
-        LOG_INF("Triggering camera shoot");
-        s->remote->shoot();
+      }
+      if (!s->stack.has_even_steps()) {
+        // One speed for all frames, the spacing of a plan varies
+        LOG_WRN("Flying stack needs even steps, not a plan");
+        err = -ENOTSUP;
         break;
-      case EVENT_RECORD:
-        LOG_INF("Toggling camera recording");
-        s->remote->recToggle();
+      }
+      LOG_INF("Starting flying stack at %d frames/s", msg.value);
+      s->fly_fps = msg.value;
+      start_stack(s, msg.seq);
+      done = false;
+      break;
+    case EVENT_SHOOT:
+      LOG_INF("Triggering camera shoot");
+      err = s->trigger->shoot();
+      break;
+    case EVENT_RECORD:
+      LOG_INF("Toggling camera recording");
+      s->remote->recToggle();
+      break;
+    case EVENT_SET_CAPTURE_PROFILE:
+      if (msg.value < (int)CaptureProfile::FULL_AF ||
+          msg.value > (int)CaptureProfile::HALF_PRESS_HELD) {
+        LOG_WRN("Unsupported capture profile %d", msg.value);
+        err = -EINVAL;
         break;
-      case EVENT_STATUS:
-        s_log_state(s);
+      }
+      s->capture_profile = (CaptureProfile)msg.value;
+      LOG_INF("Stacks use capture profile %s",
+              capture_profile_name(s->capture_profile));
+      break;
+    case EVENT_MEASURE_CAPTURE_LATENCY:
+      err = measure_capture_latency(s, msg.value);
+      break;
+    case EVENT_SET_TRIGGER: {
+      CameraTrigger *trigger = get_trigger(msg.value);
+      if (!trigger) {
+        LOG_WRN("No trigger backend %d", msg.value);
+        err = -ENODEV;
         break;
-      default:
-        LOG_INF("unsupported event: %d", msg.evt.value());
       }
-      publish_pwa_status(s);
+      s->trigger = trigger;
+      LOG_INF("Shooting through the %s trigger", trigger->name());
+      break;
     }
+    case EVENT_STATUS:
+      s_log_state(s);
+      publish_pwa_status(s, true);
+      break;
+    default:
+      LOG_INF("unsupported event: %d", msg.evt.value());
+      err = -ENOTSUP;
+    }
+    if (done) {
+      report_completed(msg.seq, err);
+    }
+    update_stack_timing(s);
+    publish_pwa_status(s);
   } else {
-    LOG_ERR("failed to wait for zbus");
+    LOG_ERR("failed to wait for event");
   }
   return SMF_EVENT_HANDLED;
 }
@@ -304,78 +783,430 @@ static enum smf_state_result s_interactive_run(void *o) {
 static void s_parent_stacking_entry(void *o) {
   struct s_object *s = (struct s_object *)o;
 
-  if (!s->remote->ready()) {
+  if (!s->trigger->ready()) {
     LOG_WRN("Cannot start stacking - camera not connected");
+    complete_stack(s, -ENOTCONN);
     smf_set_state(SMF_CTX(o), s_interactive_ptr);
     return;
   }
 
   // wait for camera to be ready
-  while (!s->remote->ready()) {
+  while (!s->trigger->ready()) {
     LOG_INF("Waiting for camera to be ready...");
     k_sleep(K_SECONDS(1));
   }
   LOG_DBG("Camera is ready, starting stack");
 
-  s->stepper->set_speed(StepperSpeed::SLOW);
-  s->stack.start_stack();
+  // The plan cannot be replaced while it is stacked
+  if (s->stack.uses_positions()) {
+    const int32_t *positions;
+    int count = plan_acquire(&positions);
+    if (count < 0) {
+      LOG_WRN("Cannot start stacking - no plan uploaded");
+      complete_stack(s, count);
+      smf_set_state(SMF_CTX(o), s_interactive_ptr);
+      return;
+    }
+    s->stack.set_positions(positions, count);
+  }
+
+  // A stop sent while idle must not end the new stack right away
+  clear_stop_request();
+
+  s->stepper->set_speed(stack_speed(s));
+  if (!s->stack.start_stack().has_value()) {
+    LOG_WRN("Cannot start stacking - nothing to stack");
+    complete_stack(s, -EINVAL);
+    smf_set_state(SMF_CTX(o), s_interactive_ptr);
+    return;
+  }
+
+  s->trigger->setLowLatency(true);
+  s->trigger->setCaptureProfile(s->capture_profile);
+  s->trigger->beginSeries();
 }
 
 static void s_parent_stacking_exit(void *o) {
   struct s_object *s = (struct s_object *)o;
 
+  s->trigger->endSeries();
+  s->trigger->setCaptureProfile(CaptureProfile::FULL_AF);
+  s->trigger->setLowLatency(false);
+
+  s->stepper->clear_position_trigger();
   s->stepper->set_speed(StepperSpeed::MEDIUM);
+  plan_release();
+}
+
+// The stacking states never block for long: every wait is a k_poll on the
+// stop signal, the event queues and, while moving, the end of the move, a
+// frame triggered on the way or the camera reporting a frame as done, bounded
+// by the deadline of the current state.
+enum stack_wakeup {
+  STACK_WAKEUP_STOP,
+  STACK_WAKEUP_EVENT,
+  STACK_WAKEUP_MOTION,
+  STACK_WAKEUP_TIMEOUT,
+};
+
+static enum stack_wakeup
+stack_wait(struct s_object *s, k_timeout_t timeout, bool wait_for_motion,
+           struct k_poll_signal *signal = nullptr) {
+  struct k_poll_event events[5];
+  int num_events = 0;
+
+  k_poll_event_init(&events[num_events++], K_POLL_TYPE_SIGNAL,
+                    K_POLL_MODE_NOTIFY_ONLY, &stop_signal);
+  k_poll_event_init(&events[num_events++], K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                    K_POLL_MODE_NOTIFY_ONLY, &event_prio_msgq);
+  k_poll_event_init(&events[num_events++], K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                    K_POLL_MODE_NOTIFY_ONLY, &event_msgq);
+  if (wait_for_motion) {
+    k_poll_event_init(&events[num_events++], K_POLL_TYPE_SEM_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY, s->stepper->motion_done_sem());
+  }
+  if (signal) {
+    k_poll_event_init(&events[num_events++], K_POLL_TYPE_SIGNAL,
+                      K_POLL_MODE_NOTIFY_ONLY, signal);
+  }
+
+  int ret = k_poll(events, num_events, timeout);
+  if (stop_is_requested()) {
+    return STACK_WAKEUP_STOP;
+  }
+  if (ret == -EAGAIN) {
+    return STACK_WAKEUP_TIMEOUT;
+  }
+  if (events[1].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE ||
+      events[2].state == K_POLL_STATE_MSGQ_DATA_AVAILABLE) {
+    return STACK_WAKEUP_EVENT;
+  }
+  return STACK_WAKEUP_MOTION;
+}
+
+// Events that arrive mid-frame: answer queries right away, keep settings for
+// the next frame and drop anything that would move the rail.
+static void stack_handle_event(struct s_object *s) {
+  struct event_msg msg;
+  if (event_get(&msg, K_NO_WAIT) != 0 || !msg.evt.has_value()) {
+    return;
+  }
+
+  s->last_event_ms = k_uptime_get();
+  report_started(msg.seq);
+  int err = 0;
+  switch (msg.evt.value()) {
+  case EVENT_STATUS:
+    s_log_state(s);
+    publish_pwa_status(s, true);
+    break;
+  case EVENT_SET_WAIT_BEFORE_MS:
+    LOG_INF("set wait before ms to %d", msg.value);
+    s->wait_before_ms = msg.value;
+    break;
+  case EVENT_SET_WAIT_AFTER_MS:
+    LOG_INF("set wait after ms to %d", msg.value);
+    s->wait_after_ms = msg.value;
+    break;
+  default:
+    LOG_WRN("Ignoring event %d while stacking", msg.evt.value());
+    err = -EBUSY;
+    break;
+  }
+  report_completed(msg.seq, err);
+  publish_pwa_status(s);
+}
+
+static void stack_stop(void *o) {
+  struct s_object *s = (struct s_object *)o;
+
+  s->stepper->pause();
+  // No frame of a flying stack may trigger after it ended
+  s->stepper->clear_position_trigger();
+  LOG_INF("Stop requested, ending stack (%u us after request)",
+          us_since_stop_request());
+  clear_stop_request();
+  s->stack.stop_stack();
+  complete_stack(s, -ECANCELED);
+  smf_set_state(SMF_CTX(o), s_interactive_ptr);
+  publish_pwa_status(s);
 }
 
 static enum smf_state_result s_stack_run(void *o) {
   struct s_object *s = (struct s_object *)o;
   if (s->stack.stack_in_progress()) {
     if (stop_is_requested()) {
-      LOG_INF("Stop requested, ending stack");
-      clear_stop_request();
-      s->stack.stop_stack();
-      smf_set_state(SMF_CTX(o), s_interactive_ptr);
-      publish_pwa_status(s);
+      stack_stop(o);
       return SMF_EVENT_HANDLED;
     }
     LOG_INF("Stacking:");
     s->stack.log_state();
+    if (s->fly_fps > 0 && s->stack.get_index_in_stack().value() > 0) {
+      // The first frame is taken at rest, the rest on the fly
+      smf_set_state(SMF_CTX(o), s_stack_fly_ptr);
+      publish_pwa_status(s);
+      return SMF_EVENT_HANDLED;
+    }
     int current_target = s->stack.get_current_target().value();
     s->stepper->set_target_position_nm(current_target);
     smf_set_state(SMF_CTX(o), s_stack_move_ptr);
   } else {
     LOG_INF("Stacking DONE");
     s->stack.flip_start_at();
+    complete_stack(s, 0);
     smf_set_state(SMF_CTX(o), s_interactive_ptr);
   }
   publish_pwa_status(s);
   return SMF_EVENT_HANDLED;
 }
 
-static enum smf_state_result s_stack_move_run(void *o) {
+static void s_stack_move_entry(void *o) {
   LOG_DBG("%s", __FUNCTION__);
   struct s_object *s = (struct s_object *)o;
   s->stepper->step_towards_target();
-  s->stepper->wait_and_pause();
+}
+
+static enum smf_state_result s_stack_move_run(void *o) {
+  struct s_object *s = (struct s_object *)o;
+
+  int ret = s->stepper->wait_for_target(K_NO_WAIT);
+  if (ret == -EAGAIN) {
+    switch (stack_wait(s, K_FOREVER, true)) {
+    case STACK_WAKEUP_STOP:
+      stack_stop(o);
+      break;
+    case STACK_WAKEUP_EVENT:
+      stack_handle_event(s);
+      break;
+    default:
+      // end of the move is picked up by the next run
+      break;
+    }
+    return SMF_EVENT_HANDLED;
+  }
+  if (ret < 0) {
+    LOG_WRN("Move ended at %.3fum instead of %.3fum: %d",
+            nm_as_um(s->stepper->get_position_nm()),
+            nm_as_um(s->stepper->get_target_position_nm()), ret);
+  }
   smf_set_state(SMF_CTX(o), s_stack_settle_ptr);
   return SMF_EVENT_HANDLED;
 }
 
-static enum smf_state_result s_stack_settle_run(void *o) {
+static void s_stack_settle_entry(void *o) {
   LOG_DBG("%s", __FUNCTION__);
   struct s_object *s = (struct s_object *)o;
-  k_sleep(K_MSEC(s->wait_before_ms));
-  smf_set_state(SMF_CTX(o), s_stack_img_ptr);
+  s->stack_deadline = sys_timepoint_calc(K_MSEC(s->wait_before_ms));
+}
+
+static enum smf_state_result s_stack_settle_run(void *o) {
+  struct s_object *s = (struct s_object *)o;
+  switch (stack_wait(s, sys_timepoint_timeout(s->stack_deadline), false)) {
+  case STACK_WAKEUP_STOP:
+    stack_stop(o);
+    break;
+  case STACK_WAKEUP_EVENT:
+    stack_handle_event(s);
+    break;
+  default:
+    smf_set_state(SMF_CTX(o), s_stack_img_ptr);
+    break;
+  }
   return SMF_EVENT_HANDLED;
 }
 
+// Raised from the trigger once the shutter was released
+static struct k_poll_signal shutter_released_signal =
+    K_POLL_SIGNAL_INITIALIZER(shutter_released_signal);
+
+static void shutter_released(int err, void *user_data) {
+  ARG_UNUSED(user_data);
+  k_poll_signal_raise(&shutter_released_signal, err);
+}
+
+static void s_stack_img_entry(void *o) {
+  LOG_DBG("%s", __FUNCTION__);
+  struct s_object *s = (struct s_object *)o;
+  k_poll_signal_reset(&shutter_released_signal);
+  s->shutter_released = false;
+  int err = s->trigger->shoot(shutter_released, nullptr);
+  if (err) {
+    LOG_WRN("Frame %d not shot (%d)",
+            s->stack.get_index_in_stack().value_or(-1), err);
+    k_poll_signal_raise(&shutter_released_signal, err);
+  }
+  // Bound for the shutter release, wait_after_ms starts once it is written
+  s->stack_deadline = sys_timepoint_calc(K_SECONDS(1));
+}
+
+// Switches to the wait_after_ms bound the first time the shutter release is
+// seen written, whatever woke the state up
+static bool note_shutter_released(struct s_object *s) {
+  unsigned int released;
+  int result;
+
+  if (!s->shutter_released) {
+    k_poll_signal_check(&shutter_released_signal, &released, &result);
+    if (released) {
+      s->shutter_released = true;
+      s->stack_deadline = sys_timepoint_calc(K_MSEC(s->wait_after_ms));
+    }
+  }
+  return s->shutter_released;
+}
+
+// Waits for the shutter release to be written, then moves on once the camera
+// reports the frame as done. wait_after_ms is only the upper bound for
+// cameras that do not report.
 static enum smf_state_result s_stack_img_run(void *o) {
   struct s_object *s = (struct s_object *)o;
+
+  struct k_poll_signal *signal = note_shutter_released(s)
+                                     ? s->trigger->captureSignal()
+                                     : &shutter_released_signal;
+  switch (stack_wait(s, sys_timepoint_timeout(s->stack_deadline), false,
+                     signal)) {
+  case STACK_WAKEUP_STOP:
+    stack_stop(o);
+    break;
+  case STACK_WAKEUP_EVENT:
+    stack_handle_event(s);
+    note_shutter_released(s);
+    break;
+  default:
+    if (!s->shutter_released) {
+      if (note_shutter_released(s)) {
+        // shutter release written, now wait for the frame
+        break;
+      }
+      LOG_WRN("Shutter release not written in time");
+    }
+    s->stack.increment_target();
+    smf_set_state(SMF_CTX(o), s_stack_ptr);
+    break;
+  }
+  return SMF_EVENT_HANDLED;
+}
+
+// ############################################################################
+// Flying stack: the stepper keeps moving from the first to the last frame and
+// every planned position it passes triggers the next frame
+
+static atomic_t fly_frames_triggered = ATOMIC_INIT(0);
+static uint32_t fly_frames_shot;
+static struct k_poll_signal fly_frame_signal =
+    K_POLL_SIGNAL_INITIALIZER(fly_frame_signal);
+
+// The next positions to arm, computed ahead by the state machine so that the
+// step timing context never touches the stack. Single producer, single
+// consumer: only the state machine moves fly_ahead_put and only
+// fly_position_reached() moves fly_ahead_taken.
+#define FLY_AHEAD 8
+static int32_t fly_ahead_nm[FLY_AHEAD];
+static atomic_t fly_ahead_put = ATOMIC_INIT(0);
+static atomic_t fly_ahead_taken = ATOMIC_INIT(0);
+static int fly_ahead_index; // stack index of the next position to put
+
+// Runs in the step timing context, arms the position of the next frame
+static void fly_position_reached(void *user_data) {
+  struct s_object *s = (struct s_object *)user_data;
+
+  atomic_inc(&fly_frames_triggered);
+  const atomic_val_t taken = atomic_get(&fly_ahead_taken);
+  if (taken != atomic_get(&fly_ahead_put)) {
+    s->stepper->set_position_trigger_nm(fly_ahead_nm[taken % FLY_AHEAD],
+                                        fly_position_reached, s);
+    atomic_set(&fly_ahead_taken, taken + 1);
+  }
+  k_poll_signal_raise(&fly_frame_signal, 0);
+}
+
+static void fly_fill_ahead(struct s_object *s) {
+  atomic_val_t put = atomic_get(&fly_ahead_put);
+  while (put - atomic_get(&fly_ahead_taken) < FLY_AHEAD) {
+    std::optional<int> next = s->stack.get_target(fly_ahead_index);
+    if (!next.has_value()) {
+      break;
+    }
+    fly_ahead_nm[put % FLY_AHEAD] = next.value();
+    atomic_set(&fly_ahead_put, ++put);
+    fly_ahead_index++;
+  }
+}
+
+static void s_stack_fly_entry(void *o) {
   LOG_DBG("%s", __FUNCTION__);
-  s->remote->shoot();
-  k_sleep(K_MSEC(s->wait_after_ms));
-  s->stack.increment_target();
-  smf_set_state(SMF_CTX(o), s_stack_ptr);
+  struct s_object *s = (struct s_object *)o;
+
+  // Pass one frame per 1/fps seconds
+  s->stepper->set_speed_nm_per_s(s->stack.get_step_size() * s->fly_fps);
+
+  atomic_clear(&fly_frames_triggered);
+  fly_frames_shot = 0;
+  k_poll_signal_reset(&fly_frame_signal);
+  atomic_clear(&fly_ahead_put);
+  atomic_clear(&fly_ahead_taken);
+  fly_ahead_index = s->stack.get_index_in_stack().value() + 1;
+  fly_fill_ahead(s);
+  s->stepper->set_position_trigger_nm(s->stack.get_current_target().value(),
+                                      fly_position_reached, s);
+  s->stepper->set_target_position_nm(s->stack.get_last_target());
+  s->stepper->step_towards_target();
+}
+
+static enum smf_state_result s_stack_fly_run(void *o) {
+  struct s_object *s = (struct s_object *)o;
+
+  k_poll_signal_reset(&fly_frame_signal);
+  fly_fill_ahead(s);
+  const uint32_t triggered = (uint32_t)atomic_get(&fly_frames_triggered);
+  if (fly_frames_shot < triggered) {
+    if (triggered - fly_frames_shot > 1) {
+      LOG_WRN("Camera is %u frames behind", triggered - fly_frames_shot);
+    }
+    fly_frames_shot++;
+    s->stack.increment_target();
+    int err = s->trigger->shoot();
+    if (err) {
+      LOG_WRN("Frame %u not shot (%d)", fly_frames_shot, err);
+    }
+    publish_pwa_status(s);
+    return SMF_EVENT_HANDLED;
+  }
+
+  int ret = s->stepper->wait_for_target(K_NO_WAIT);
+  if (ret != -EAGAIN) {
+    s->stepper->clear_position_trigger();
+    // The last position may have been passed right before the move ended
+    if (fly_frames_shot < (uint32_t)atomic_get(&fly_frames_triggered)) {
+      return SMF_EVENT_HANDLED;
+    }
+    LOG_INF("Flying stack shot %u frames", fly_frames_shot);
+    // Positions not handed over in time were passed without a frame, they
+    // are not taken at rest either
+    if (s->stack.stack_in_progress()) {
+      LOG_WRN("Flying stack skipped %d frames",
+              s->stack.get_length_of_stack().value() -
+                  s->stack.get_index_in_stack().value());
+    }
+    while (s->stack.stack_in_progress()) {
+      s->stack.increment_target();
+    }
+    smf_set_state(SMF_CTX(o), s_stack_ptr);
+    return SMF_EVENT_HANDLED;
+  }
+
+  switch (stack_wait(s, K_FOREVER, true, &fly_frame_signal)) {
+  case STACK_WAKEUP_STOP:
+    stack_stop(o);
+    break;
+  case STACK_WAKEUP_EVENT:
+    stack_handle_event(s);
+    break;
+  default:
+    // frames and the end of the move are picked up by the next run
+    break;
+  }
   return SMF_EVENT_HANDLED;
 }
 
@@ -390,14 +1221,19 @@ static struct smf_state stack_states[] = {
     SMF_CREATE_STATE(s_parent_stacking_entry, NULL, s_parent_stacking_exit,
                      NULL, NULL),                          // S_PARENT_STACKING
     SMF_CREATE_STATE(NULL, s_stack_run, NULL, NULL, NULL), // S_STACK
-    SMF_CREATE_STATE(NULL, s_stack_move_run, NULL, NULL, NULL), // S_STACK_MOVE
-    SMF_CREATE_STATE(NULL, s_stack_settle_run, NULL, NULL,
-                     NULL),                                    // S_STACK_SETTLE
-    SMF_CREATE_STATE(NULL, s_stack_img_run, NULL, NULL, NULL), // S_STACK_IMG
+    SMF_CREATE_STATE(s_stack_move_entry, s_stack_move_run, NULL, NULL,
+                     NULL), // S_STACK_MOVE
+    SMF_CREATE_STATE(s_stack_settle_entry, s_stack_settle_run, NULL, NULL,
+                     NULL), // S_STACK_SETTLE
+    SMF_CREATE_STATE(s_stack_img_entry, s_stack_img_run, NULL, NULL,
+                     NULL), // S_STACK_IMG
+    SMF_CREATE_STATE(s_stack_fly_entry, s_stack_fly_run, NULL, NULL,
+                     NULL), // S_STACK_FLY
 };
 
 StateMachine::StateMachine(const StepperWithTarget *stepper,
-                           const SonyRemote *remote) {
+                           const SonyRemote *remote,
+                           CameraTrigger *trigger) {
   LOG_INF("%s", __FUNCTION__);
 
   // Set up parent pointers after array initialization
@@ -406,6 +1242,7 @@ StateMachine::StateMachine(const StepperWithTarget *stepper,
   stack_states[S_STACK_MOVE].parent = &stack_states[S_PARENT_STACKING];
   stack_states[S_STACK_SETTLE].parent = &stack_states[S_PARENT_STACKING];
   stack_states[S_STACK_IMG].parent = &stack_states[S_PARENT_STACKING];
+  stack_states[S_STACK_FLY].parent = &stack_states[S_PARENT_STACKING];
 
   s0_ptr = &stack_states[S0];
   s_interactive_ptr = &stack_states[S_INTERACTIVE];
@@ -413,13 +1250,17 @@ StateMachine::StateMachine(const StepperWithTarget *stepper,
   s_stack_move_ptr = &stack_states[S_STACK_MOVE];
   s_stack_settle_ptr = &stack_states[S_STACK_SETTLE];
   s_stack_img_ptr = &stack_states[S_STACK_IMG];
+  s_stack_fly_ptr = &stack_states[S_STACK_FLY];
 
   s_obj.stepper = stepper;
   s_obj.remote = remote;
+  s_obj.trigger = trigger;
   Stack stack;
   s_obj.stack = stack;
   s_obj.last_event_ms = k_uptime_get();
+  update_stack_timing(&s_obj);
   auto_disable_ctx = &s_obj;
+  stop_stepper = stepper;
   k_work_reschedule(&auto_disable_work, K_SECONDS(30));
 
   smf_set_initial(SMF_CTX(&s_obj), s0_ptr);
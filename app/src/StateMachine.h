@@ -9,18 +9,13 @@
 #include <zephyr/input/input.h>
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
-#include <zephyr/zbus/zbus.h>
 
 #include <zephyr/smf.h>
 
 #include <zephyr/logging/log.h>
 
+#include "CameraTrigger.h"
 #include "Stack.h"
-#ifdef CONFIG_BT
-#include "sony_remote/sony_remote.h"
-#else
-#include "sony_remote/fake_sony_remote.h"
-#endif
 #include "stepper_with_target/StepperWithTarget.h"
 
 enum event {
@@ -40,17 +35,61 @@ enum event {
   EVENT_CAMERA_STOP_SCAN,
   EVENT_START_STACK_WITH_STEP_SIZE,
   EVENT_START_STACK_WITH_LENGTH,
+  EVENT_START_STACK_WITH_PLAN,
+  EVENT_START_STACK_WITH_SEGMENTS,
+  EVENT_START_FLYING_STACK,
   EVENT_STOP,
   EVENT_SHOOT,
   EVENT_RECORD,
+  EVENT_SET_CAPTURE_PROFILE,
+  EVENT_MEASURE_CAPTURE_LATENCY,
+  EVENT_SET_TRIGGER,
   EVENT_STATUS,
 };
 struct event_msg {
   std::optional<event> evt;
   int value;
+  uint16_t seq; // command sequence number, 0 if nobody follows it
 };
 int event_pub(event event);
 int event_pub(event event, int value);
+/**
+ * @brief Publish an event for a command that the client follows.
+ *
+ * The state machine reports when it starts the command and when it is done
+ * with it, a move once the rail stopped and a stack once it ended.
+ */
+int event_pub(event event, int value, uint16_t seq);
+
+/* Queries overtake the other events in a queue of their own */
+bool event_is_priority(event event);
+
+/**
+ * @brief Make sure a batch of events is queued as a whole.
+ *
+ * On success other threads cannot publish until event_pub_batch_end(), so
+ * the @p count events, @p prio_count of them priority ones, all fit.
+ *
+ * @return 0, or -ENOMSG without room for all of them
+ */
+int event_pub_batch_begin(size_t count, size_t prio_count);
+void event_pub_batch_end();
+
+struct event_stats {
+  uint32_t published;
+  uint32_t processed;
+  uint32_t dropped;
+};
+const struct event_stats get_event_stats();
+
+/**
+ * @brief Estimate how long a stack takes with the current settings.
+ *
+ * Per frame the waits before and after the shot, plus the travel at the
+ * speed of stacks. Ramps and the time to shoot are not counted.
+ */
+uint32_t stack_eta_ms(uint32_t frames, uint32_t travel_nm);
+
 void input_cb(struct input_event *evt, void *user_data);
 
 enum stack_state {
@@ -63,7 +102,8 @@ enum stack_state {
   S_STACK,
   S_STACK_MOVE,
   S_STACK_SETTLE,
-  S_STACK_IMG
+  S_STACK_IMG,
+  S_STACK_FLY
 };
 
 struct s_object {
@@ -71,17 +111,28 @@ struct s_object {
   /* Other state specific data add here */
   const StepperWithTarget *stepper;
   const SonyRemote *remote;
+  CameraTrigger *trigger; // shoots the frames
   const Stack stack;
   int wait_before_ms = 1000;
   int wait_after_ms = 500;
   int64_t last_event_ms = 0;
+  k_timepoint_t stack_deadline;
+  bool shutter_released = false; // of the current frame, see s_stack_img_run
+  int fly_fps = 0; // > 0 shoots on the fly at this frame rate
+  // Used for stacks, the lens stays put so there is nothing to focus per frame
+  CaptureProfile capture_profile = CaptureProfile::HALF_PRESS_HELD;
+  // Commands that are still running, reported done later
+  uint16_t stack_seq = 0;
+  uint16_t motion_seqs[4] = {};
+  uint8_t num_motion_seqs = 0;
 };
 
 class StateMachine {
   struct s_object s_obj;
 
 public:
-  StateMachine(const StepperWithTarget *stepper, const SonyRemote *remote);
+  StateMachine(const StepperWithTarget *stepper, const SonyRemote *remote,
+               CameraTrigger *trigger);
 
   int32_t run_state_machine();
 
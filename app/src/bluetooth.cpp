@@ -12,6 +12,13 @@
 
 LOG_MODULE_REGISTER(bluetooth, LOG_LEVEL_INF);
 
+// One connection and one bond for the PWA, one each per camera
+BUILD_ASSERT(CONFIG_BT_MAX_CONN > CONFIG_RAIL_CAMERAS,
+             "CONFIG_BT_MAX_CONN too small for CONFIG_RAIL_CAMERAS");
+BUILD_ASSERT(CONFIG_BT_MAX_PAIRED > CONFIG_RAIL_CAMERAS,
+             "CONFIG_BT_MAX_PAIRED too small for CONFIG_RAIL_CAMERAS");
+BUILD_ASSERT(CONFIG_RAIL_CAMERAS <= SonyRemote::MAX_CAMERAS);
+
 static void unified_connected(struct bt_conn *conn, uint8_t err) {
   struct bt_conn_info info;
   bt_conn_get_info(conn, &info);
@@ -53,10 +60,39 @@ static void unified_security_changed(struct bt_conn *conn, bt_security_t level,
   }
 }
 
+static void unified_le_param_updated(struct bt_conn *conn, uint16_t interval,
+                                     uint16_t latency, uint16_t timeout) {
+  struct bt_conn_info info;
+  bt_conn_get_info(conn, &info);
+
+  if (info.role == BT_CONN_ROLE_CENTRAL) {
+    SonyRemote::on_param_updated(conn, interval, latency, timeout);
+  } else if (info.role == BT_CONN_ROLE_PERIPHERAL) {
+    LOG_INF("PWA connection interval %u us",
+            BT_CONN_INTERVAL_TO_US(interval));
+  }
+}
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+static void unified_le_phy_updated(struct bt_conn *conn,
+                                   struct bt_conn_le_phy_info *param) {
+  struct bt_conn_info info;
+  bt_conn_get_info(conn, &info);
+
+  if (info.role == BT_CONN_ROLE_CENTRAL) {
+    SonyRemote::on_phy_updated(conn, param);
+  }
+}
+#endif
+
 static bt_conn_cb kConnCbs = {
     .connected = unified_connected,
     .disconnected = unified_disconnected,
+    .le_param_updated = unified_le_param_updated,
     .security_changed = unified_security_changed,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+    .le_phy_updated = unified_le_phy_updated,
+#endif
 };
 
 static void unified_auth_cancel(struct bt_conn *conn) {
@@ -151,6 +187,10 @@ SonyRemote *init_bluetooth(void) {
     LOG_ERR("settings_load failed (%d), but continue...", err);
   }
 #endif
+  // Before anything can connect, the cached handles of a bonded camera let
+  // remote.connect() come up right away
+  bt_conn_cb_register(&kConnCbs);
+  bt_conn_auth_cb_register(&kAuthCbs);
 
   LOG_INF("initialize PWA service ...");
   if (int err = PwaService::startAdvertising(); err) {
@@ -162,13 +202,13 @@ SonyRemote *init_bluetooth(void) {
   LOG_INF("initialize Sony Remote ...");
   static SonyRemote remote("9C:50:D1:AF:76:5F");
   // SonyRemote remote("CC:C0:79:DA:94:B6");
+#if CONFIG_RAIL_CAMERAS > 1
+  // any other Sony camera, reachable via SonyRemote::get()
+  static SonyRemote more_remotes[CONFIG_RAIL_CAMERAS - 1];
+#endif
 
   k_msleep(100);
-  remote.startScan();
-  k_msleep(100);
-
-  bt_conn_cb_register(&kConnCbs);
-  bt_conn_auth_cb_register(&kAuthCbs);
+  remote.connect();
 
   k_msleep(100);
   return &remote;
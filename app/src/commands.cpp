@@ -0,0 +1,477 @@
+#include "commands.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(commands, LOG_LEVEL_INF);
+
+// ############################################################################
+// Command table
+//
+// Sorted by group and name, case folded, so that a lookup is a binary search.
+// The shell lists a group in this order too.
+
+namespace {
+
+constexpr command_spec plain(const char *group, const char *name, event evt,
+                             const char *help) {
+  return {
+      .group = group,
+      .name = name,
+      .help = help,
+      .evt = evt,
+      .arg = arg_kind::NONE,
+      .required = false,
+      .bare_evt = evt,
+      .fallback = 0,
+      .min = 0,
+      .max = 0,
+  };
+}
+
+constexpr command_spec with_arg(const char *group, const char *name, event evt,
+                                arg_kind arg, int32_t min, int32_t max,
+                                const char *help) {
+  return {
+      .group = group,
+      .name = name,
+      .help = help,
+      .evt = evt,
+      .arg = arg,
+      .required = true,
+      .bare_evt = evt,
+      .fallback = 0,
+      .min = min,
+      .max = max,
+  };
+}
+
+constexpr command_spec optional_arg(const char *group, const char *name,
+                                    event evt, arg_kind arg, event bare_evt,
+                                    int32_t fallback, int32_t min, int32_t max,
+                                    const char *help) {
+  return {
+      .group = group,
+      .name = name,
+      .help = help,
+      .evt = evt,
+      .arg = arg,
+      .required = false,
+      .bare_evt = bare_evt,
+      .fallback = fallback,
+      .min = min,
+      .max = max,
+  };
+}
+
+constexpr int32_t kAny = INT32_MIN;
+
+constexpr command_spec kCommands[] = {
+    optional_arg("cam", "latency", EVENT_MEASURE_CAPTURE_LATENCY,
+                 arg_kind::INT, EVENT_MEASURE_CAPTURE_LATENCY, 10, 1, 100,
+                 "Measure the shot latency per capture profile."),
+    with_arg("cam", "profile", EVENT_SET_CAPTURE_PROFILE, arg_kind::PROFILE, 0,
+             INT32_MAX, "Set the capture profile used for stacks."),
+    plain("cam", "record", EVENT_RECORD, "Toggle camera recording."),
+    plain("cam", "scan", EVENT_CAMERA_START_SCAN, "Scan for camera"),
+    plain("cam", "shoot", EVENT_SHOOT, "Trigger camera shoot."),
+    plain("cam", "stopScan", EVENT_CAMERA_STOP_SCAN, "Stop scan for camera"),
+    with_arg("cam", "trigger", EVENT_SET_TRIGGER, arg_kind::TRIGGER, 0,
+             INT32_MAX, "Select the trigger backend."),
+    plain("rail", "disable", EVENT_DISABLE,
+          "Disable stepper until the next event."),
+    with_arg("rail", "fly", EVENT_START_FLYING_STACK, arg_kind::INT, 1,
+             INT32_MAX,
+             "Start stacking on the fly at <fps>, with the last step size "
+             "or length."),
+    with_arg("rail", "g", EVENT_GO, arg_kind::UM, kAny, INT32_MAX,
+             "Go relative."),
+    with_arg("rail", "go", EVENT_GO, arg_kind::UM, kAny, INT32_MAX,
+             "Go relative."),
+    with_arg("rail", "go_nm", EVENT_GO, arg_kind::NM, kAny, INT32_MAX,
+             "Go relative (nm)."),
+    with_arg("rail", "go_pct", EVENT_GO_PCT, arg_kind::INT, 0, 100,
+             "Go to percentage between upper and lower bound."),
+    with_arg("rail", "go_to", EVENT_GO_TO, arg_kind::UM, kAny, INT32_MAX,
+             "Go to absolute position."),
+    optional_arg("rail", "lower", EVENT_SET_LOWER_BOUND_TO, arg_kind::UM,
+                 EVENT_SET_LOWER_BOUND, 0, kAny, INT32_MAX, "Set lower bound."),
+    with_arg("rail", "p", EVENT_GO_PCT, arg_kind::INT, 0, 100,
+             "Go to percentage between upper and lower bound."),
+    optional_arg("rail", "s", EVENT_START_STACK_WITH_STEP_SIZE, arg_kind::UM,
+                 EVENT_START_STACK_WITH_STEP_SIZE, 1000, 1, INT32_MAX,
+                 "Start stacking with step size."),
+    with_arg("rail", "set_rpm", EVENT_SET_SPEED_RPM, arg_kind::INT, 1,
+             INT32_MAX, "Set movement speed using raw RPM."),
+    with_arg("rail", "set_speed", EVENT_SET_SPEED, arg_kind::SPEED, 1, 3,
+             "Set movement speed (slow|medium|fast)."),
+    optional_arg("rail", "stack", EVENT_START_STACK_WITH_STEP_SIZE,
+                 arg_kind::UM, EVENT_START_STACK_WITH_STEP_SIZE, 1000, 1,
+                 INT32_MAX, "Start stacking with step size."),
+    optional_arg("rail", "stack_count", EVENT_START_STACK_WITH_LENGTH,
+                 arg_kind::INT, EVENT_START_STACK_WITH_LENGTH, 100, 1,
+                 INT32_MAX, "Start stacking with length."),
+    optional_arg("rail", "stack_nm", EVENT_START_STACK_WITH_STEP_SIZE,
+                 arg_kind::NM, EVENT_START_STACK_WITH_STEP_SIZE, 1000, 1,
+                 INT32_MAX, "Start stacking with step size (nm)."),
+    plain("rail", "stack_plan", EVENT_START_STACK_WITH_PLAN,
+          "Start stacking along the uploaded plan."),
+    plain("rail", "stack_segments", EVENT_START_STACK_WITH_SEGMENTS,
+          "Start stacking along the segment plan."),
+    plain("rail", "status", EVENT_STATUS, "Get current status."),
+    plain("rail", "stop", EVENT_STOP, "Stop running stack."),
+    optional_arg("rail", "upper", EVENT_SET_UPPER_BOUND_TO, arg_kind::UM,
+                 EVENT_SET_UPPER_BOUND, 0, kAny, INT32_MAX, "Set upper bound."),
+    with_arg("rail", "wait_after", EVENT_SET_WAIT_AFTER_MS, arg_kind::INT, 0,
+             INT32_MAX, "Set wait after ms."),
+    with_arg("rail", "wait_before", EVENT_SET_WAIT_BEFORE_MS, arg_kind::INT, 0,
+             INT32_MAX, "Set wait before ms."),
+};
+
+constexpr char fold(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+constexpr int compare(const char *a, const char *b) {
+  while (*a && fold(*a) == fold(*b)) {
+    a++;
+    b++;
+  }
+  return fold(*a) - fold(*b);
+}
+
+constexpr int compare(const command_spec &spec, const char *group,
+                      const char *name) {
+  int order = compare(spec.group, group);
+  return order != 0 ? order : compare(spec.name, name);
+}
+
+constexpr bool is_sorted() {
+  for (size_t i = 1; i < ARRAY_SIZE(kCommands); i++) {
+    if (compare(kCommands[i - 1], kCommands[i].group, kCommands[i].name) >=
+        0) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(is_sorted(), "kCommands must be sorted by group and name");
+
+// First row of a group, or where it would be
+size_t first_row(const char *group, const char *name) {
+  size_t lo = 0;
+  size_t hi = ARRAY_SIZE(kCommands);
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (compare(kCommands[mid], group, name) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Fixed point decimal, without going through float, extra decimals are
+// truncated
+int parse_fixed(const char *str, int decimals, int32_t *out) {
+  const char *p = str;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+
+  int64_t value = 0;
+  int digits = 0;
+  for (; isdigit((unsigned char)*p); p++, digits++) {
+    value = value * 10 + (*p - '0');
+    if (value > INT32_MAX) {
+      return -ERANGE;
+    }
+  }
+  int scale = 0;
+  if (*p == '.') {
+    for (p++; isdigit((unsigned char)*p); p++, digits++) {
+      if (scale < decimals) {
+        value = value * 10 + (*p - '0');
+        scale++;
+      }
+    }
+  }
+  if (digits == 0 || *p != '\0') {
+    return -EINVAL;
+  }
+  for (; scale < decimals; scale++) {
+    value *= 10;
+  }
+  if (value > INT32_MAX) {
+    return -ERANGE;
+  }
+  *out = negative ? -value : value;
+  return 0;
+}
+
+int parse_speed(const char *str, int32_t *out) {
+  static const char *const presets[] = {"slow", "medium", "fast"};
+  for (size_t i = 0; i < ARRAY_SIZE(presets); i++) {
+    if (strcasecmp(str, presets[i]) == 0) {
+      *out = i + 1;
+      return 0;
+    }
+  }
+  return parse_fixed(str, 0, out);
+}
+
+int parse_profile(const char *str, int32_t *out) {
+  static const CaptureProfile profiles[] = {CaptureProfile::FULL_AF,
+                                            CaptureProfile::SHUTTER_ONLY,
+                                            CaptureProfile::HALF_PRESS_HELD};
+  for (CaptureProfile profile : profiles) {
+    if (strcasecmp(str, capture_profile_name(profile)) == 0) {
+      *out = (int32_t)profile;
+      return 0;
+    }
+  }
+  return -EINVAL;
+}
+
+int parse_arg(arg_kind arg, const char *str, int32_t *out) {
+  switch (arg) {
+  case arg_kind::UM:
+    return parse_fixed(str, 3, out);
+  case arg_kind::NM:
+  case arg_kind::INT:
+    return parse_fixed(str, 0, out);
+  case arg_kind::SPEED:
+    return parse_speed(str, out);
+  case arg_kind::PROFILE:
+    return parse_profile(str, out);
+  case arg_kind::TRIGGER:
+    *out = find_trigger(str);
+    return *out < 0 ? -EINVAL : 0;
+  case arg_kind::NONE:
+    break;
+  }
+  return -E2BIG;
+}
+} // namespace
+
+const struct command_spec *command_find(const char *group, const char *name) {
+  size_t i = first_row(group, name);
+  if (i < ARRAY_SIZE(kCommands) && compare(kCommands[i], group, name) == 0) {
+    return &kCommands[i];
+  }
+  return nullptr;
+}
+
+int command_parse(const struct command_spec *spec, size_t argc, char **argv,
+                  struct rail_command *cmd) {
+  if (argc > 2) {
+    return -E2BIG;
+  }
+  cmd->spec = spec;
+  cmd->seq = 0;
+  if (argc < 2) {
+    if (spec->required) {
+      return -ENODATA;
+    }
+    cmd->evt = spec->bare_evt;
+    cmd->value = spec->fallback;
+    cmd->has_value = spec->arg != arg_kind::NONE && spec->bare_evt == spec->evt;
+    return 0;
+  }
+
+  int err = parse_arg(spec->arg, argv[1], &cmd->value);
+  if (err) {
+    return err;
+  }
+  if (cmd->value < spec->min || cmd->value > spec->max) {
+    return -ERANGE;
+  }
+  cmd->evt = spec->evt;
+  cmd->has_value = true;
+  return 0;
+}
+
+int command_tokenize(char *line, char **argv, size_t max) {
+  char *saveptr;
+  size_t argc = 0;
+  for (char *token = strtok_r(line, " \t", &saveptr); token;
+       token = strtok_r(nullptr, " \t", &saveptr)) {
+    if (argc == max) {
+      return -E2BIG;
+    }
+    argv[argc++] = token;
+  }
+  return argc;
+}
+
+int command_parse_um(const char *text, int32_t *nm) {
+  return parse_fixed(text, 3, nm);
+}
+
+int command_parse_seq(const char *token, uint16_t *seq) {
+  int32_t value;
+  if (token[0] != '@' || parse_fixed(token + 1, 0, &value) != 0 ||
+      value < 1 || value > UINT16_MAX) {
+    return -EINVAL;
+  }
+  *seq = value;
+  return 0;
+}
+
+int command_parse_line(char *line, struct rail_command *cmd) {
+  // sequence number, group, name, argument and one to notice extra ones
+  char *tokens[5];
+  char **argv = tokens;
+  int argc = command_tokenize(line, tokens, ARRAY_SIZE(tokens));
+  if (argc < 0) {
+    return argc;
+  }
+  uint16_t seq = 0;
+  if (argc > 0 && argv[0][0] == '@') {
+    if (command_parse_seq(argv[0], &seq) != 0) {
+      return -EINVAL;
+    }
+    argv++;
+    argc--;
+  }
+  if (argc < 2) {
+    return -ENOENT;
+  }
+  const struct command_spec *spec = command_find(argv[0], argv[1]);
+  if (!spec) {
+    return -ENOENT;
+  }
+  int err = command_parse(spec, argc - 1, argv + 1, cmd);
+  cmd->seq = seq;
+  return err;
+}
+
+int command_submit(const struct rail_command *cmd) {
+  LOG_DBG("%s %s: event=%d value=%d seq=%u", cmd->spec->group,
+          cmd->spec->name, cmd->evt, cmd->value, cmd->seq);
+  return event_pub(cmd->evt, cmd->value, cmd->seq);
+}
+
+int command_parse_batch(char *text, struct rail_command *cmds, size_t max,
+                        int *failed) {
+  char *saveptr;
+  size_t count = 0;
+  *failed = 0;
+  for (char *line = strtok_r(text, "\n\r;", &saveptr); line;
+       line = strtok_r(nullptr, "\n\r;", &saveptr)) {
+    line += strspn(line, " \t");
+    if (*line == '\0' || *line == '#') {
+      continue;
+    }
+    if (count == max) {
+      *failed = count + 1;
+      return -EFBIG;
+    }
+    int err = command_parse_line(line, &cmds[count]);
+    if (!err && cmds[count].evt == EVENT_STOP) {
+      // STOP skips the queue, it would overtake the commands before it
+      err = -EPERM;
+    }
+    if (err) {
+      *failed = count + 1;
+      return err;
+    }
+    count++;
+  }
+  return count;
+}
+
+int command_submit_batch(const struct rail_command *cmds, size_t count) {
+  size_t prio_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    prio_count += event_is_priority(cmds[i].evt);
+  }
+  int err = event_pub_batch_begin(count, prio_count);
+  if (err) {
+    return err;
+  }
+  for (size_t i = 0; i < count && !err; i++) {
+    err = command_submit(&cmds[i]);
+  }
+  event_pub_batch_end();
+  return err ? err : count;
+}
+
+int command_describe(const struct rail_command *cmd, char *buf, size_t size) {
+  if (cmd->has_value) {
+    return snprintf(buf, size, "%s %s %d", cmd->spec->group, cmd->spec->name,
+                    cmd->value);
+  }
+  return snprintf(buf, size, "%s %s", cmd->spec->group, cmd->spec->name);
+}
+
+const char *command_error_name(int err) {
+  switch (err) {
+  case -ENOENT:
+    return "UNKNOWN_CMD";
+  case -ENODATA:
+    return "MISSING_ARG";
+  case -EINVAL:
+    return "INVALID_ARG";
+  case -ERANGE:
+    return "OUT_OF_RANGE";
+  case -E2BIG:
+    return "TOO_MANY_ARGS";
+  case -EFBIG:
+    return "TOO_LONG";
+  case -ESRCH:
+    return "UNKNOWN_SCRIPT";
+  case -ENOMEM:
+    return "NO_SPACE";
+  case -ENOMSG:
+    return "QUEUE_FULL";
+  case -EBUSY:
+    return "BUSY";
+  case -EAGAIN:
+    return "INCOMPLETE";
+  case -EDOM:
+    return "NOT_MONOTONIC";
+  case -EBADMSG:
+    return "INVALID_FRAME";
+  case -EPERM:
+    return "NOT_IN_BATCH";
+  default:
+    return "FAILED";
+  }
+}
+
+const char *command_arg_name(const struct command_spec *spec) {
+  switch (spec->arg) {
+  case arg_kind::UM:
+    return "um";
+  case arg_kind::NM:
+    return "nm";
+  case arg_kind::INT:
+    return "n";
+  case arg_kind::SPEED:
+    return "slow|medium|fast";
+  case arg_kind::PROFILE:
+    return "full_af|shutter_only|half_press_held";
+  case arg_kind::TRIGGER:
+    return "name";
+  case arg_kind::NONE:
+    break;
+  }
+  return "";
+}
+
+size_t command_count(const char *group) {
+  // "" sorts before and "\x7f" after every name of the group
+  return first_row(group, "\x7f") - first_row(group, "");
+}
+
+const struct command_spec *command_get(const char *group, size_t index) {
+  if (index >= command_count(group)) {
+    return nullptr;
+  }
+  return &kCommands[first_row(group, "") + index];
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "StateMachine.h"
+
+/* How the argument of a command is parsed */
+enum class arg_kind : uint8_t {
+  NONE,    // takes no argument
+  UM,      // micrometres with up to 3 decimals, stored as nm
+  NM,      // whole nanometres
+  INT,     // whole number: ms, rpm, fps, percent or frames
+  SPEED,   // slow|medium|fast or 1..3
+  PROFILE, // capture profile name
+  TRIGGER, // trigger backend name, stored as its index
+};
+
+/**
+ * @brief One row of the command table shared by the shell and the PWA.
+ *
+ * Without its argument a command publishes @p bare_evt with @p fallback,
+ * unless the argument is required.
+ */
+struct command_spec {
+  const char *group;
+  const char *name;
+  const char *help;
+  enum event evt;
+  arg_kind arg;
+  bool required;
+  enum event bare_evt;
+  int32_t fallback;
+  int32_t min;
+  int32_t max;
+};
+
+/**
+ * @brief A parsed command, what both front-ends put on the event queue.
+ */
+struct rail_command {
+  const struct command_spec *spec;
+  enum event evt;
+  int32_t value;
+  bool has_value;
+  uint16_t seq; // set by the client to follow the command, 0 if not
+};
+
+/**
+ * @brief Look up a command, case insensitive.
+ *
+ * @return the table row, nullptr if there is no such command
+ */
+const struct command_spec *command_find(const char *group, const char *name);
+
+/**
+ * @brief Parse the arguments of a command.
+ *
+ * @param argv the command name followed by its arguments, like the shell
+ * @return 0 on success, -ENODATA if the argument is missing, -EINVAL if it
+ * does not parse, -ERANGE if it is out of range, -E2BIG on extra arguments
+ */
+int command_parse(const struct command_spec *spec, size_t argc, char **argv,
+                  struct rail_command *cmd);
+
+/* Micrometres with up to 3 decimals as nm, @return 0, -EINVAL or -ERANGE */
+int command_parse_um(const char *text, int32_t *nm);
+
+/**
+ * @brief Parse the sequence number in front of a command, like "@12".
+ *
+ * @return 0 on success, -EINVAL unless it is '@' and 1 to 65535
+ */
+int command_parse_seq(const char *token, uint16_t *seq);
+
+/**
+ * @brief Parse a whole command line like "rail go 1.5", tokenized in place.
+ *
+ * It may start with a sequence number, "@12 rail go 1.5".
+ *
+ * @return 0 on success, -ENOENT for an unknown command or an error of
+ * command_parse()
+ */
+int command_parse_line(char *line, struct rail_command *cmd);
+
+/**
+ * @brief Split a line on blanks in place.
+ *
+ * @return the number of tokens, -E2BIG if there are more than @p max
+ */
+int command_tokenize(char *line, char **argv, size_t max);
+
+/* Put a parsed command on the event queue */
+int command_submit(const struct rail_command *cmd);
+
+/* Commands per batch or script, half of the event queue */
+#define COMMAND_BATCH_MAX 16
+
+/**
+ * @brief Parse commands separated by newlines or ';', tokenized in place.
+ *
+ * Blank lines and lines starting with '#' are skipped. Nothing is queued, so
+ * a batch either parses as a whole or not at all. "rail stop" is refused, it
+ * would bypass the queue and run before the commands ahead of it.
+ *
+ * @param failed set to the 1-based number of the command that did not parse,
+ * 0 if the error is not about a single command
+ * @return the number of commands, -EFBIG if there are more than @p max,
+ * -EPERM for a stop, or an error of command_parse_line()
+ */
+int command_parse_batch(char *text, struct rail_command *cmds, size_t max,
+                        int *failed);
+
+/**
+ * @brief Queue parsed commands in order, all of them or none.
+ *
+ * @return @p count, or -ENOMSG if the event queues lack room for all of them
+ */
+int command_submit_batch(const struct rail_command *cmds, size_t count);
+
+/* "rail go 1500", the command as it was understood */
+int command_describe(const struct rail_command *cmd, char *buf, size_t size);
+
+/* MISSING_ARG, INVALID_ARG, ... for an error of the parser */
+const char *command_error_name(int err);
+
+/* Placeholder of the argument in usage texts, "" if there is none */
+const char *command_arg_name(const struct command_spec *spec);
+
+/* Commands of a group in table order, for the shell */
+size_t command_count(const char *group);
+const struct command_spec *command_get(const char *group, size_t index);
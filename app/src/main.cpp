@@ -8,7 +8,11 @@
 #ifdef CONFIG_SHELL
 #include "shell.h"
 #endif
+#include "CameraTrigger.h"
 #include "StateMachine.h"
+#ifdef CONFIG_BT
+#include "pwa_service.h"
+#endif
 #include "stepper_with_target/StepperWithTarget.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
@@ -112,7 +116,13 @@ int main(void) {
     return -1;
   }
 
-  StateMachine sm(stepper, remote);
+#ifdef CONFIG_BT
+  PwaService::startTelemetry(stepper);
+#endif
+
+  CameraTrigger *trigger = init_triggers(remote);
+
+  StateMachine sm(stepper, remote, trigger);
 
 #ifdef BUILD_COMMIT
   LOG_INF("Build commit: %s", BUILD_COMMIT);
@@ -6,6 +6,9 @@
 #else
 #include "sony_remote/fake_sony_remote.h"
 #endif
+#if !defined(CONFIG_BT) && defined(CONFIG_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
 
 LOG_MODULE_REGISTER(maybe_bluetooth, LOG_LEVEL_INF);
 
@@ -14,6 +17,16 @@ SonyRemote *init_maybe_bluetooth(void) {
   return init_bluetooth();
 #else
   static SonyRemote remote;
+#ifdef CONFIG_SETTINGS
+  // Bluetooth loads them otherwise, the command scripts live there
+  int err = settings_subsys_init();
+  if (!err) {
+    err = settings_load();
+  }
+  if (err) {
+    LOG_ERR("settings_load failed (%d), but continue...", err);
+  }
+#endif
   LOG_INF("initialize Dummy Sony Remote ...");
   return &remote;
 #endif
@@ -0,0 +1,287 @@
+#include "plan.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "StateMachine.h"
+#include "commands.h"
+
+LOG_MODULE_REGISTER(plan, LOG_LEVEL_INF);
+
+namespace {
+
+// Uploaded from the Bluetooth RX thread or the shell, read by the stack
+int32_t positions[CONFIG_RAIL_PLAN_POSITIONS];
+size_t expected = 0; // announced by plan_begin(), 0 while not uploading
+size_t received = 0;
+size_t committed = 0;
+bool held = false;
+// Copied by the stack when it starts, so they are never held
+struct plan_segment segments[CONFIG_RAIL_PLAN_SEGMENTS];
+size_t num_segments = 0;
+int32_t segments_start = 0;
+int segment_frames = 0;
+K_MUTEX_DEFINE(plan_lock);
+
+constexpr int64_t kTravelNm = (int64_t)CONFIG_RAIL_TRAVEL_UM * 1000;
+
+// The origin is where the rail was switched on, it may go either way
+int check_travel(int32_t lowest, int32_t highest) {
+  if (llabs(lowest) > kTravelNm || llabs(highest) > kTravelNm ||
+      (int64_t)highest - lowest > kTravelNm) {
+    LOG_WRN("Plan %d..%d nm exceeds the travel of %d um", lowest, highest,
+            CONFIG_RAIL_TRAVEL_UM);
+    return -ERANGE;
+  }
+  return 0;
+}
+
+int check(const int32_t *list, size_t count) {
+  int32_t lowest = list[0];
+  int32_t highest = list[0];
+  const bool rising = list[1] > list[0];
+  for (size_t i = 1; i < count; i++) {
+    if (list[i] == list[i - 1] || (list[i] > list[i - 1]) != rising) {
+      LOG_WRN("Position %zu (%d nm) breaks the order", i, list[i]);
+      return -EDOM;
+    }
+    lowest = MIN(lowest, list[i]);
+    highest = MAX(highest, list[i]);
+  }
+  return check_travel(lowest, highest);
+}
+
+void add_eta(struct plan_info *info) {
+  if (info->count) {
+    int64_t travel = llabs((int64_t)info->last_nm - info->first_nm);
+    info->eta_ms = stack_eta_ms(info->count, travel);
+  }
+}
+
+int parse_frames(const char *text, int32_t *frames) {
+  char *end;
+  long value = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || value < 1 || value > INT32_MAX) {
+    return -EINVAL;
+  }
+  *frames = value;
+  return 0;
+}
+
+} // namespace
+
+int plan_begin(size_t count) {
+  if (count < 2) {
+    return -EINVAL;
+  }
+  if (count > ARRAY_SIZE(positions)) {
+    return -EFBIG;
+  }
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  int err = held ? -EBUSY : 0;
+  if (!err) {
+    committed = 0;
+    received = 0;
+    expected = count;
+  }
+  k_mutex_unlock(&plan_lock);
+  return err;
+}
+
+int plan_put(size_t index, const uint8_t *data, size_t n) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  int err = 0;
+  if (expected == 0 || index > received) {
+    err = -EBADMSG;
+  } else if (index + n > expected) {
+    err = -EFBIG;
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      positions[index + i] = (int32_t)sys_get_le32(&data[i * 4]);
+    }
+    received = MAX(received, index + n);
+  }
+  k_mutex_unlock(&plan_lock);
+  return err;
+}
+
+int plan_commit(void) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  int ret;
+  if (expected == 0) {
+    ret = -EBADMSG;
+  } else if (received < expected) {
+    ret = -EAGAIN;
+  } else {
+    ret = check(positions, expected);
+  }
+  if (ret == 0) {
+    committed = expected;
+    expected = 0;
+    ret = committed;
+    LOG_INF("Plan of %d positions, %d..%d nm", ret, positions[0],
+            positions[committed - 1]);
+  }
+  k_mutex_unlock(&plan_lock);
+  return ret;
+}
+
+int plan_acquire(const int32_t **list) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  int ret = committed ? (int)committed : -ENODATA;
+  held = committed != 0;
+  *list = positions;
+  k_mutex_unlock(&plan_lock);
+  return ret;
+}
+
+void plan_release(void) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  held = false;
+  k_mutex_unlock(&plan_lock);
+}
+
+int plan_get_info(struct plan_info *info) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  *info = {};
+  if (committed) {
+    info->count = committed;
+    info->first_nm = positions[0];
+    info->last_nm = positions[committed - 1];
+  }
+  k_mutex_unlock(&plan_lock);
+  add_eta(info);
+  return info->count;
+}
+
+int64_t plan_segment_frames(int32_t from_nm,
+                            const struct plan_segment *segment) {
+  if (segment->step_nm <= 0) {
+    return segment->frames;
+  }
+  int64_t distance = llabs((int64_t)segment->end_nm - from_nm);
+  return (distance + segment->step_nm - 1) / segment->step_nm;
+}
+
+int32_t plan_segment_target(int32_t from_nm, const struct plan_segment *segment,
+                            int index) {
+  int64_t distance = (int64_t)segment->end_nm - from_nm;
+  if (segment->step_nm <= 0) {
+    return from_nm + distance * index / segment->frames;
+  }
+  // All full steps, the end may be closer than one step size
+  int64_t offset = (int64_t)index * segment->step_nm;
+  if (offset >= llabs(distance)) {
+    return segment->end_nm;
+  }
+  return from_nm + (distance < 0 ? -offset : offset);
+}
+
+int plan_set_segments(int32_t start_nm, const struct plan_segment *list,
+                      size_t count) {
+  if (count == 0) {
+    return -EINVAL;
+  }
+  if (count > ARRAY_SIZE(segments)) {
+    return -EFBIG;
+  }
+
+  int32_t from = start_nm;
+  int32_t lowest = start_nm;
+  int32_t highest = start_nm;
+  const bool rising = list[0].end_nm > start_nm;
+  int64_t frames = 1;
+  for (size_t i = 0; i < count; i++) {
+    const struct plan_segment &segment = list[i];
+    if (segment.end_nm == from || segment.step_nm < 0 ||
+        (segment.step_nm == 0 && segment.frames < 1)) {
+      LOG_WRN("Segment %zu is empty", i + 1);
+      return -EINVAL;
+    }
+    if ((segment.end_nm > from) != rising) {
+      LOG_WRN("Segment %zu turns back", i + 1);
+      return -EDOM;
+    }
+    lowest = MIN(lowest, segment.end_nm);
+    highest = MAX(highest, segment.end_nm);
+    // Off the rail a small step size would count frames past any limit
+    int err = check_travel(lowest, highest);
+    if (err) {
+      return err;
+    }
+    frames += plan_segment_frames(from, &segment);
+    if (frames > INT32_MAX) {
+      return -EFBIG;
+    }
+    from = segment.end_nm;
+  }
+
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  memcpy(segments, list, count * sizeof(*list));
+  num_segments = count;
+  segments_start = start_nm;
+  segment_frames = frames;
+  k_mutex_unlock(&plan_lock);
+  LOG_INF("Plan of %zu segments, %d frames, %d..%d nm", count, (int)frames,
+          start_nm, from);
+  return frames;
+}
+
+int plan_parse_segments(char *text, int32_t *start_nm,
+                        struct plan_segment *list, size_t max) {
+  char *saveptr;
+  char *token = strtok_r(text, " \t", &saveptr);
+  if (!token || command_parse_um(token, start_nm) != 0) {
+    return -EINVAL;
+  }
+  size_t count = 0;
+  while ((token = strtok_r(nullptr, " \t", &saveptr))) {
+    if (count == max) {
+      return -EFBIG;
+    }
+    struct plan_segment &segment = list[count++];
+    char *split = strpbrk(token, "/xX");
+    if (!split) {
+      return -EINVAL;
+    }
+    const bool by_step = *split == '/';
+    *split = '\0';
+    segment = {};
+    int err = command_parse_um(token, &segment.end_nm);
+    if (!err) {
+      err = by_step ? command_parse_um(split + 1, &segment.step_nm)
+                    : parse_frames(split + 1, &segment.frames);
+    }
+    if (err || (by_step && segment.step_nm <= 0)) {
+      return -EINVAL;
+    }
+  }
+  return count;
+}
+
+int plan_get_segments(int32_t *start_nm, struct plan_segment *list,
+                      size_t max) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  size_t count = MIN(num_segments, max);
+  memcpy(list, segments, count * sizeof(*list));
+  *start_nm = segments_start;
+  k_mutex_unlock(&plan_lock);
+  return count;
+}
+
+int plan_get_segment_info(struct plan_info *info) {
+  k_mutex_lock(&plan_lock, K_FOREVER);
+  *info = {};
+  if (num_segments) {
+    info->count = segment_frames;
+    info->first_nm = segments_start;
+    info->last_nm = segments[num_segments - 1].end_nm;
+  }
+  k_mutex_unlock(&plan_lock);
+  add_eta(info);
+  return info->count;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Stack plans besides even steps between the bounds: an explicit list of
+ * positions in nm, uploaded in chunks, checked as a whole on commit and read
+ * in place by the stack, one int32_t per frame. Or a few segments, each with
+ * its own step size or frame count, evaluated lazily like a computed stack.
+ */
+
+/**
+ * @brief Start uploading a plan of @p count positions, dropping the last one.
+ *
+ * @return 0 on success, -EFBIG if @p count is over CONFIG_RAIL_PLAN_POSITIONS,
+ * -EINVAL for fewer than 2 positions, -EBUSY while a stack runs the plan
+ */
+int plan_begin(size_t count);
+
+/**
+ * @brief Store @p n positions from @p index on, little-endian int32.
+ *
+ * Chunks come in order, a chunk may be sent again.
+ *
+ * @return 0 on success, -EBADMSG without plan_begin() or for a gap,
+ * -EFBIG past the announced count
+ */
+int plan_put(size_t index, const uint8_t *positions, size_t n);
+
+/**
+ * @brief Check the uploaded positions against the rail and make them the plan.
+ *
+ * @return the number of positions, -EAGAIN while some are missing, -ERANGE
+ * if the plan leaves CONFIG_RAIL_TRAVEL_UM, -EDOM unless the positions
+ * strictly rise or strictly fall
+ */
+int plan_commit(void);
+
+/**
+ * @brief Hold the committed plan for a stack, uploads fail until released.
+ *
+ * @return the number of positions, -ENODATA if there is no plan
+ */
+int plan_acquire(const int32_t **positions);
+
+/* Let uploads replace the plan again, a no-op if it is not held */
+void plan_release(void);
+
+struct plan_info {
+  size_t count; // frames
+  int32_t first_nm;
+  int32_t last_nm;
+  uint32_t eta_ms; // see stack_eta_ms()
+};
+
+/* Summary of the committed plan, @return its count, 0 without plan */
+int plan_get_info(struct plan_info *info);
+
+/**
+ * @brief Part of a segment plan, from the end of the previous segment or the
+ * start of the plan to @p end_nm.
+ *
+ * Frames are @p step_nm apart, the last one at @p end_nm, or without step
+ * @p frames evenly spaced ones. The start is a frame of the previous segment.
+ */
+struct plan_segment {
+  int32_t end_nm;
+  int32_t step_nm; // 0 to take frames
+  int32_t frames;
+};
+
+/* Frames of a segment starting at @p from_nm, without its start */
+int64_t plan_segment_frames(int32_t from_nm,
+                            const struct plan_segment *segment);
+
+/* Frame @p index of a segment, 1 to plan_segment_frames() */
+int32_t plan_segment_target(int32_t from_nm, const struct plan_segment *segment,
+                            int index);
+
+/**
+ * @brief Replace the segment plan.
+ *
+ * @return the number of frames, -EINVAL for an empty segment, -EFBIG for more
+ * than CONFIG_RAIL_PLAN_SEGMENTS segments, -EDOM unless the segments all go
+ * the same way, -ERANGE if the plan leaves CONFIG_RAIL_TRAVEL_UM
+ */
+int plan_set_segments(int32_t start_nm, const struct plan_segment *segments,
+                      size_t count);
+
+/**
+ * @brief Parse a segment plan like "0 100/5 150/1 400x10".
+ *
+ * The start in um, then per segment its end in um followed by "/" and the
+ * step size in um or by "x" and the number of frames. Tokenized in place.
+ *
+ * @return the number of segments, -EINVAL if it does not parse, -EFBIG for
+ * more than @p max
+ */
+int plan_parse_segments(char *text, int32_t *start_nm,
+                        struct plan_segment *segments, size_t max);
+
+/* Copy the segment plan, @return the number of segments, 0 without */
+int plan_get_segments(int32_t *start_nm, struct plan_segment *segments,
+                      size_t max);
+
+/* Summary of the segment plan, @return its frames, 0 without plan */
+int plan_get_segment_info(struct plan_info *info);
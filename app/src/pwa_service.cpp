@@ -1,4 +1,5 @@
 #include "pwa_service.h"
+#include <cctype>
 #include <cstdlib>
 #include <cstring>
 #include <strings.h>
@@ -7,278 +8,231 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 
 #include "StateMachine.h"
+#include "commands.h"
+#include "plan.h"
+#include "scripts.h"
 
 LOG_MODULE_REGISTER(pwa_service, LOG_LEVEL_INF);
 
 namespace {
 
-int parseSpeedPreset(const char *token) {
-  if (!token) {
-    return 0;
-  }
-  if (strcasecmp(token, "slow") == 0 || strcmp(token, "1") == 0) {
-    return 1;
-  }
-  if (strcasecmp(token, "medium") == 0 || strcmp(token, "2") == 0) {
-    return 2;
-  }
-  if (strcasecmp(token, "fast") == 0 || strcmp(token, "3") == 0) {
-    return 3;
+// Not a state machine event, so not in the command table
+void handleTelemetryCommand(const char *param) {
+  char response[64];
+  int hz = param ? atoi(param) : 0;
+  if (PwaService::setTelemetryRate(hz) != 0) {
+    LOG_WRN("→ rail telemetry invalid rate");
+    PwaService::notifyStatus("ERR:RAIL_TELEMETRY_INVALID_RATE");
+    return;
   }
-  return 0;
+  LOG_INF("→ Command: rail telemetry hz=%d", hz);
+  snprintf(response, sizeof(response), "ACK:rail telemetry %d", hz);
+  PwaService::notifyStatus(response);
 }
 
-bool handleRailCommand(const char *subcmd, char **saveptr) {
-  if (!subcmd) {
-    PwaService::notifyStatus("ERR:RAIL_MISSING_COMMAND");
-    return true;
+// ERR:RAIL_GO_MISSING_ARG
+void notifyCommandError(const char *group, const char *name,
+                        const char *reason) {
+  char response[64];
+  int n = snprintf(response, sizeof(response), "ERR:%s_%s%s%s", group,
+                   name ? name : "", name ? "_" : "", reason);
+  for (int i = 4; i < n && i < (int)sizeof(response); i++) {
+    response[i] = toupper((unsigned char)response[i]);
   }
+  PwaService::notifyStatus(response);
+}
 
-  char *param1 = nullptr;
-  char *param2 = nullptr;
-  char *param3 = nullptr;
-  char response[128];
-
-  if (strcasecmp(subcmd, "go") == 0 || strcasecmp(subcmd, "g") == 0 ||
-      strcasecmp(subcmd, "go_nm") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_WRN("→ rail %s (missing distance)", subcmd);
-      PwaService::notifyStatus("ERR:RAIL_GO_MISSING_DISTANCE");
-      return true;
-    }
-    bool is_nm_command = (strcasecmp(subcmd, "go_nm") == 0);
-    int multiplier = is_nm_command ? 1 : 1000;
-    int distance_nm = atoi(param1) * multiplier;
-    LOG_INF("→ Command: rail %s distance=%dnm", subcmd, distance_nm);
-    event_pub(EVENT_GO, distance_nm);
-    snprintf(response, sizeof(response), "ACK:rail %s %d", subcmd, distance_nm);
-    PwaService::notifyStatus(response);
-    return true;
+// ERR:BATCH_3_INVALID_ARG, the command number is left out if there is none
+void notifyBatchError(const char *prefix, int err, int failed) {
+  char response[64];
+  if (failed) {
+    snprintf(response, sizeof(response), "ERR:%s_%d_%s", prefix, failed,
+             command_error_name(err));
+  } else {
+    snprintf(response, sizeof(response), "ERR:%s_%s", prefix,
+             command_error_name(err));
   }
+  PwaService::notifyStatus(response);
+}
 
-  if (strcasecmp(subcmd, "go_to") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_WRN("→ rail go_to (missing position)");
-      PwaService::notifyStatus("ERR:RAIL_GO_TO_MISSING_POSITION");
-      return true;
-    }
-    int position_nm = atoi(param1) * 1000;
-    LOG_INF("→ Command: rail go_to position=%dnm", position_nm);
-    event_pub(EVENT_GO_TO, position_nm);
-    snprintf(response, sizeof(response), "ACK:rail go_to %d", position_nm);
-    PwaService::notifyStatus(response);
-    return true;
+// Only the Bluetooth RX thread writes commands
+struct rail_command batch_cmds[COMMAND_BATCH_MAX];
+
+// Several commands in one write, queued all or none, one response
+void handleBatch(char *text) {
+  char response[64];
+  int failed;
+  int count =
+      command_parse_batch(text, batch_cmds, ARRAY_SIZE(batch_cmds), &failed);
+  if (count >= 0) {
+    count = command_submit_batch(batch_cmds, count);
+  }
+  if (count < 0) {
+    LOG_WRN("→ batch failed at command %d: %s", failed,
+            command_error_name(count));
+    notifyBatchError("BATCH", count, failed);
+    return;
   }
+  LOG_INF("→ Command: batch of %d", count);
+  snprintf(response, sizeof(response), "ACK:batch %d", count);
+  PwaService::notifyStatus(response);
+}
 
-  if (strcasecmp(subcmd, "go_pct") == 0 || strcasecmp(subcmd, "p") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_WRN("→ rail go_pct (missing percentage)");
-      PwaService::notifyStatus("ERR:RAIL_GO_PCT_MISSING_PERCENTAGE");
-      return true;
-    }
-    int percentage = atoi(param1);
-    if (percentage < 0 || percentage > 100) {
-      LOG_WRN("→ rail go_pct invalid percentage=%d", percentage);
-      PwaService::notifyStatus("ERR:RAIL_GO_PCT_INVALID_RANGE");
-      return true;
-    }
-    LOG_INF("→ Command: rail go_pct percentage=%d", percentage);
-    event_pub(EVENT_GO_PCT, percentage);
-    snprintf(response, sizeof(response), "ACK:rail go_pct %d", percentage);
+// script run|save|delete|show|list, the body of save runs to the end
+void handleScriptCommand(char *args) {
+  char response[128];
+  char *saveptr;
+  const char *verb = strtok_r(args, " ", &saveptr);
+  const char *name = verb ? strtok_r(nullptr, " ", &saveptr) : nullptr;
+  int failed = 0;
+  int ret;
+
+  if (verb && strcasecmp(verb, "list") == 0) {
+    char names[96];
+    int count = script_list(names, sizeof(names));
+    snprintf(response, sizeof(response), "ACK:script list %s", names);
+    LOG_INF("→ Command: script list (%d)", count);
     PwaService::notifyStatus(response);
-    return true;
+    return;
   }
-
-  if (strcasecmp(subcmd, "lower") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_INF("→ Command: rail lower (current position)");
-      event_pub(EVENT_SET_LOWER_BOUND);
-      PwaService::notifyStatus("ACK:rail lower");
-    } else {
-      int position_nm = atoi(param1) * 1000;
-      LOG_INF("→ Command: rail lower position=%dnm", position_nm);
-      event_pub(EVENT_SET_LOWER_BOUND_TO, position_nm);
-      snprintf(response, sizeof(response), "ACK:rail lower %d", position_nm);
-      PwaService::notifyStatus(response);
-    }
-    return true;
+  if (!verb || !name) {
+    PwaService::notifyStatus("ERR:SCRIPT_MISSING_ARG");
+    return;
   }
 
-  if (strcasecmp(subcmd, "upper") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_INF("→ Command: rail upper (current position)");
-      event_pub(EVENT_SET_UPPER_BOUND);
-      PwaService::notifyStatus("ACK:rail upper");
-    } else {
-      int position_nm = atoi(param1) * 1000;
-      LOG_INF("→ Command: rail upper position=%dnm", position_nm);
-      event_pub(EVENT_SET_UPPER_BOUND_TO, position_nm);
-      snprintf(response, sizeof(response), "ACK:rail upper %d", position_nm);
+  if (strcasecmp(verb, "run") == 0) {
+    ret = script_run(name, &failed);
+  } else if (strcasecmp(verb, "save") == 0) {
+    ret = script_save(name, saveptr, &failed);
+  } else if (strcasecmp(verb, "delete") == 0) {
+    ret = script_delete(name);
+  } else if (strcasecmp(verb, "show") == 0) {
+    int n = snprintf(response, sizeof(response), "ACK:script show %s ", name);
+    ret = script_show(name, response + n, sizeof(response) - n);
+    if (ret >= 0) {
       PwaService::notifyStatus(response);
+      return;
     }
-    return true;
+  } else {
+    PwaService::notifyStatus("ERR:SCRIPT_UNKNOWN_CMD");
+    return;
   }
 
-  if (strcasecmp(subcmd, "wait_before") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_WRN("→ rail wait_before (missing milliseconds)");
-      PwaService::notifyStatus("ERR:RAIL_WAIT_BEFORE_MISSING_MS");
-      return true;
-    }
-    int wait_ms = atoi(param1);
-    LOG_INF("→ Command: rail wait_before ms=%d", wait_ms);
-    event_pub(EVENT_SET_WAIT_BEFORE_MS, wait_ms);
-    snprintf(response, sizeof(response), "ACK:rail wait_before %d", wait_ms);
-    PwaService::notifyStatus(response);
-    return true;
+  if (ret < 0) {
+    LOG_WRN("→ script %s %s: %s", verb, name, command_error_name(ret));
+    notifyBatchError("SCRIPT", ret, failed);
+    return;
   }
+  LOG_INF("→ Command: script %s %s", verb, name);
+  snprintf(response, sizeof(response), "ACK:script %s %s %d", verb, name,
+           ret);
+  PwaService::notifyStatus(response);
+}
 
-  if (strcasecmp(subcmd, "wait_after") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_WRN("→ rail wait_after (missing milliseconds)");
-      PwaService::notifyStatus("ERR:RAIL_WAIT_AFTER_MISSING_MS");
-      return true;
-    }
-    int wait_ms = atoi(param1);
-    LOG_INF("→ Command: rail wait_after ms=%d", wait_ms);
-    event_pub(EVENT_SET_WAIT_AFTER_MS, wait_ms);
-    snprintf(response, sizeof(response), "ACK:rail wait_after %d", wait_ms);
-    PwaService::notifyStatus(response);
-    return true;
-  }
+// Only the Bluetooth RX thread writes segment plans
+struct plan_segment plan_segments[CONFIG_RAIL_PLAN_SEGMENTS];
 
-  if (strcasecmp(subcmd, "set_speed") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    int speed_value = parseSpeedPreset(param1);
-    if (speed_value == 0) {
-      LOG_WRN("→ rail set_speed (unknown preset %s)",
-              param1 ? param1 : "<missing>");
-      PwaService::notifyStatus("ERR:RAIL_SET_SPEED_UNKNOWN_PRESET");
-      return true;
-    }
-    LOG_INF("→ Command: rail set_speed preset=%d", speed_value);
-    event_pub(EVENT_SET_SPEED, speed_value);
-    snprintf(response, sizeof(response), "ACK:rail set_speed %d", speed_value);
+// plan segments <start> <end>/<step>|<end>x<frames>... and plan show
+void handlePlanCommand(char *args) {
+  char response[96];
+  char *saveptr;
+  const char *verb = strtok_r(args, " ", &saveptr);
+  struct plan_info positions;
+  struct plan_info segments;
+
+  if (verb && strcasecmp(verb, "show") == 0) {
+    plan_get_info(&positions);
+    plan_get_segment_info(&segments);
+    snprintf(response, sizeof(response),
+             "ACK:plan show positions %zu %u segments %zu %u",
+             positions.count, positions.eta_ms, segments.count,
+             segments.eta_ms);
     PwaService::notifyStatus(response);
-    return true;
+    return;
   }
-
-  if (strcasecmp(subcmd, "set_rpm") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-    if (!param1) {
-      LOG_WRN("→ rail set_rpm (missing rpm)");
-      PwaService::notifyStatus("ERR:RAIL_SET_RPM_MISSING_VALUE");
-      return true;
-    }
-    int rpm = atoi(param1);
-    if (rpm < 1) {
-      LOG_WRN("→ rail set_rpm invalid rpm=%d", rpm);
-      PwaService::notifyStatus("ERR:RAIL_SET_RPM_INVALID");
-      return true;
-    }
-    LOG_INF("→ Command: rail set_rpm rpm=%d", rpm);
-    event_pub(EVENT_SET_SPEED_RPM, rpm);
-    snprintf(response, sizeof(response), "ACK:rail set_rpm %d", rpm);
-    PwaService::notifyStatus(response);
-    return true;
+  if (!verb || strcasecmp(verb, "segments") != 0) {
+    PwaService::notifyStatus("ERR:PLAN_UNKNOWN_CMD");
+    return;
   }
 
-  if (strcasecmp(subcmd, "stack") == 0 || strcasecmp(subcmd, "s") == 0 ||
-      strcasecmp(subcmd, "stack_nm") == 0) {
-    bool is_nm_command = (strcasecmp(subcmd, "stack_nm") == 0);
-    int multiplier = is_nm_command ? 1 : 1000;
-
-    param1 = strtok_r(nullptr, " ", saveptr);
-
-    if (param1) {
-      int expected_step_size_nm = atoi(param1) * multiplier;
-      LOG_INF("→ Command: rail %s step_size=%dnm", subcmd,
-              expected_step_size_nm);
-      event_pub(EVENT_START_STACK_WITH_STEP_SIZE, expected_step_size_nm);
-      snprintf(response, sizeof(response), "ACK:rail %s %d", subcmd,
-               expected_step_size_nm);
-    } else {
-      LOG_INF("→ Command: rail %s step_size=1000nm (default)", subcmd);
-      event_pub(EVENT_START_STACK_WITH_STEP_SIZE, 1000);
-      snprintf(response, sizeof(response), "ACK:rail %s 1000", subcmd);
-    }
-    PwaService::notifyStatus(response);
-    return true;
+  int32_t start;
+  int ret = plan_parse_segments(saveptr, &start, plan_segments,
+                                ARRAY_SIZE(plan_segments));
+  if (ret >= 0) {
+    ret = plan_set_segments(start, plan_segments, ret);
   }
-
-  if (strcasecmp(subcmd, "stack_count") == 0) {
-    param1 = strtok_r(nullptr, " ", saveptr);
-
-    if (param1) {
-      int expected_length = atoi(param1);
-      LOG_INF("→ Command: rail stack_count length=%d", expected_length);
-      event_pub(EVENT_START_STACK_WITH_LENGTH, expected_length);
-      snprintf(response, sizeof(response), "ACK:rail stack_count %d",
-               expected_length);
-    } else {
-      LOG_INF("→ Command: rail stack_count length=100 (default)");
-      event_pub(EVENT_START_STACK_WITH_LENGTH, 100);
-      snprintf(response, sizeof(response), "ACK:rail stack_count 100");
-    }
+  if (ret < 0) {
+    LOG_WRN("→ plan segments: %s", command_error_name(ret));
+    snprintf(response, sizeof(response), "ERR:PLAN_%s",
+             command_error_name(ret));
     PwaService::notifyStatus(response);
-    return true;
-  }
-
-  if (strcasecmp(subcmd, "status") == 0) {
-    LOG_INF("→ Command: rail status");
-    event_pub(EVENT_STATUS);
-    PwaService::notifyStatus("ACK:rail status");
-    return true;
-  }
-
-  if (strcasecmp(subcmd, "disable") == 0) {
-    LOG_INF("→ Command: rail disable");
-    event_pub(EVENT_DISABLE);
-    PwaService::notifyStatus("ACK:rail disable");
-    return true;
-  }
-
-  if (strcasecmp(subcmd, "stop") == 0) {
-    LOG_INF("→ Command: rail stop");
-    event_pub(EVENT_STOP);
-    PwaService::notifyStatus("ACK:rail stop");
-    return true;
+    return;
   }
-
-  return false;
+  plan_get_segment_info(&segments);
+  LOG_INF("→ Command: plan segments, %zu frames", segments.count);
+  snprintf(response, sizeof(response), "ACK:plan segments %zu %u",
+           segments.count, segments.eta_ms);
+  PwaService::notifyStatus(response);
 }
 
-bool handleCamCommand(const char *subcmd, char **saveptr) {
-  ARG_UNUSED(saveptr);
-  if (!subcmd) {
-    PwaService::notifyStatus("ERR:CAM_MISSING_COMMAND");
-    return true;
-  }
-
-  if (strcasecmp(subcmd, "shoot") == 0) {
-    LOG_INF("→ Command: cam shoot");
-    event_pub(EVENT_SHOOT);
-    PwaService::notifyStatus("ACK:cam shoot");
-    return true;
-  }
+// A plan frame is reassembled here when it comes as a long write
+uint8_t plan_frame[PWA_PLAN_FRAME_MAX];
+size_t plan_frame_len = 0;
 
-  if (strcasecmp(subcmd, "record") == 0) {
-    LOG_INF("→ Command: cam record");
-    event_pub(EVENT_RECORD);
-    PwaService::notifyStatus("ACK:cam record");
-    return true;
+// Bytes of the frame, known once its header is in
+size_t planFrameSize(const uint8_t *frame, size_t len) {
+  switch (frame[0]) {
+  case PWA_PLAN_BEGIN:
+    return 3;
+  case PWA_PLAN_DATA:
+    return len < 4 ? 4 : 4 + 4 * (size_t)frame[3];
+  case PWA_PLAN_COMMIT:
+    return 1;
+  default:
+    return len;
   }
+}
 
-  return false;
+// Chunks are only answered if they fail, the upload as a whole on commit
+void handlePlanFrame(const uint8_t *frame, size_t len) {
+  char response[64];
+  int ret;
+  switch (frame[0]) {
+  case PWA_PLAN_BEGIN:
+    ret = plan_begin(sys_get_le16(&frame[1]));
+    if (ret == 0) {
+      snprintf(response, sizeof(response), "ACK:plan begin %u",
+               sys_get_le16(&frame[1]));
+      PwaService::notifyStatus(response);
+      return;
+    }
+    break;
+  case PWA_PLAN_DATA:
+    ret = plan_put(sys_get_le16(&frame[1]), &frame[4], frame[3]);
+    if (ret == 0) {
+      return;
+    }
+    break;
+  case PWA_PLAN_COMMIT:
+    ret = plan_commit();
+    if (ret > 0) {
+      LOG_INF("→ Plan of %d positions", ret);
+      snprintf(response, sizeof(response), "ACK:plan %d", ret);
+      PwaService::notifyStatus(response);
+      return;
+    }
+    break;
+  default:
+    ret = -EBADMSG;
+    break;
+  }
+  LOG_WRN("→ plan frame %u: %s", frame[0], command_error_name(ret));
+  snprintf(response, sizeof(response), "ERR:PLAN_%s",
+           command_error_name(ret));
+  PwaService::notifyStatus(response);
 }
 } // namespace
 
@@ -298,10 +252,76 @@ bool handleCamCommand(const char *subcmd, char **saveptr) {
   BT_UUID_DECLARE_128(                                                         \
       BT_UUID_128_ENCODE(0x12345636, 0x5678, 0x1234, 0x1234, 0x123456789abc))
 
+// State characteristic UUID: 12345637-5678-1234-1234-123456789abc
+#define PWA_STATE_UUID                                                         \
+  BT_UUID_DECLARE_128(                                                         \
+      BT_UUID_128_ENCODE(0x12345637, 0x5678, 0x1234, 0x1234, 0x123456789abc))
+
+// Telemetry characteristic UUID: 12345638-5678-1234-1234-123456789abc
+#define PWA_TELEMETRY_UUID                                                     \
+  BT_UUID_DECLARE_128(                                                         \
+      BT_UUID_128_ENCODE(0x12345638, 0x5678, 0x1234, 0x1234, 0x123456789abc))
+
+// Plan characteristic UUID: 12345639-5678-1234-1234-123456789abc
+#define PWA_PLAN_UUID                                                          \
+  BT_UUID_DECLARE_128(                                                         \
+      BT_UUID_128_ENCODE(0x12345639, 0x5678, 0x1234, 0x1234, 0x123456789abc))
+
+namespace {
+// Fields of struct pwa_state in frame order, bit n of the mask is field n
+struct state_field {
+  uint8_t offset;
+  uint8_t size;
+};
+constexpr state_field kStateFields[] = {
+    {offsetof(pwa_state, position_nm), 4},
+    {offsetof(pwa_state, target_nm), 4},
+    {offsetof(pwa_state, lower_nm), 4},
+    {offsetof(pwa_state, upper_nm), 4},
+    {offsetof(pwa_state, stack_index), 2},
+    {offsetof(pwa_state, stack_length), 2},
+    {offsetof(pwa_state, wait_before_ms), 2},
+    {offsetof(pwa_state, wait_after_ms), 2},
+    {offsetof(pwa_state, flags), 1},
+};
+constexpr uint16_t kAllStateFields = BIT_MASK(ARRAY_SIZE(kStateFields));
+constexpr size_t kStateHeaderSize = 4;
+constexpr size_t kStateFrameMax = kStateHeaderSize + sizeof(pwa_state);
+
+const struct bt_gatt_attr *status_attr = nullptr;
+const struct bt_gatt_attr *state_attr = nullptr;
+const struct bt_gatt_attr *telemetry_attr = nullptr;
+
+// Guards latest_state_, written by the state machine, read by the RX thread
+K_MUTEX_DEFINE(latest_state_lock);
+
+constexpr size_t kTelemetryFrameSize = 18;
+// Polling for the start of a move while idle
+constexpr uint32_t kTelemetryIdleMs = 100;
+// Samples handed to the stack but not sent yet, more means the link is
+// slower than the rate
+constexpr atomic_val_t kTelemetryMaxInFlight = 2;
+} // namespace
+
 // Static member initialization
 struct bt_conn *PwaService::pwa_conn_ = nullptr;
 bool PwaService::notify_enabled_ = false;
+bool PwaService::state_notify_enabled_ = false;
 uint8_t PwaService::status_buffer_[256] = {0};
+struct pwa_state PwaService::state_ = {};
+bool PwaService::state_valid_ = false;
+struct pwa_state PwaService::latest_state_ = {};
+uint8_t PwaService::state_seq_ = 0;
+StepperWithTarget *PwaService::telemetry_stepper_ = nullptr;
+struct k_work_delayable PwaService::telemetry_work_;
+bool PwaService::telemetry_notify_enabled_ = false;
+int PwaService::telemetry_hz_ = CONFIG_RAIL_TELEMETRY_HZ;
+uint32_t PwaService::telemetry_period_ms_ = 1000 / CONFIG_RAIL_TELEMETRY_HZ;
+atomic_t PwaService::telemetry_in_flight_ = ATOMIC_INIT(0);
+bool PwaService::telemetry_was_moving_ = false;
+int32_t PwaService::telemetry_last_nm_ = 0;
+int64_t PwaService::telemetry_last_ms_ = 0;
+uint8_t PwaService::telemetry_seq_ = 0;
 
 // Static method implementations
 void PwaService::cccChanged(const struct bt_gatt_attr *attr, uint16_t value) {
@@ -309,6 +329,25 @@ void PwaService::cccChanged(const struct bt_gatt_attr *attr, uint16_t value) {
   LOG_INF("PWA notifications %s", notify_enabled_ ? "enabled" : "disabled");
 }
 
+void PwaService::stateCccChanged(const struct bt_gatt_attr *attr,
+                                 uint16_t value) {
+  state_notify_enabled_ = (value == BT_GATT_CCC_NOTIFY);
+  // the first frame after subscribing carries all fields
+  state_valid_ = false;
+  LOG_INF("PWA state notifications %s",
+          state_notify_enabled_ ? "enabled" : "disabled");
+}
+
+ssize_t PwaService::stateRead(struct bt_conn *conn,
+                              const struct bt_gatt_attr *attr, void *buf,
+                              uint16_t len, uint16_t offset) {
+  uint8_t frame[kStateFrameMax];
+  k_mutex_lock(&latest_state_lock, K_FOREVER);
+  size_t size = encodeState(latest_state_, kAllStateFields, frame);
+  k_mutex_unlock(&latest_state_lock);
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, frame, size);
+}
+
 ssize_t PwaService::cmdWrite(struct bt_conn *conn,
                              const struct bt_gatt_attr *attr, const void *buf,
                              uint16_t len, uint16_t offset, uint8_t flags) {
@@ -328,34 +367,141 @@ ssize_t PwaService::cmdWrite(struct bt_conn *conn,
 
   LOG_DBG("PWA Command Received: '%s'", cmd);
 
+  char *line = cmd + strspn(cmd, " \t\r\n");
+  if (strncasecmp(line, "script", 6) == 0 && (line[6] == ' ' || !line[6])) {
+    handleScriptCommand(line + 6);
+    return len;
+  }
+  if (strncasecmp(line, "plan", 4) == 0 && (line[4] == ' ' || !line[4])) {
+    handlePlanCommand(line + 4);
+    return len;
+  }
+  if (strpbrk(line, "\n\r;")) {
+    handleBatch(line);
+    return len;
+  }
+
   char response[128];
-  char *saveptr;
-  char *token = strtok_r(cmd, " ", &saveptr);
+  // sequence number, group, name, argument and one to notice extra ones
+  char *tokens[5];
+  char **argv = tokens;
+  int argc = command_tokenize(line, tokens, ARRAY_SIZE(tokens));
+
+  // Followed commands get SEQ: notifications instead of ACK: and ERR:
+  uint16_t seq = 0;
+  if (argc > 0 && argv[0][0] == '@') {
+    if (command_parse_seq(argv[0], &seq) != 0) {
+      notifyStatus("ERR:INVALID_SEQ");
+      return len;
+    }
+    argv++;
+    argc--;
+  }
 
-  if (!token) {
+  if (argc == 0) {
     LOG_WRN("Empty command received");
     notifyStatus("ERR:EMPTY_COMMAND");
     return len;
   }
+  if (argc < 0) {
+    notifyCommandError(tokens[0], tokens[1], command_error_name(argc));
+    return len;
+  }
+  const bool known_group =
+      strcasecmp(argv[0], "rail") == 0 || strcasecmp(argv[0], "cam") == 0;
+  if (known_group && argc == 1) {
+    notifyCommandError(argv[0], nullptr, "MISSING_COMMAND");
+    return len;
+  }
+  if (strcasecmp(argv[0], "rail") == 0 &&
+      strcasecmp(argv[1], "telemetry") == 0) {
+    handleTelemetryCommand(argc > 2 ? argv[2] : nullptr);
+    return len;
+  }
 
-  if (strcasecmp(token, "rail") == 0) {
-    const char *subcmd = strtok_r(nullptr, " ", &saveptr);
-    if (handleRailCommand(subcmd, &saveptr)) {
+  const struct command_spec *spec =
+      known_group ? command_find(argv[0], argv[1]) : nullptr;
+  if (!spec) {
+    LOG_WRN("→ Unknown command: %s", argv[0]);
+    if (seq) {
+      notifyCommand(seq, "REJECTED:UNKNOWN_CMD");
       return len;
     }
-  } else if (strcasecmp(token, "cam") == 0) {
-    const char *subcmd = strtok_r(nullptr, " ", &saveptr);
-    if (handleCamCommand(subcmd, &saveptr)) {
+    snprintf(response, sizeof(response), "ERR:UNKNOWN_CMD:%s", argv[0]);
+    notifyStatus(response);
+    return len;
+  }
+
+  struct rail_command command;
+  int err = command_parse(spec, argc - 1, argv + 1, &command);
+  if (err) {
+    LOG_WRN("→ %s %s: %s", spec->group, spec->name, command_error_name(err));
+    if (seq) {
+      snprintf(response, sizeof(response), "REJECTED:%s",
+               command_error_name(err));
+      notifyCommand(seq, response);
       return len;
     }
+    notifyCommandError(spec->group, spec->name, command_error_name(err));
+    return len;
   }
 
-  LOG_WRN("→ Unknown command: %s", token);
-  snprintf(response, sizeof(response), "ERR:UNKNOWN_CMD:%s", token);
+  // Accepted and reported from here on by the state machine
+  command.seq = seq;
+  err = command_submit(&command);
+  if (seq) {
+    LOG_INF("→ Command @%u: %s %s", seq, spec->group, spec->name);
+    return len;
+  }
+  if (err) {
+    notifyCommandError(spec->group, spec->name, command_error_name(err));
+    return len;
+  }
+  strcpy(response, "ACK:");
+  command_describe(&command, response + 4, sizeof(response) - 4);
+  LOG_INF("→ Command: %s", response + 4);
   notifyStatus(response);
   return len;
 }
 
+ssize_t PwaService::planWrite(struct bt_conn *conn,
+                              const struct bt_gatt_attr *attr, const void *buf,
+                              uint16_t len, uint16_t offset, uint8_t flags) {
+  ARG_UNUSED(conn);
+  ARG_UNUSED(attr);
+
+  // A long write is checked once it is executed, chunk by chunk in order
+  if (flags & BT_GATT_WRITE_FLAG_PREPARE) {
+    return 0;
+  }
+  if (offset == 0) {
+    plan_frame_len = 0;
+  }
+  if (offset != plan_frame_len) {
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+  }
+  if (len == 0 || offset + len > sizeof(plan_frame)) {
+    plan_frame_len = 0;
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+  }
+  memcpy(plan_frame + offset, buf, len);
+  plan_frame_len = offset + len;
+
+  size_t size = planFrameSize(plan_frame, plan_frame_len);
+  if (plan_frame_len < size) {
+    // the rest follows in the same long write
+    return len;
+  }
+  if (plan_frame_len > size) {
+    LOG_WRN("Plan frame of %zu bytes, expected %zu", plan_frame_len, size);
+    notifyStatus("ERR:PLAN_INVALID_FRAME");
+  } else {
+    handlePlanFrame(plan_frame, size);
+  }
+  plan_frame_len = 0;
+  return len;
+}
+
 // C-style wrapper functions for GATT callbacks
 static void pwa_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value) {
   PwaService::cccChanged(attr, value);
@@ -367,6 +513,28 @@ static ssize_t pwa_cmd_write(struct bt_conn *conn,
   return PwaService::cmdWrite(conn, attr, buf, len, offset, flags);
 }
 
+static void pwa_state_ccc_changed(const struct bt_gatt_attr *attr,
+                                  uint16_t value) {
+  PwaService::stateCccChanged(attr, value);
+}
+
+static void pwa_telemetry_ccc_changed(const struct bt_gatt_attr *attr,
+                                      uint16_t value) {
+  PwaService::telemetryCccChanged(attr, value);
+}
+
+static ssize_t pwa_plan_write(struct bt_conn *conn,
+                              const struct bt_gatt_attr *attr, const void *buf,
+                              uint16_t len, uint16_t offset, uint8_t flags) {
+  return PwaService::planWrite(conn, attr, buf, len, offset, flags);
+}
+
+static ssize_t pwa_state_read(struct bt_conn *conn,
+                              const struct bt_gatt_attr *attr, void *buf,
+                              uint16_t len, uint16_t offset) {
+  return PwaService::stateRead(conn, attr, buf, len, offset);
+}
+
 // GATT service definition
 BT_GATT_SERVICE_DEFINE(
     pwa_gatt_svc, BT_GATT_PRIMARY_SERVICE(PWA_SERVICE_UUID),
@@ -385,17 +553,118 @@ BT_GATT_SERVICE_DEFINE(
     BT_GATT_CHARACTERISTIC(PWA_CMD_UUID,
                            BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                            BT_GATT_PERM_WRITE_ENCRYPT, NULL, pwa_cmd_write,
-                           NULL));
+                           NULL),
 
-const struct bt_gatt_attr *PwaService::findStatusAttr() {
-  const struct bt_gatt_attr *svc = bt_gatt_attr_next(nullptr);
-  while (svc) {
-    if (bt_uuid_cmp(svc->uuid, PWA_STATUS_UUID) == 0) {
-      return svc;
+    // State characteristic: Read + Notify, binary frames
+    BT_GATT_CHARACTERISTIC(PWA_STATE_UUID,
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_READ_ENCRYPT, pwa_state_read, NULL,
+                           NULL),
+    BT_GATT_CCC(pwa_state_ccc_changed,
+                BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
+
+    // Telemetry characteristic: Notify, positions while moving
+    BT_GATT_CHARACTERISTIC(PWA_TELEMETRY_UUID, BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(pwa_telemetry_ccc_changed,
+                BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
+
+    // Plan characteristic: Write, frames of up to PWA_PLAN_FRAME_MAX bytes
+    BT_GATT_CHARACTERISTIC(PWA_PLAN_UUID, BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_WRITE_ENCRYPT |
+                               BT_GATT_PERM_PREPARE_WRITE,
+                           NULL, pwa_plan_write, NULL));
+
+const struct bt_gatt_attr *
+PwaService::findAttr(const struct bt_uuid *uuid,
+                     const struct bt_gatt_attr **cache) {
+  if (*cache) {
+    return *cache;
+  }
+  for (size_t i = 0; i < pwa_gatt_svc.attr_count; i++) {
+    if (bt_uuid_cmp(pwa_gatt_svc.attrs[i].uuid, uuid) == 0) {
+      *cache = &pwa_gatt_svc.attrs[i];
+      break;
+    }
+  }
+  return *cache;
+}
+
+size_t PwaService::encodeState(const struct pwa_state &state, uint16_t mask,
+                               uint8_t *buf) {
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(&state);
+  uint8_t *p = buf;
+  *p++ = PWA_STATE_VERSION;
+  *p++ = state_seq_;
+  sys_put_le16(mask, p);
+  p += 2;
+  for (size_t i = 0; i < ARRAY_SIZE(kStateFields); i++) {
+    if (!(mask & BIT(i))) {
+      continue;
+    }
+    const state_field &field = kStateFields[i];
+    switch (field.size) {
+    case 4:
+      sys_put_le32(*reinterpret_cast<const uint32_t *>(src + field.offset), p);
+      break;
+    case 2:
+      sys_put_le16(*reinterpret_cast<const uint16_t *>(src + field.offset), p);
+      break;
+    default:
+      *p = src[field.offset];
+      break;
+    }
+    p += field.size;
+  }
+  return p - buf;
+}
+
+bool PwaService::notifyState(const struct pwa_state &state, bool full) {
+  k_mutex_lock(&latest_state_lock, K_FOREVER);
+  latest_state_ = state;
+  k_mutex_unlock(&latest_state_lock);
+  if (!state_notify_enabled_ || !pwa_conn_) {
+    return false;
+  }
+
+  const uint32_t start = k_cycle_get_32();
+  const uint8_t *now = reinterpret_cast<const uint8_t *>(&state);
+  const uint8_t *last = reinterpret_cast<const uint8_t *>(&state_);
+  uint16_t mask = kAllStateFields;
+  if (state_valid_ && !full) {
+    mask = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(kStateFields); i++) {
+      const state_field &field = kStateFields[i];
+      if (memcmp(now + field.offset, last + field.offset, field.size) != 0) {
+        mask |= BIT(i);
+      }
+    }
+    if (mask == 0) {
+      return true;
     }
-    svc = bt_gatt_attr_next(svc);
   }
-  return nullptr;
+
+  uint8_t frame[kStateFrameMax];
+  size_t size = encodeState(state, mask, frame);
+  const struct bt_gatt_attr *attr = findAttr(PWA_STATE_UUID, &state_attr);
+  int err = attr ? bt_gatt_notify(pwa_conn_, attr, frame, size) : -ENOENT;
+  if (err) {
+    // keep the last state so that the next frame carries this change too
+    LOG_WRN("State notify failed: %d", err);
+    return true;
+  }
+  state_ = state;
+  state_valid_ = true;
+  state_seq_++;
+  LOG_DBG("State frame mask 0x%03x, %u bytes, %u cycles", mask, size,
+          k_cycle_get_32() - start);
+  return true;
+}
+
+void PwaService::notifyCommand(uint16_t seq, const char *stage) {
+  char status[48];
+  snprintf(status, sizeof(status), "SEQ:%u:%s", seq, stage);
+  notifyStatus(status);
 }
 
 void PwaService::notifyStatus(const char *status) {
@@ -413,7 +682,7 @@ void PwaService::notifyStatus(const char *status) {
   memcpy(status_buffer_, status, len);
   status_buffer_[len] = '\0';
 
-  const struct bt_gatt_attr *attr = findStatusAttr();
+  const struct bt_gatt_attr *attr = findAttr(PWA_STATUS_UUID, &status_attr);
   if (!attr) {
     LOG_ERR("Status characteristic not found");
     return;
@@ -427,6 +696,124 @@ void PwaService::notifyStatus(const char *status) {
   }
 }
 
+void PwaService::startTelemetry(StepperWithTarget *stepper) {
+  telemetry_stepper_ = stepper;
+  k_work_init_delayable(&telemetry_work_, telemetryWorkHandler);
+}
+
+int PwaService::setTelemetryRate(int hz) {
+  if (hz < PWA_TELEMETRY_MIN_HZ || hz > PWA_TELEMETRY_MAX_HZ) {
+    return -EINVAL;
+  }
+  telemetry_hz_ = hz;
+  telemetry_period_ms_ = 1000 / hz;
+  return 0;
+}
+
+void PwaService::telemetryCccChanged(const struct bt_gatt_attr *attr,
+                                     uint16_t value) {
+  telemetry_notify_enabled_ = (value == BT_GATT_CCC_NOTIFY);
+  LOG_INF("PWA telemetry %s at %d Hz",
+          telemetry_notify_enabled_ ? "enabled" : "disabled", telemetry_hz_);
+  if (telemetry_notify_enabled_ && telemetry_stepper_) {
+    telemetry_was_moving_ = false;
+    k_work_reschedule(&telemetry_work_, K_NO_WAIT);
+  }
+}
+
+// No point in sampling faster than the connection events go out
+uint32_t PwaService::telemetryFloorMs() {
+  struct bt_conn_info info;
+  uint32_t floor_ms = 1000 / telemetry_hz_;
+  if (pwa_conn_ && bt_conn_get_info(pwa_conn_, &info) == 0) {
+    const uint32_t interval_ms =
+        BT_CONN_INTERVAL_TO_US(info.le.interval) / USEC_PER_MSEC;
+    floor_ms = MAX(floor_ms, interval_ms);
+  }
+  return floor_ms;
+}
+
+void PwaService::telemetrySent(struct bt_conn *conn, void *user_data) {
+  if (conn != pwa_conn_) {
+    return; // counted out on disconnect
+  }
+  atomic_dec(&telemetry_in_flight_);
+}
+
+int PwaService::sendTelemetry(int64_t now_ms, bool moving) {
+  const int32_t position_nm = telemetry_stepper_->get_position_nm();
+  const int32_t target_nm = telemetry_stepper_->get_target_position_nm();
+  const int64_t dt_ms = now_ms - telemetry_last_ms_;
+  int32_t velocity = 0;
+  if (moving && dt_ms > 0) {
+    velocity = (int64_t)(position_nm - telemetry_last_nm_) * 1000 / dt_ms;
+  }
+
+  uint8_t frame[kTelemetryFrameSize];
+  frame[0] = PWA_TELEMETRY_VERSION;
+  frame[1] = telemetry_seq_;
+  sys_put_le32((uint32_t)now_ms, &frame[2]);
+  sys_put_le32(position_nm, &frame[6]);
+  sys_put_le32(target_nm, &frame[10]);
+  sys_put_le32(velocity, &frame[14]);
+
+  struct bt_gatt_notify_params params = {};
+  params.attr = findAttr(PWA_TELEMETRY_UUID, &telemetry_attr);
+  params.data = frame;
+  params.len = sizeof(frame);
+  params.func = telemetrySent;
+  atomic_inc(&telemetry_in_flight_);
+  int err = bt_gatt_notify_cb(pwa_conn_, &params);
+  if (err) {
+    atomic_dec(&telemetry_in_flight_);
+    return err;
+  }
+  telemetry_seq_++;
+  telemetry_last_nm_ = position_nm;
+  telemetry_last_ms_ = now_ms;
+  return 0;
+}
+
+// Samples at the configured rate while moving, plus one once stopped. Halves
+// the rate while notifications queue up and recovers gradually.
+void PwaService::telemetryWorkHandler(struct k_work *work) {
+  if (!telemetry_notify_enabled_ || !pwa_conn_ || !telemetry_stepper_) {
+    return;
+  }
+
+  const bool moving = telemetry_stepper_->is_moving_now();
+  const uint32_t floor_ms = telemetryFloorMs();
+  const uint32_t ceiling_ms = 1000 / PWA_TELEMETRY_MIN_HZ;
+  telemetry_period_ms_ = CLAMP(telemetry_period_ms_, floor_ms, ceiling_ms);
+  if (moving || telemetry_was_moving_) {
+    const int64_t now_ms = k_uptime_get();
+    int err = -ENOBUFS;
+    if (atomic_get(&telemetry_in_flight_) < kTelemetryMaxInFlight) {
+      err = sendTelemetry(now_ms, moving);
+    }
+    if (err) {
+      // retried later at a lower rate
+      telemetry_period_ms_ = MIN(telemetry_period_ms_ * 2, ceiling_ms);
+      LOG_DBG("Telemetry backing off to %u ms (%d)", telemetry_period_ms_,
+              err);
+    } else {
+      telemetry_period_ms_ -= (telemetry_period_ms_ - floor_ms + 3) / 4;
+    }
+    if (!moving && err == 0) {
+      telemetry_was_moving_ = false;
+    } else if (moving) {
+      telemetry_was_moving_ = true;
+    }
+  } else {
+    telemetry_last_ms_ = k_uptime_get();
+    telemetry_last_nm_ = telemetry_stepper_->get_position_nm();
+  }
+
+  const uint32_t delay_ms =
+      telemetry_was_moving_ ? telemetry_period_ms_ : kTelemetryIdleMs;
+  k_work_reschedule(&telemetry_work_, K_MSEC(delay_ms));
+}
+
 bool PwaService::isConnected() { return pwa_conn_ != nullptr; }
 
 void PwaService::onConnected(struct bt_conn *conn, uint8_t err) {
@@ -472,6 +859,12 @@ void PwaService::onDisconnected(struct bt_conn *conn, uint8_t reason) {
     pwa_conn_ = nullptr;
   }
   notify_enabled_ = false;
+  state_notify_enabled_ = false;
+  state_valid_ = false;
+  telemetry_notify_enabled_ = false;
+  // Notifications still queued for the old link are dropped with it
+  k_work_cancel_delayable(&telemetry_work_);
+  atomic_clear(&telemetry_in_flight_);
 
   LOG_INF("Restarting advertising after disconnect...");
   if (int err = startAdvertising(); err) {
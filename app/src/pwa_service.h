@@ -4,13 +4,62 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/uuid.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+class StepperWithTarget;
+
+// Version of the binary state frame, bumped on layout changes
+#define PWA_STATE_VERSION 1
+
+// Bits of pwa_state::flags
+#define PWA_STATE_STACK_RUNNING BIT(0)
+#define PWA_STATE_MOVING BIT(1)
+#define PWA_STATE_CAM_CONNECTED BIT(2)
+
+/**
+ * @brief Rail state as sent on the state characteristic.
+ *
+ * A frame is a header {version, sequence, changed mask (u16)} followed by
+ * the changed fields in the order below, little-endian. Bit n of the mask
+ * stands for field n. Notifications carry the fields changed since the last
+ * one, reads and the first notification after subscribing carry all.
+ */
+struct pwa_state {
+  int32_t position_nm;
+  int32_t target_nm;
+  int32_t lower_nm;
+  int32_t upper_nm;
+  int16_t stack_index; // -1 without stack
+  uint16_t stack_length;
+  uint16_t wait_before_ms; // saturated
+  uint16_t wait_after_ms;  // saturated
+  uint8_t flags;
+};
+
+// Telemetry frame: {version, sequence, time_ms (u32), position_nm,
+// target_nm, velocity_nm_per_s (i32)}, little-endian
+#define PWA_TELEMETRY_VERSION 1
+#define PWA_TELEMETRY_MIN_HZ 5
+#define PWA_TELEMETRY_MAX_HZ 50
+
+// Plan frames: {BEGIN, count (u16)}, {DATA, index (u16), n (u8), n positions
+// in nm (i32)} and {COMMIT}, little-endian. A frame may take a long write.
+#define PWA_PLAN_BEGIN 1
+#define PWA_PLAN_DATA 2
+#define PWA_PLAN_COMMIT 3
+#define PWA_PLAN_FRAME_MAX 512
 
 /**
  * @brief PWA GATT Service for Web Bluetooth control
  *
- * This service exposes two characteristics:
+ * This service exposes five characteristics:
  * - Command (write): Receives commands from the PWA
- * - Status (read + notify): Sends status updates to the PWA
+ * - Status (read + notify): Sends text responses to the PWA
+ * - State (read + notify): Sends the rail state as binary frames
+ * - Telemetry (notify): Streams positions while the rail moves
+ * - Plan (write): Receives stack plans as lists of positions
  */
 class PwaService {
 public:
@@ -32,6 +81,36 @@ public:
    */
   static void notifyStatus(const char *status);
 
+  /**
+   * @brief Report the progress of a command sent with a sequence number
+   * @param stage ACCEPTED, REJECTED:<reason>, STARTED or COMPLETED:<err>,
+   *        sent as "SEQ:<seq>:<stage>"
+   */
+  static void notifyCommand(uint16_t seq, const char *stage);
+
+  /**
+   * @brief Send the fields of @p state that changed since the last frame
+   *
+   * Also kept for reads of the state characteristic, so call it with every
+   * change, connected or not.
+   * @param full send all fields, e.g. when asked for the status
+   * @return false if no client subscribed to the state characteristic, the
+   *         caller may fall back to a text status then
+   */
+  static bool notifyState(const struct pwa_state &state, bool full = false);
+
+  /**
+   * @brief Stream positions of @p stepper once a client subscribes to the
+   * telemetry characteristic.
+   */
+  static void startTelemetry(StepperWithTarget *stepper);
+
+  /**
+   * @brief Set the telemetry rate while moving
+   * @return 0 on success, -EINVAL outside PWA_TELEMETRY_MIN_HZ..MAX_HZ
+   */
+  static int setTelemetryRate(int hz);
+
   /**
    * @brief Check if a PWA client is connected
    * @return true if connected, false otherwise
@@ -47,6 +126,16 @@ public:
                           const void *buf, uint16_t len, uint16_t offset,
                           uint8_t flags);
   static void cccChanged(const struct bt_gatt_attr *attr, uint16_t value);
+  static void stateCccChanged(const struct bt_gatt_attr *attr,
+                              uint16_t value);
+  static ssize_t stateRead(struct bt_conn *conn,
+                           const struct bt_gatt_attr *attr, void *buf,
+                           uint16_t len, uint16_t offset);
+  static void telemetryCccChanged(const struct bt_gatt_attr *attr,
+                                  uint16_t value);
+  static ssize_t planWrite(struct bt_conn *conn,
+                           const struct bt_gatt_attr *attr, const void *buf,
+                           uint16_t len, uint16_t offset, uint8_t flags);
 
   // Public access to status buffer for GATT service
   static uint8_t status_buffer_[256];
@@ -54,7 +143,35 @@ public:
 private:
   static struct bt_conn *pwa_conn_;
   static bool notify_enabled_;
+  static bool state_notify_enabled_;
+
+  // Last state sent, deltas are taken against it
+  static struct pwa_state state_;
+  static bool state_valid_;
+  // Last state handed in, subscribed or not, answers reads
+  static struct pwa_state latest_state_;
+  static uint8_t state_seq_;
+
+  // Helper to find an attribute for notifications, looked up once
+  static const struct bt_gatt_attr *findAttr(const struct bt_uuid *uuid,
+                                             const struct bt_gatt_attr **cache);
+  static size_t encodeState(const struct pwa_state &state, uint16_t mask,
+                            uint8_t *buf);
+
+  // Telemetry, sampled from the system work queue
+  static StepperWithTarget *telemetry_stepper_;
+  static struct k_work_delayable telemetry_work_;
+  static bool telemetry_notify_enabled_;
+  static int telemetry_hz_;
+  static uint32_t telemetry_period_ms_; // backed off from 1000 / hz
+  static atomic_t telemetry_in_flight_;
+  static bool telemetry_was_moving_;
+  static int32_t telemetry_last_nm_;
+  static int64_t telemetry_last_ms_;
+  static uint8_t telemetry_seq_;
 
-  // Helper to find status attribute for notifications
-  static const struct bt_gatt_attr *findStatusAttr();
+  static void telemetryWorkHandler(struct k_work *work);
+  static void telemetrySent(struct bt_conn *conn, void *user_data);
+  static int sendTelemetry(int64_t now_ms, bool moving);
+  static uint32_t telemetryFloorMs();
 };
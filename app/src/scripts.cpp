@@ -0,0 +1,192 @@
+#include "scripts.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#ifdef CONFIG_SETTINGS
+#include <zephyr/settings/settings.h>
+#endif
+
+#include "commands.h"
+
+LOG_MODULE_REGISTER(scripts, LOG_LEVEL_INF);
+
+namespace {
+
+struct script {
+  char name[SCRIPT_NAME_MAX + 1];
+  char body[CONFIG_RAIL_SCRIPT_SIZE];
+};
+
+// Written from the shell and from the Bluetooth RX thread
+struct script scripts[CONFIG_RAIL_SCRIPTS];
+K_MUTEX_DEFINE(scripts_lock);
+
+// Parsing needs more than the Bluetooth RX stack should give, under the lock
+char scratch_text[CONFIG_RAIL_SCRIPT_SIZE];
+struct rail_command scratch_cmds[COMMAND_BATCH_MAX];
+
+bool valid_name(const char *name) {
+  size_t len = strlen(name);
+  if (len == 0 || len > SCRIPT_NAME_MAX) {
+    return false;
+  }
+  for (const char *p = name; *p; p++) {
+    if (!isalnum((unsigned char)*p) && *p != '_' && *p != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct script *find_script(const char *name, bool or_free) {
+  struct script *free_slot = nullptr;
+  for (auto &script : scripts) {
+    if (strcmp(script.name, name) == 0) {
+      return &script;
+    }
+    if (!free_slot && script.name[0] == '\0') {
+      free_slot = &script;
+    }
+  }
+  return or_free ? free_slot : nullptr;
+}
+
+#ifdef CONFIG_SETTINGS
+void script_key(const char *name, char *key, size_t len) {
+  snprintk(key, len, "rail/script/%s", name);
+}
+
+int scripts_set(const char *name, size_t len, settings_read_cb read_cb,
+                void *cb_arg) {
+  struct script *script =
+      valid_name(name) ? find_script(name, true) : nullptr;
+  if (!script || len >= sizeof(script->body)) {
+    LOG_WRN("Ignoring stored script %s", name);
+    return -EINVAL;
+  }
+  ssize_t read = read_cb(cb_arg, script->body, len);
+  if (read < 0) {
+    return read;
+  }
+  script->body[read] = '\0';
+  strcpy(script->name, name);
+  return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(rail_scripts, "rail/script", NULL,
+                               scripts_set, NULL, NULL);
+#endif
+
+} // namespace
+
+int script_save(const char *name, const char *body, int *failed) {
+  *failed = 0;
+  if (!valid_name(name)) {
+    return -EINVAL;
+  }
+  size_t len = strlen(body);
+  if (len >= CONFIG_RAIL_SCRIPT_SIZE) {
+    return -EFBIG;
+  }
+
+  k_mutex_lock(&scripts_lock, K_FOREVER);
+  strcpy(scratch_text, body);
+  int count = command_parse_batch(scratch_text, scratch_cmds,
+                                  ARRAY_SIZE(scratch_cmds), failed);
+  if (count == 0) {
+    count = -ENODATA;
+  }
+  struct script *script = count < 0 ? nullptr : find_script(name, true);
+  if (script) {
+    strcpy(script->name, name);
+    strcpy(script->body, body);
+  }
+  k_mutex_unlock(&scripts_lock);
+  if (count < 0) {
+    return count;
+  }
+  if (!script) {
+    return -ENOMEM;
+  }
+
+#ifdef CONFIG_SETTINGS
+  char key[32];
+  script_key(name, key, sizeof(key));
+  if (int err = settings_save_one(key, body, len); err) {
+    LOG_WRN("Saving script %s failed (%d)", name, err);
+  }
+#endif
+  LOG_INF("Script %s: %d commands", name, count);
+  return count;
+}
+
+int script_delete(const char *name) {
+  k_mutex_lock(&scripts_lock, K_FOREVER);
+  struct script *script = find_script(name, false);
+  if (script) {
+    *script = {};
+  }
+  k_mutex_unlock(&scripts_lock);
+  if (!script) {
+    return -ESRCH;
+  }
+
+#ifdef CONFIG_SETTINGS
+  char key[32];
+  script_key(name, key, sizeof(key));
+  settings_delete(key);
+#endif
+  return 0;
+}
+
+int script_run(const char *name, int *failed) {
+  *failed = 0;
+  k_mutex_lock(&scripts_lock, K_FOREVER);
+  struct script *script = find_script(name, false);
+  int count = -ESRCH;
+  if (script) {
+    // Parsed again, a trigger named in the script may be gone by now
+    strcpy(scratch_text, script->body);
+    count = command_parse_batch(scratch_text, scratch_cmds,
+                                ARRAY_SIZE(scratch_cmds), failed);
+  }
+  if (count >= 0) {
+    LOG_INF("Running script %s: %d commands", name, count);
+    count = command_submit_batch(scratch_cmds, count);
+  }
+  k_mutex_unlock(&scripts_lock);
+  return count;
+}
+
+int script_show(const char *name, char *buf, size_t size) {
+  k_mutex_lock(&scripts_lock, K_FOREVER);
+  struct script *script = find_script(name, false);
+  int len = script ? snprintf(buf, size, "%s", script->body) : -ESRCH;
+  k_mutex_unlock(&scripts_lock);
+  return len;
+}
+
+int script_list(char *buf, size_t size) {
+  int count = 0;
+  size_t used = 0;
+  buf[0] = '\0';
+  k_mutex_lock(&scripts_lock, K_FOREVER);
+  for (const auto &script : scripts) {
+    if (script.name[0] == '\0') {
+      continue;
+    }
+    int n = snprintf(buf + used, size - used, "%s%s", count ? "," : "",
+                     script.name);
+    if (n < 0 || (size_t)n >= size - used) {
+      break;
+    }
+    used += n;
+    count++;
+  }
+  k_mutex_unlock(&scripts_lock);
+  return count;
+}
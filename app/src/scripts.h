@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+/* Longest script name, letters, digits, '_' and '-' */
+#define SCRIPT_NAME_MAX 15
+
+/**
+ * @brief Store a named batch of commands, persisted with the settings.
+ *
+ * The body is checked with command_parse_batch() and replaces a script of
+ * the same name.
+ *
+ * @param failed set like command_parse_batch() does
+ * @return the number of commands, -EINVAL for a bad name, -ENODATA without
+ * commands, -EFBIG if the body is longer than CONFIG_RAIL_SCRIPT_SIZE,
+ * -ENOMEM if all slots are taken, or an error of command_parse_batch()
+ */
+int script_save(const char *name, const char *body, int *failed);
+
+/* @return 0 on success, -ESRCH if there is no such script */
+int script_delete(const char *name);
+
+/**
+ * @brief Queue all commands of a script.
+ *
+ * @return the number of commands, -ESRCH if there is no such script, or an
+ * error of command_parse_batch() or command_submit_batch()
+ */
+int script_run(const char *name, int *failed);
+
+/* Copy the body of a script, @return its length or -ESRCH */
+int script_show(const char *name, char *buf, size_t size);
+
+/* Names of all scripts separated by ',', @return the number of scripts */
+int script_list(char *buf, size_t size);
@@ -2,248 +2,345 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(shell, LOG_LEVEL_INF);
 
-static int cmd_rail_go(const struct shell *sh, size_t argc, char **argv) {
-
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail %s <distance>", argv[0]);
-    return -EINVAL;
+// Commands of the shared table, argv[0] is the command name
+static int cmd_table(const struct shell *sh, const char *group, size_t argc,
+                     char **argv) {
+  const struct command_spec *spec = command_find(group, argv[0]);
+  if (!spec) {
+    return -ENOEXEC;
   }
 
-  // Check if argv[0] is `go` or `go_nm`:
-  bool is_nm_command = (strcmp(argv[0], "go_nm") == 0);
-  int multiplier =
-      is_nm_command ? 1 : 1000; // go_nm uses nm directly, go uses um
-
-  int distance_nm = atof(argv[1]) * multiplier;
-  event_pub(EVENT_GO, distance_nm);
-
-  return 0;
-}
-
-static int cmd_rail_go_to(const struct shell *sh, size_t argc, char **argv) {
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail go_to <absolute_position>");
-    return -EINVAL;
+  struct rail_command cmd;
+  int err = command_parse(spec, argc, argv, &cmd);
+  if (err) {
+    const char *arg = command_arg_name(spec);
+    shell_print(sh, "%s, usage: %s %s%s%s%s", command_error_name(err), group,
+                spec->name, *arg ? (spec->required ? " <" : " [") : "", arg,
+                *arg ? (spec->required ? ">" : "]") : "");
+    if (spec->arg == arg_kind::TRIGGER) {
+      for (int i = 0; get_trigger(i); i++) {
+        shell_print(sh, "  %s", get_trigger(i)->name());
+      }
+    }
+    return err;
   }
+  return command_submit(&cmd);
+}
 
-  int position_um = atof(argv[1]);
-  int position_nm = position_um * 1000;
-  event_pub(EVENT_GO_TO, position_nm);
-
-  return 0;
+static int cmd_rail_table(const struct shell *sh, size_t argc, char **argv) {
+  return cmd_table(sh, "rail", argc, argv);
 }
 
-static int cmd_rail_go_pct(const struct shell *sh, size_t argc, char **argv) {
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail go_pct <percentage>");
-    return -EINVAL;
-  }
+static int cmd_cam_table(const struct shell *sh, size_t argc, char **argv) {
+  return cmd_table(sh, "cam", argc, argv);
+}
 
-  int percentage = atoi(argv[1]);
-  if (percentage < 0 || percentage > 100) {
-    shell_print(sh, "Percentage must be between 0 and 100");
-    return -EINVAL;
+// The table first, then the commands only the shell has
+static void get_table_entry(const char *group, shell_cmd_handler handler,
+                            const struct shell_static_entry *extras,
+                            size_t num_extras, size_t idx,
+                            struct shell_static_entry *entry) {
+  const struct command_spec *spec = command_get(group, idx);
+  if (spec) {
+    entry->syntax = spec->name;
+    entry->help = spec->help;
+    entry->subcmd = NULL;
+    entry->handler = handler;
+    entry->args.mandatory = 1;
+    entry->args.optional = spec->arg == arg_kind::NONE ? 0 : 1;
+    return;
   }
 
-  event_pub(EVENT_GO_PCT, percentage);
-
-  return 0;
-}
-
-static int cmd_rail_setLowerBound(const struct shell *sh, size_t argc,
-                                  char **argv) {
-  if (argc == 2) {
-    int position_um = atof(argv[1]);
-    int position_nm = position_um * 1000;
-    event_pub(EVENT_SET_LOWER_BOUND_TO, position_nm);
+  idx -= command_count(group);
+  if (idx < num_extras) {
+    *entry = extras[idx];
   } else {
-    event_pub(EVENT_SET_LOWER_BOUND);
+    entry->syntax = NULL;
   }
-  return 0;
 }
 
-static int cmd_rail_setUpperBound(const struct shell *sh, size_t argc,
-                                  char **argv) {
-  if (argc == 2) {
-    int position_um = atof(argv[1]);
+#ifdef CONFIG_SIMPLE_STEPPER_TIMING_STATS
+static int cmd_rail_timing(const struct shell *sh, size_t argc, char **argv) {
+  const struct device *stepper_dev = DEVICE_DT_GET(DT_NODELABEL(stepper_motor));
 
-    int position_nm = position_um * 1000;
-    event_pub(EVENT_SET_UPPER_BOUND_TO, position_nm);
-  } else {
-    event_pub(EVENT_SET_UPPER_BOUND);
+  if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+    return simple_stepper_reset_timing_stats(stepper_dev);
+  } else if (argc != 1) {
+    shell_print(sh, "Usage: rail timing [reset]");
+    return -EINVAL;
   }
-  return 0;
-}
 
-static int cmd_rail_setWaitBefore(const struct shell *sh, size_t argc,
-                                  char **argv) {
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail wait_before <milliseconds>");
-    return -EINVAL;
+  struct simple_stepper_timing_stats stats;
+  int ret = simple_stepper_get_timing_stats(stepper_dev, &stats);
+  if (ret < 0) {
+    return ret;
+  }
+  if (stats.steps == 0) {
+    shell_print(sh, "No steps measured");
+    return 0;
   }
 
-  int wait_ms = atoi(argv[1]);
-  event_pub(EVENT_SET_WAIT_BEFORE_MS, wait_ms);
+  shell_print(sh, "steps=%u error_ns: min=%d max=%d mean_abs=%llu", stats.steps,
+              stats.min_error_ns, stats.max_error_ns,
+              (unsigned long long)(stats.abs_error_sum_ns / stats.steps));
   return 0;
 }
+#endif
 
-static int cmd_rail_setWaitAfter(const struct shell *sh, size_t argc,
-                                 char **argv) {
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail wait_after <milliseconds>");
+static int cmd_rail_burst(const struct shell *sh, size_t argc, char **argv) {
+  int count = argc == 2 ? atoi(argv[1]) : 20;
+  if (count < 1) {
+    shell_print(sh, "Usage: rail burst [count]");
     return -EINVAL;
   }
 
-  int wait_ms = atoi(argv[1]);
-  event_pub(EVENT_SET_WAIT_AFTER_MS, wait_ms);
+  // Jog by 0nm as fast as possible, every single one has to be processed
+  const struct event_stats before = get_event_stats();
+  for (int i = 0; i < count; i++) {
+    event_pub(EVENT_GO, 0);
+  }
+  struct event_stats after = get_event_stats();
+  const int64_t deadline_ms = k_uptime_get() + 2000;
+  while (after.processed - before.processed <
+             after.published - before.published &&
+         k_uptime_get() < deadline_ms) {
+    k_sleep(K_MSEC(10));
+    after = get_event_stats();
+  }
+
+  shell_print(sh, "burst of %d: published %u, processed %u, dropped %u", count,
+              after.published - before.published,
+              after.processed - before.processed,
+              after.dropped - before.dropped);
   return 0;
 }
 
-static int cmd_rail_setSpeedRpm(const struct shell *sh, size_t argc,
-                                char **argv) {
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail set_rpm <rpm>");
+static int cmd_rail_parsebench(const struct shell *sh, size_t argc,
+                               char **argv) {
+  static const char *const lines[] = {
+      "rail go 1.5",
+      "rail go_nm -250",
+      "rail stack_count 120",
+      "rail set_speed fast",
+      "rail lower",
+      "rail wait_before 1000",
+      "cam profile half_press_held",
+      "cam shoot",
+  };
+  int rounds = argc == 2 ? atoi(argv[1]) : 1000;
+  if (rounds < 1) {
+    shell_print(sh, "Usage: rail parsebench [rounds]");
     return -EINVAL;
   }
 
-  int rpm = atoi(argv[1]);
-  if (rpm < 1) {
-    shell_print(sh, "RPM must be >= 1");
-    return -EINVAL;
+  // Tokenizing included, the PWA parses whole lines like this
+  uint64_t total_cycles = 0;
+  for (const char *line : lines) {
+    char buf[48];
+    struct rail_command cmd;
+    uint32_t start = k_cycle_get_32();
+    for (int i = 0; i < rounds; i++) {
+      strncpy(buf, line, sizeof(buf));
+      if (command_parse_line(buf, &cmd) != 0) {
+        shell_print(sh, "%s: does not parse", line);
+        return -EINVAL;
+      }
+    }
+    uint32_t cycles = k_cycle_get_32() - start;
+    total_cycles += cycles;
+    shell_print(sh, "%-30s %6u cycles %6llu ns", line, cycles / rounds,
+                (unsigned long long)(k_cyc_to_ns_floor64(cycles) / rounds));
   }
 
-  event_pub(EVENT_SET_SPEED_RPM, rpm);
+  const uint32_t parses = rounds * ARRAY_SIZE(lines);
+  shell_print(sh, "%u parses, %llu cycles %llu ns per command", parses,
+              (unsigned long long)(total_cycles / parses),
+              (unsigned long long)(k_cyc_to_ns_floor64(total_cycles) / parses));
   return 0;
 }
 
-static int cmd_rail_setSpeed(const struct shell *sh, size_t argc, char **argv) {
-  if (argc != 2) {
-    shell_print(sh, "Usage: rail set_speed <slow|medium|fast>");
-    return -EINVAL;
-  }
+static const struct shell_static_entry rail_extras[] = {
+    {
+        .syntax = "burst",
+        .help = "Publish a burst of no-op jogs, count lost events.",
+        .handler = cmd_rail_burst,
+    },
+    {
+        .syntax = "parsebench",
+        .help = "Measure the parse cost per command.",
+        .handler = cmd_rail_parsebench,
+    },
+#ifdef CONFIG_SIMPLE_STEPPER_TIMING_STATS
+    {
+        .syntax = "timing",
+        .help = "Show step timing jitter (reset to clear).",
+        .handler = cmd_rail_timing,
+    },
+#endif
+};
+
+static void get_rail_entry(size_t idx, struct shell_static_entry *entry) {
+  get_table_entry("rail", cmd_rail_table, rail_extras, ARRAY_SIZE(rail_extras),
+                  idx, entry);
+}
 
-  int speed_value = 0;
-  if (strcmp(argv[1], "slow") == 0) {
-    speed_value = 1;
-  } else if (strcmp(argv[1], "medium") == 0) {
-    speed_value = 2;
-  } else if (strcmp(argv[1], "fast") == 0) {
-    speed_value = 3;
+SHELL_DYNAMIC_CMD_CREATE(sub_rail, get_rail_entry);
+SHELL_CMD_REGISTER(rail, &sub_rail, "rail commands", NULL);
+SHELL_CMD_REGISTER(r, &sub_rail, "rail commands", NULL);
+
+static void print_batch_error(const struct shell *sh, int err, int failed) {
+  if (failed) {
+    shell_print(sh, "command %d: %s", failed, command_error_name(err));
   } else {
-    shell_print(sh, "Unknown speed '%s'. Use slow, medium, or fast.", argv[1]);
-    return -EINVAL;
+    shell_print(sh, "%s", command_error_name(err));
   }
-
-  event_pub(EVENT_SET_SPEED, speed_value);
-  return 0;
 }
 
-static int cmd_rail_disable(const struct shell *sh, size_t argc, char **argv) {
-  ARG_UNUSED(sh);
-  ARG_UNUSED(argc);
-  ARG_UNUSED(argv);
-  event_pub(EVENT_DISABLE);
+static int cmd_script_save(const struct shell *sh, size_t argc, char **argv) {
+  if (argc != 3) {
+    shell_print(sh, "Usage: script save <name> <command>[; <command>...]");
+    return -EINVAL;
+  }
+  int failed;
+  int count = script_save(argv[1], argv[2], &failed);
+  if (count < 0) {
+    print_batch_error(sh, count, failed);
+    return count;
+  }
+  shell_print(sh, "%s: %d commands", argv[1], count);
   return 0;
 }
 
-static int cmd_rail_stop(const struct shell *sh, size_t argc, char **argv) {
-  ARG_UNUSED(sh);
-  ARG_UNUSED(argc);
-  ARG_UNUSED(argv);
-  event_pub(EVENT_STOP);
-  shell_print(sh, "Stopping stack...");
+static int cmd_script_run(const struct shell *sh, size_t argc, char **argv) {
+  int failed;
+  int count = script_run(argv[1], &failed);
+  if (count < 0) {
+    print_batch_error(sh, count, failed);
+    return count;
+  }
+  shell_print(sh, "%s: queued %d commands", argv[1], count);
   return 0;
 }
 
-static int cmd_rail_startStackWithStepSize(const struct shell *sh, size_t argc,
-                                           char **argv) {
-  bool is_nm_command = (strcmp(argv[0], "stack_nm") == 0);
-  int multiplier =
-      is_nm_command ? 1 : 1000; // stack_nm uses nm directly, stack uses um
-
-  if (argc == 2) {
-    int expected_step_size_nm = atof(argv[1]) * multiplier;
-    event_pub(EVENT_START_STACK_WITH_STEP_SIZE, expected_step_size_nm);
-  } else if (argc > 2) {
-    shell_print(sh, "Usage: rail %s <expected_step_size>", argv[0]);
-    return -EINVAL;
-  } else {
-    event_pub(EVENT_START_STACK_WITH_STEP_SIZE, 1000);
+static int cmd_script_delete(const struct shell *sh, size_t argc,
+                             char **argv) {
+  int err = script_delete(argv[1]);
+  if (err) {
+    print_batch_error(sh, err, 0);
   }
-  return 0;
+  return err;
 }
-static int cmd_rail_startStackWithLength(const struct shell *sh, size_t argc,
-                                         char **argv) {
-  if (argc == 2) {
-    int expected_length_of_stack = atoi(argv[1]);
-    event_pub(EVENT_START_STACK_WITH_LENGTH, expected_length_of_stack);
-  } else if (argc > 2) {
-    shell_print(sh, "Usage: rail startStack <expected_length_of_stack>");
-    return -EINVAL;
-  } else {
-    event_pub(EVENT_START_STACK_WITH_LENGTH, 100);
+
+static int cmd_script_show(const struct shell *sh, size_t argc, char **argv) {
+  char body[CONFIG_RAIL_SCRIPT_SIZE];
+  int len = script_show(argv[1], body, sizeof(body));
+  if (len < 0) {
+    print_batch_error(sh, len, 0);
+    return len;
   }
+  shell_print(sh, "%s", body);
   return 0;
 }
 
-static int cmd_rail_status(const struct shell *sh, size_t argc, char **argv) {
-  event_pub(EVENT_STATUS);
+static int cmd_script_list(const struct shell *sh, size_t argc, char **argv) {
+  char names[CONFIG_RAIL_SCRIPTS * (SCRIPT_NAME_MAX + 1) + 1];
+  int count = script_list(names, sizeof(names));
+  shell_print(sh, "%d scripts: %s", count, names);
   return 0;
 }
 
 SHELL_STATIC_SUBCMD_SET_CREATE(
-    sub_rail, SHELL_CMD(go, NULL, "Go relative.", cmd_rail_go),
-    SHELL_CMD(g, NULL, "Go relative.", cmd_rail_go),
-    SHELL_CMD(go_nm, NULL, "Go relative (nm).", cmd_rail_go),
-    SHELL_CMD(go_to, NULL, "Go to absolute position.", cmd_rail_go_to),
-    SHELL_CMD(go_pct, NULL, "Go to percentage between upper and lower bound.",
-              cmd_rail_go_pct),
-    SHELL_CMD(p, NULL, "Go to percentage between upper and lower bound.",
-              cmd_rail_go_pct),
-    SHELL_CMD(lower, NULL, "Set lower bound.", cmd_rail_setLowerBound),
-    SHELL_CMD(upper, NULL, "Set upper bound.", cmd_rail_setUpperBound),
-    SHELL_CMD(wait_before, NULL, "Set wait before ms.", cmd_rail_setWaitBefore),
-    SHELL_CMD(wait_after, NULL, "Set wait after ms.", cmd_rail_setWaitAfter),
-    SHELL_CMD(set_speed, NULL, "Set movement speed (slow|medium|fast).",
-              cmd_rail_setSpeed),
-    SHELL_CMD(set_rpm, NULL, "Set movement speed using raw RPM.",
-              cmd_rail_setSpeedRpm),
-    SHELL_CMD(disable, NULL, "Disable stepper until the next event.",
-              cmd_rail_disable),
-    SHELL_CMD(stop, NULL, "Stop running stack.", cmd_rail_stop),
-    SHELL_CMD(s, NULL, "Start stacking with step size.",
-              cmd_rail_startStackWithStepSize),
-    SHELL_CMD(stack, NULL, "Start stacking with step size.",
-              cmd_rail_startStackWithStepSize),
-    SHELL_CMD(stack_nm, NULL, "Start stacking with step size (nm).",
-              cmd_rail_startStackWithStepSize),
-    SHELL_CMD(stack_count, NULL, "Start stacking with length.",
-              cmd_rail_startStackWithLength),
-    SHELL_CMD(status, NULL, "Get current status.", cmd_rail_status),
+    sub_script,
+    SHELL_CMD_ARG(save, NULL, "Save commands separated by ';' as <name>.",
+                  cmd_script_save, 2, SHELL_OPT_ARG_RAW),
+    SHELL_CMD_ARG(run, NULL, "Queue all commands of a script.",
+                  cmd_script_run, 2, 0),
+    SHELL_CMD_ARG(delete, NULL, "Delete a script.", cmd_script_delete, 2, 0),
+    SHELL_CMD_ARG(show, NULL, "Print the commands of a script.",
+                  cmd_script_show, 2, 0),
+    SHELL_CMD(list, NULL, "List the scripts.", cmd_script_list),
     SHELL_SUBCMD_SET_END);
-SHELL_CMD_REGISTER(rail, &sub_rail, "rail commands", NULL);
-SHELL_CMD_REGISTER(r, &sub_rail, "rail commands", NULL);
+SHELL_CMD_REGISTER(script, &sub_script, "command scripts", NULL);
 
-static int cmd_cam_shoot(const struct shell *sh, size_t argc, char **argv) {
-  event_pub(EVENT_SHOOT);
-  return 0;
+static void print_plan(const struct shell *sh, const char *kind,
+                       const struct plan_info *info) {
+  if (info->count == 0) {
+    shell_print(sh, "%s: none", kind);
+    return;
+  }
+  shell_print(sh, "%s: %zu frames from %.3fum to %.3fum, eta %u:%02u", kind,
+              info->count, nm_as_um(info->first_nm), nm_as_um(info->last_nm),
+              info->eta_ms / 60000, info->eta_ms / 1000 % 60);
 }
 
-static int cmd_cam_record(const struct shell *sh, size_t argc, char **argv) {
-  event_pub(EVENT_RECORD);
+// Goes through the same upload as the PWA, one position at a time
+static int cmd_plan_set(const struct shell *sh, size_t argc, char **argv) {
+  int err = plan_begin(argc - 1);
+  for (size_t i = 1; !err && i < argc; i++) {
+    int32_t nm;
+    uint8_t le[4];
+    err = command_parse_um(argv[i], &nm);
+    if (err) {
+      shell_print(sh, "%s: %s", argv[i], command_error_name(err));
+      return err;
+    }
+    sys_put_le32(nm, le);
+    err = plan_put(i - 1, le, 1);
+  }
+  int count = err ? err : plan_commit();
+  if (count < 0) {
+    shell_print(sh, "%s", command_error_name(count));
+    return count;
+  }
+  struct plan_info info;
+  plan_get_info(&info);
+  print_plan(sh, "positions", &info);
   return 0;
 }
 
-static int cmd_cam_startScan(const struct shell *sh, size_t argc, char **argv) {
-  event_pub(EVENT_CAMERA_START_SCAN);
+static int cmd_plan_segments(const struct shell *sh, size_t argc,
+                             char **argv) {
+  struct plan_segment segments[CONFIG_RAIL_PLAN_SEGMENTS];
+  int32_t start;
+  int count =
+      plan_parse_segments(argv[1], &start, segments, ARRAY_SIZE(segments));
+  if (count >= 0) {
+    count = plan_set_segments(start, segments, count);
+  }
+  if (count < 0) {
+    shell_print(sh, "%s, usage: plan segments <start> <end>/<step>|"
+                    "<end>x<frames>...",
+                command_error_name(count));
+    return count;
+  }
+  struct plan_info info;
+  plan_get_segment_info(&info);
+  print_plan(sh, "segments", &info);
   return 0;
 }
 
-static int cmd_cam_stopScan(const struct shell *sh, size_t argc, char **argv) {
-  event_pub(EVENT_CAMERA_STOP_SCAN);
+static int cmd_plan_show(const struct shell *sh, size_t argc, char **argv) {
+  struct plan_info info;
+  plan_get_info(&info);
+  print_plan(sh, "positions", &info);
+  plan_get_segment_info(&info);
+  print_plan(sh, "segments", &info);
   return 0;
 }
 
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_plan,
+    SHELL_CMD_ARG(set, NULL, "Plan a stack at <um> <um>..., in order.",
+                  cmd_plan_set, 3, SHELL_OPT_ARG_MAX),
+    SHELL_CMD_ARG(segments, NULL,
+                  "Plan segments from <start> to <end>/<step> or "
+                  "<end>x<frames>..., in um.",
+                  cmd_plan_segments, 2, SHELL_OPT_ARG_RAW),
+    SHELL_CMD(show, NULL, "Show the plans with their frames and eta.",
+              cmd_plan_show),
+    SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(plan, &sub_plan, "stack plans", NULL);
+
 #ifdef CONFIG_REBOOT
 static int cmd_system_reboot(const struct shell *sh, size_t argc, char **argv) {
   ARG_UNUSED(sh);
@@ -255,12 +352,11 @@ static int cmd_system_reboot(const struct shell *sh, size_t argc, char **argv) {
 }
 #endif
 
-SHELL_STATIC_SUBCMD_SET_CREATE(
-    sub_cam, SHELL_CMD(shoot, NULL, "Trigger camera shoot.", cmd_cam_shoot),
-    SHELL_CMD(record, NULL, "Toggle camera recording.", cmd_cam_record),
-    SHELL_CMD(scan, NULL, "Scan for camera", cmd_cam_startScan),
-    SHELL_CMD(stopScan, NULL, "Stop scan for camera", cmd_cam_stopScan),
-    SHELL_SUBCMD_SET_END);
+static void get_cam_entry(size_t idx, struct shell_static_entry *entry) {
+  get_table_entry("cam", cmd_cam_table, NULL, 0, idx, entry);
+}
+
+SHELL_DYNAMIC_CMD_CREATE(sub_cam, get_cam_entry);
 SHELL_CMD_REGISTER(cam, &sub_cam, "cam commands", NULL);
 SHELL_CMD_REGISTER(c, &sub_cam, "cam commands", NULL);
 #ifdef CONFIG_REBOOT
@@ -9,5 +9,11 @@
 #include <zephyr/sys/reboot.h>
 #endif
 #include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
 
-#include "StateMachine.h"
\ No newline at end of file
+#include <stepper_with_target/simple_stepper.h>
+
+#include "StateMachine.h"
+#include "commands.h"
+#include "plan.h"
+#include "scripts.h"
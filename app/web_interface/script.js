@@ -1,12 +1,40 @@
 const SERVICE_UUID = '12345634-5678-1234-1234-123456789abc';
 const STATUS_UUID = '12345636-5678-1234-1234-123456789abc';
 const COMMAND_UUID = '12345635-5678-1234-1234-123456789abc';
+const STATE_UUID = '12345637-5678-1234-1234-123456789abc';
+const STATE_VERSION = 1;
+// Fields of the binary state frame in frame order, bit n of the mask is
+// field n: [name, byte size, signed]
+const STATE_FIELDS = [
+  [ 'position_nm', 4, true ], [ 'target_nm', 4, true ],
+  [ 'lower_nm', 4, true ], [ 'upper_nm', 4, true ],
+  [ 'stack_index', 2, true ], [ 'stack_length', 2, false ],
+  [ 'wait_before_ms', 2, false ], [ 'wait_after_ms', 2, false ],
+  [ 'flags', 1, false ]
+];
+const TELEMETRY_UUID = '12345638-5678-1234-1234-123456789abc';
+const TELEMETRY_VERSION = 1;
+const STATE_STACK_RUNNING = 1 << 0;
+const STATE_MOVING = 1 << 1;
+const STATE_CAM_CONNECTED = 1 << 2;
+const PLAN_UUID = '12345639-5678-1234-1234-123456789abc';
+const PLAN_BEGIN = 1;
+const PLAN_DATA = 2;
+const PLAN_COMMIT = 3;
+// Positions per data frame, 4 + 4 * 127 bytes are one long write
+const PLAN_CHUNK = 127;
 const STORAGE_PREFIX = 'zephyrRail.';
 const DEMO_MODE = window.location.hash.toLowerCase() === '#demo';
 const PERSISTED_FIELDS = [ 'go-distance', 'wait-before', 'wait-after' ];
 const textDecoder = new TextDecoder();
 
-let device, server, service, commandChar, statusChar;
+let device, server, service, commandChar, statusChar, stateChar, telemetryChar;
+let planChar;
+// Last telemetry sample, extrapolated between samples while moving
+let telemetry = null;
+let telemetryAnimation = null;
+// Raw fields of the last binary state frame, deltas are applied to it
+let binaryState = null;
 let connectionIndicatorEl, connectionLabelEl;
 let pwaConnected = false;
 let camConnected = false;
@@ -62,6 +90,7 @@ document.addEventListener('DOMContentLoaded', function() {
   railStateEls = {
     card : document.getElementById('rail-state-card'),
     updated : document.getElementById('rail-state-updated'),
+    position : document.getElementById('rail-position-value'),
     target : document.getElementById('rail-target-value'),
     lower : document.getElementById('rail-lower-value'),
     upper : document.getElementById('rail-upper-value'),
@@ -160,6 +189,37 @@ document.addEventListener('DOMContentLoaded', function() {
           statusChar.addEventListener('characteristicvaluechanged',
                                       handleStatusNotification);
 
+          // Binary state frames, older firmware sends JSON on the status
+          try {
+            stateChar = await service.getCharacteristic(STATE_UUID);
+            await stateChar.startNotifications();
+            stateChar.addEventListener('characteristicvaluechanged',
+                                       handleStateNotification);
+            applyStateFrame(await stateChar.readValue());
+          } catch (error) {
+            console.log('No binary state characteristic:', error);
+            stateChar = null;
+          }
+
+          // Positions streamed while moving
+          try {
+            telemetryChar = await service.getCharacteristic(TELEMETRY_UUID);
+            await telemetryChar.startNotifications();
+            telemetryChar.addEventListener('characteristicvaluechanged',
+                                           handleTelemetryNotification);
+          } catch (error) {
+            console.log('No telemetry characteristic:', error);
+            telemetryChar = null;
+          }
+
+          // Stack plans uploaded as position lists
+          try {
+            planChar = await service.getCharacteristic(PLAN_UUID);
+          } catch (error) {
+            console.log('No plan characteristic:', error);
+            planChar = null;
+          }
+
           // Handle disconnection
           device.addEventListener('gattserverdisconnected',
                                   handleDisconnection);
@@ -210,29 +270,140 @@ document.addEventListener('DOMContentLoaded', function() {
 function handleStatusNotification(event) {
   const value = textDecoder.decode(event.target.value);
   const timestamp = new Date();
+  if (handleCommandProgress(value)) {
+    return;
+  }
+  handlePlanResponse(value);
   const parsedState = parseRailStateMessage(value);
 
   if (parsedState) {
-    const isStackRunning = parsedState.stack_running === true;
-    let stackStart = railState.stack_start;
-    if (isStackRunning) {
-      if (!railState.stack_running || !railState.stack_start) {
-        stackStart = timestamp;
-      }
+    applyRailState(parsedState, timestamp);
+  }
+
+  updateStatus(`[${timestamp.toLocaleTimeString()}] ${value}`, 'connected');
+}
+
+function handleStateNotification(event) {
+  applyStateFrame(event.target.value);
+}
+
+// Decode a binary state frame, see struct pwa_state in pwa_service.h
+function decodeStateFrame(view) {
+  if (view.byteLength < 4 || view.getUint8(0) !== STATE_VERSION) {
+    console.warn('Unsupported state frame', view);
+    return null;
+  }
+  const mask = view.getUint16(2, true);
+  const fields = Object.assign({}, binaryState);
+  let offset = 4;
+  for (let i = 0; i < STATE_FIELDS.length; i++) {
+    if (!(mask & (1 << i))) {
+      continue;
+    }
+    const [name, size, signed] = STATE_FIELDS[i];
+    if (offset + size > view.byteLength) {
+      console.warn('Truncated state frame', view);
+      return null;
+    }
+    if (size === 4) {
+      fields[name] =
+          signed ? view.getInt32(offset, true) : view.getUint32(offset, true);
+    } else if (size === 2) {
+      fields[name] =
+          signed ? view.getInt16(offset, true) : view.getUint16(offset, true);
     } else {
-      stackStart = null;
+      fields[name] = view.getUint8(offset);
     }
-    railState =
-        Object.assign({}, railState, parsedState,
-                      {last_update : timestamp, stack_start : stackStart});
-    camConnected =
-        parsedState.cam_connected === true || parsedState.cam_connected === 1;
-    updateConnectionStatus();
-    renderRailState();
-    updateStopButton();
+    offset += size;
+  }
+  // A delta needs a full frame to apply to
+  if (!binaryState && mask !== (1 << STATE_FIELDS.length) - 1) {
+    return null;
   }
+  binaryState = fields;
+  return fields;
+}
 
-  updateStatus(`[${timestamp.toLocaleTimeString()}] ${value}`, 'connected');
+function applyStateFrame(view) {
+  const fields = decodeStateFrame(view);
+  if (!fields) {
+    return;
+  }
+  const flags = fields.flags;
+  applyRailState(normalizeRailState({
+                   position_nm : fields.position_nm,
+                   target_nm : fields.target_nm,
+                   lower_nm : fields.lower_nm,
+                   upper_nm : fields.upper_nm,
+                   stack_index : fields.stack_index,
+                   stack_length : fields.stack_length,
+                   stack_running : (flags & STATE_STACK_RUNNING) !== 0,
+                   wait_before_ms : fields.wait_before_ms,
+                   wait_after_ms : fields.wait_after_ms,
+                   moving : (flags & STATE_MOVING) !== 0,
+                   cam_connected : (flags & STATE_CAM_CONNECTED) !== 0
+                 }),
+                 new Date());
+}
+
+function applyRailState(parsedState, timestamp) {
+  const isStackRunning = parsedState.stack_running === true;
+  let stackStart = railState.stack_start;
+  if (isStackRunning) {
+    if (!railState.stack_running || !railState.stack_start) {
+      stackStart = timestamp;
+    }
+  } else {
+    stackStart = null;
+  }
+  railState =
+      Object.assign({}, railState, parsedState,
+                    {last_update : timestamp, stack_start : stackStart});
+  camConnected =
+      parsedState.cam_connected === true || parsedState.cam_connected === 1;
+  updateConnectionStatus();
+  renderRailState();
+  updateStopButton();
+}
+
+// {version, seq, time_ms, position_nm, target_nm, velocity_nm_per_s}
+function handleTelemetryNotification(event) {
+  const view = event.target.value;
+  if (view.byteLength < 18 || view.getUint8(0) !== TELEMETRY_VERSION) {
+    return;
+  }
+  telemetry = {
+    received : performance.now(),
+    position_nm : view.getInt32(6, true),
+    target_nm : view.getInt32(10, true),
+    velocity : view.getInt32(14, true)
+  };
+  railState.position_nm = telemetry.position_nm;
+  railState.target_nm = telemetry.target_nm;
+  if (!telemetryAnimation) {
+    telemetryAnimation = requestAnimationFrame(renderTelemetry);
+  }
+}
+
+// Position between samples, never past the target
+function extrapolatedPosition(now) {
+  const {position_nm, target_nm, velocity, received} = telemetry;
+  const position = position_nm + velocity * (now - received) / 1000;
+  return velocity >= 0 ? Math.min(position, Math.max(position_nm, target_nm))
+                       : Math.max(position, Math.min(position_nm, target_nm));
+}
+
+function renderTelemetry(now) {
+  telemetryAnimation = null;
+  if (!telemetry || !railStateEls.position) {
+    return;
+  }
+  railStateEls.position.textContent =
+      formatMicrons(Math.round(extrapolatedPosition(now)));
+  railStateEls.target.textContent = formatMicrons(telemetry.target_nm);
+  if (telemetry.velocity !== 0) {
+    telemetryAnimation = requestAnimationFrame(renderTelemetry);
+  }
 }
 
 function handleDisconnection() {
@@ -243,6 +414,7 @@ function handleDisconnection() {
   toggleControls(false);
   resetRailState();
   updateStopButton();
+  failTrackedCommands('disconnected');
 
   // Reset variables
   device = null;
@@ -250,6 +422,11 @@ function handleDisconnection() {
   service = null;
   commandChar = null;
   statusChar = null;
+  stateChar = null;
+  binaryState = null;
+  telemetryChar = null;
+  telemetry = null;
+  planChar = null;
 }
 
 function handleError(error) {
@@ -284,20 +461,77 @@ async function sendCommand(cmd) {
   }
 }
 
+// Commands sent with a sequence number, answered by "SEQ:<seq>:<stage>"
+let nextSeq = 1;
+const trackedCommands = new Map();
+
+// Resolves with the error code once the firmware completed the command, a
+// move once the rail stopped and a stack once it ended
+function sendTracked(cmd) {
+  const seq = nextSeq;
+  nextSeq = nextSeq >= 65535 ? 1 : nextSeq + 1;
+  if (DEMO_MODE || !commandChar) {
+    return sendCommand(cmd).then(() => 0);
+  }
+  return new Promise((resolve, reject) => {
+    trackedCommands.set(seq, {cmd, resolve, reject});
+    sendCommand('@' + seq + ' ' + cmd);
+  });
+}
+
+function handleCommandProgress(value) {
+  const match = /^SEQ:(\d+):([A-Z]+)(?::(.*))?$/.exec(value);
+  if (!match) {
+    return false;
+  }
+  const seq = Number(match[1]);
+  const entry = trackedCommands.get(seq);
+  if (!entry) {
+    return true;
+  }
+  if (match[2] === 'REJECTED') {
+    trackedCommands.delete(seq);
+    entry.reject(new Error(entry.cmd + ': ' + match[3]));
+  } else if (match[2] === 'COMPLETED') {
+    trackedCommands.delete(seq);
+    entry.resolve(Number(match[3]));
+  }
+  return true;
+}
+
+function failTrackedCommands(reason) {
+  for (const entry of trackedCommands.values()) {
+    entry.reject(new Error(entry.cmd + ': ' + reason));
+  }
+  trackedCommands.clear();
+}
+
 function requestRailStatus() { sendCommand('rail status'); }
 
+// Moves refresh the status once the rail stopped instead of polling
+function sendMove(cmd) {
+  sendTracked(cmd)
+      .then((err) => {
+        if (err !== 0) {
+          updateStatus(cmd + ' ended with ' + err, 'connected');
+        }
+        requestRailStatus();
+      })
+      .catch((error) => updateStatus(error.message, 'connected'));
+}
+
 // Helper functions for commands with parameters
 function sendGo(times) {
   const distance = readNumber('go-distance');
   const distanceNm = Math.round(distance * times * 1000);
-  sendCommand('rail go_nm ' + distanceNm);
+  sendMove('rail go_nm ' + distanceNm);
 }
 
-function sendGoPct(pct) { sendCommand('rail go_pct ' + pct); }
+function sendGoPct(pct) { sendMove('rail go_pct ' + pct); }
 
 function sendGoTo() {
   const position = readNumber('goto-position');
-  sendCommand('rail go_to ' + Math.round(position));
+  sendMove('rail go_to ' + Math.round(position));
 }
 
 function sendSetLowerBound() {
@@ -320,11 +554,13 @@ function sendSetWaitAfter() {
   return sendCommand('rail wait_after ' + Math.round(value));
 }
 
-async function sendWaitSettings() {
-  await sendSetWaitBefore();
-  await new Promise((resolve) => setTimeout(resolve, 300));
-  await sendSetWaitAfter();
-  await new Promise((resolve) => setTimeout(resolve, 300));
+function waitSettingsCommands() {
+  const before = Math.max(0, readNumber('wait-before'));
+  const after = Math.max(0, readNumber('wait-after'));
+  return [
+    'rail wait_before ' + Math.round(before),
+    'rail wait_after ' + Math.round(after),
+  ];
 }
 
 function sendSetSpeedPreset(preset) {
@@ -339,21 +575,106 @@ function sendSetSpeedRpm() {
   sendCommand('rail set_rpm ' + rpm);
 }
 
+// The wait settings and the start go out as one batch, one write and one ACK
 async function sendStartStack(expected_step_size_nm) {
-  await sendWaitSettings();
   const stepSize =
       expected_step_size_nm !== undefined ? expected_step_size_nm : 1000;
-  await sendCommand('rail stack_nm ' + Math.round(stepSize));
+  const start = 'rail stack_nm ' + Math.round(stepSize);
+  await sendCommand([...waitSettingsCommands(), start ].join('\n'));
 }
 
 async function sendStartStackCount(length) {
   const stackLength = length !== undefined ? length : 100;
-  await sendWaitSettings();
-  await sendCommand('rail stack_count ' + Math.round(stackLength));
+  const start = 'rail stack_count ' + Math.round(stackLength);
+  await sendCommand([...waitSettingsCommands(), start ].join('\n'));
 }
 
 function sendStopStack() { sendCommand('rail stop'); }
 
+// Frames of the plan characteristic, see PWA_PLAN_* in pwa_service.h. The
+// firmware answers "ACK:plan <count>" or "ERR:PLAN_<REASON>" on the status.
+async function uploadPlan(positionsNm) {
+  const begin = new DataView(new ArrayBuffer(3));
+  begin.setUint8(0, PLAN_BEGIN);
+  begin.setUint16(1, positionsNm.length, true);
+  await planChar.writeValueWithResponse(begin.buffer);
+  for (let index = 0; index < positionsNm.length; index += PLAN_CHUNK) {
+    const chunk = positionsNm.slice(index, index + PLAN_CHUNK);
+    const frame = new DataView(new ArrayBuffer(4 + 4 * chunk.length));
+    frame.setUint8(0, PLAN_DATA);
+    frame.setUint16(1, index, true);
+    frame.setUint8(3, chunk.length);
+    chunk.forEach((nm, i) => frame.setInt32(4 + 4 * i, nm, true));
+    await planChar.writeValueWithResponse(frame.buffer);
+  }
+  await planChar.writeValueWithResponse(new Uint8Array([ PLAN_COMMIT ]));
+}
+
+// Positions in µm, separated by commas or blanks
+async function sendPlan() {
+  const input = document.getElementById('plan-positions');
+  const values = (input ? input.value : '').split(/[\s,;]+/).filter(Boolean);
+  const positionsNm = values.map((value) => Math.round(Number(value) * 1000));
+  if (positionsNm.length < 2 ||
+      positionsNm.some((nm) => !Number.isFinite(nm))) {
+    alert('Enter at least two positions in µm.');
+    return;
+  }
+  updateStatus('$ plan of ' + positionsNm.length + ' positions');
+  if (DEMO_MODE) {
+    return;
+  }
+  if (!planChar) {
+    alert('This firmware cannot take plans.');
+    return;
+  }
+  try {
+    await uploadPlan(positionsNm);
+  } catch (error) {
+    console.error('Plan upload failed:', error);
+    updateStatus('Failed to upload plan: ' + error.message, 'connected');
+  }
+}
+
+async function sendStartPlanStack() {
+  const start = 'rail stack_plan';
+  await sendCommand([...waitSettingsCommands(), start ].join('\n'));
+}
+
+// "0 100/5 150/1 400x10": start, then per segment its end with "/" and the
+// step size or "x" and the frames, all in µm. The waits go first so that the
+// firmware estimates with them, plans are not part of batches.
+async function sendSegmentPlan() {
+  const input = document.getElementById('segment-plan');
+  const plan = (input ? input.value : '').trim().replace(/\s+/g, ' ');
+  if (!plan.length) {
+    alert('Enter a start and segments like "0 100/5 400x10".');
+    return;
+  }
+  await sendCommand(waitSettingsCommands().join('\n'));
+  await sendCommand('plan segments ' + plan);
+}
+
+async function sendStartSegmentStack() {
+  const start = 'rail stack_segments';
+  await sendCommand([...waitSettingsCommands(), start ].join('\n'));
+}
+
+function formatEta(ms) {
+  const seconds = Math.ceil(ms / 1000);
+  return Math.floor(seconds / 60) + ':' + String(seconds % 60).padStart(2, '0');
+}
+
+// "ACK:plan segments <frames> <eta_ms>" or "ACK:plan <count>"
+function handlePlanResponse(value) {
+  const hint = document.getElementById('segment-plan-estimate');
+  const match = /^ACK:plan segments (\d+) (\d+)$/.exec(value);
+  if (hint && match) {
+    hint.textContent =
+        match[1] + ' frames, ETA ' + formatEta(Number(match[2]));
+  }
+}
+
 function parseStackValue(rawValue) {
   const value = (rawValue || '').toString().trim();
   if (!value.length) {
@@ -518,6 +839,9 @@ function renderRailState() {
     return;
   }
 
+  if (railStateEls.position) {
+    railStateEls.position.textContent = formatMicrons(railState.position_nm);
+  }
   railStateEls.target.textContent = formatMicrons(railState.target_nm);
   railStateEls.lower.textContent = formatMicrons(railState.lower_nm);
   railStateEls.upper.textContent = formatMicrons(railState.upper_nm);
@@ -591,51 +915,54 @@ function parseRailStateMessage(message) {
     return null;
   }
   try {
-    const data = JSON.parse(message.slice(jsonStart));
-    const numberOrNull = (value) => {
-      const parsed = Number(value);
-      return Number.isFinite(parsed) ? parsed : null;
-    };
-
-    const stackIndex = numberOrNull(data.stack_index);
-    const stackLengthValue = data.stack_length;
-    const stackLength = numberOrNull(stackLengthValue);
-    const normalizedStackIndex =
-        stackIndex !== null && stackIndex >= 0 ? stackIndex : null;
-    const normalizedStackLength =
-        stackLength !== null && stackLength > 0 ? stackLength : null;
-    const isStacking = data.stack_running === true || data.stack_running === 1;
-    const stackProgress =
-        calculateStackProgress(normalizedStackIndex, normalizedStackLength);
-    updateStateCardProgress(stackProgress, isStacking);
-
-    const camConnected =
-        data.cam_connected === true || data.cam_connected === 1;
-
-    const isStackComplete = normalizedStackIndex !== null &&
-                            normalizedStackLength !== null &&
-                            normalizedStackIndex >= normalizedStackLength - 1;
-    const finalStackRunning = isStackComplete ? false : isStacking;
-
-    return {
-      position_nm : numberOrNull(data.position_nm),
-      target_nm : numberOrNull(data.target_nm),
-      lower_nm : numberOrNull(data.lower_nm),
-      upper_nm : numberOrNull(data.upper_nm),
-      stack_index : normalizedStackIndex,
-      stack_length : normalizedStackLength,
-      stack_running : finalStackRunning,
-      wait_before_ms : numberOrNull(data.wait_before_ms),
-      wait_after_ms : numberOrNull(data.wait_after_ms),
-      moving : data.moving === true || data.moving === 1,
-      cam_connected : camConnected
-    };
+    return normalizeRailState(JSON.parse(message.slice(jsonStart)));
   } catch (err) {
     console.warn('Failed to parse rail state payload', message, err);
     return null;
   }
 }
 
+function normalizeRailState(data) {
+  const numberOrNull = (value) => {
+    const parsed = Number(value);
+    return Number.isFinite(parsed) ? parsed : null;
+  };
+
+  const stackIndex = numberOrNull(data.stack_index);
+  const stackLengthValue = data.stack_length;
+  const stackLength = numberOrNull(stackLengthValue);
+  const normalizedStackIndex =
+      stackIndex !== null && stackIndex >= 0 ? stackIndex : null;
+  const normalizedStackLength =
+      stackLength !== null && stackLength > 0 ? stackLength : null;
+  const isStacking = data.stack_running === true || data.stack_running === 1;
+  const stackProgress =
+      calculateStackProgress(normalizedStackIndex, normalizedStackLength);
+  updateStateCardProgress(stackProgress, isStacking);
+
+  const camConnected =
+      data.cam_connected === true || data.cam_connected === 1;
+
+  const isStackComplete = normalizedStackIndex !== null &&
+                          normalizedStackLength !== null &&
+                          normalizedStackIndex >= normalizedStackLength - 1;
+  const finalStackRunning = isStackComplete ? false : isStacking;
+
+  return {
+    position_nm : numberOrNull(data.position_nm),
+    target_nm : numberOrNull(data.target_nm),
+    lower_nm : numberOrNull(data.lower_nm),
+    upper_nm : numberOrNull(data.upper_nm),
+    stack_index : normalizedStackIndex,
+    stack_length : normalizedStackLength,
+    stack_running : finalStackRunning,
+    wait_before_ms : numberOrNull(data.wait_before_ms),
+    wait_after_ms : numberOrNull(data.wait_after_ms),
+    moving : data.moving === true || data.moving === 1,
+    cam_connected : camConnected
+  };
+}
+
 function setConnectionState(state, labelText) {
   if (connectionIndicatorEl) {
     connectionIndicatorEl.classList.remove('connected', 'connecting',
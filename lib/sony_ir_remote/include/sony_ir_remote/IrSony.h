@@ -13,39 +13,57 @@
 
 #include <zephyr/logging/log.h>
 
-#include "../GPIOs.h"
-
-// #define PWM_IR_NODE DT_ALIAS(pwmir)
-// #define PWM_IR_CTLR DT_PWMS_CTLR(PWM_IR_NODE)
-// #define PWM_IR_CHANNEL DT_PWMS_CHANNEL(PWM_IR_NODE)
-// #define PWM_IR_FLAGS DT_PWMS_FLAGS(PWM_IR_NODE)
-
-#define MIN_PERIOD_USEC (USEC_PER_SEC / 64U)
-#define MAX_PERIOD_USEC USEC_PER_SEC
-
 // 40kHz
 #define PERIOD_USEC (USEC_PER_SEC / 40000U)
 // pulses with approx 25% mark/space ratio
 #define PULSE_USEC (PERIOD_USEC / 4)
 
+/* Called from the timer ISR, must not block */
+typedef void (*ir_sony_done_cb_t)(int err, void *user_data);
+
+/**
+ * @brief Sony SIRC remote on a PWM driven IR LED.
+ *
+ * The waveform is sequenced from a k_timer: every expiry switches the
+ * carrier and arms the timer for the next mark or space, so sending returns
+ * right away and the CPU is free in between.
+ */
 class IrSony {
 
 #if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
-  const struct pwm_dt_spec pwmir_spec = PWM_DT_SPEC_GET(DT_CHOSEN(rail_pwmir));
-  uint32_t max_period = MAX_PERIOD_USEC;
-
-  int start_carrier();
-  int stop_carrier();
-  int send_pulse(int duration);
-  int send_start();
-  int send_bit(bool is_one);
-  int send_code(unsigned long code);
-  int send_command(unsigned long command);
+  const struct pwm_dt_spec pwmir_spec =
+      PWM_DT_SPEC_GET(DT_NODELABEL(rail_pwmir));
+
+  struct k_timer timer;
+  unsigned long code = 0;
+  int repeat = 0;  // frames sent of the current command
+  int element = 0; // 0 start mark, odd spaces, even > 0 bit marks
+  volatile bool busy = false;
+  ir_sony_done_cb_t done = nullptr;
+  void *done_user_data = nullptr;
+
+  int set_carrier(bool on);
+  void next_element();
+  static void timer_handler(struct k_timer *timer);
 #endif // if exists
 
 public:
   IrSony();
-  void shoot();
+
+  bool ready() const;
+  bool is_busy() const;
+
+  /**
+   * @brief Start sending @p command, repeated as Sony remotes do.
+   *
+   * @param done called once the first complete frame is out, which is when
+   *        the camera acts on it
+   * @return 0 on success, -EBUSY while a command is being sent, -ENODEV
+   *         without IR LED
+   */
+  int send_command(unsigned long command, ir_sony_done_cb_t done = nullptr,
+                   void *user_data = nullptr);
+  int shoot(ir_sony_done_cb_t done = nullptr, void *user_data = nullptr);
 };
 
 #endif // IRSONY_H_
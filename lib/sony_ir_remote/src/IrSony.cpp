@@ -1,4 +1,4 @@
-#include "IrSony.h"
+#include "sony_ir_remote/IrSony.h"
 
 /*
    contains parts from:
@@ -16,98 +16,79 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(irsony);
 
-#if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
-
 // Remote control
 const unsigned long shutter_code = 0x2D;
 const unsigned long two_secs_code = 0x37;
 const unsigned long video_code = 0x48;
 
+#if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
+
+const unsigned long address = 0x1E3A;
+const int BITS = 20;
+const int REPEATS = 6;
+
 const int BASE = 635;
 const int ZERO_DURATION = BASE;
 const int ONE_DURATION = BASE * 2;
 const int START_DURATION = BASE * 4;
+const int FRAME_GAP = 11000;
 
-int IrSony::start_carrier() {
-  int ret = pwm_set_dt(&pwmir_spec, PERIOD_USEC, PULSE_USEC);
-  if (ret < 0) {
-    LOG_ERR("failed to start carrier");
-  }
-  return ret;
-}
-int IrSony::stop_carrier() {
-  int ret = pwm_set_dt(&pwmir_spec, PERIOD_USEC, 0);
-  if (ret < 0) {
-    LOG_ERR("failed to stop carrier");
-  }
-  return ret;
-}
+// start mark and its space, then mark and space per bit
+const int ELEMENTS = 2 + 2 * BITS;
 
-int IrSony::send_pulse(int duration) {
-  int ret = 0;
-  ret = start_carrier();
-  if (ret < 0) {
-    return ret;
-  }
-  k_busy_wait(duration);
-  ret = stop_carrier();
+int IrSony::set_carrier(bool on) {
+  int ret = pwm_set_dt(&pwmir_spec, PERIOD_USEC, on ? PULSE_USEC : 0);
   if (ret < 0) {
-    return ret;
+    LOG_ERR("failed to %s carrier", on ? "start" : "stop");
   }
-  k_busy_wait(BASE);
   return ret;
 }
 
-int IrSony::send_start() {
-  LOG_MODULE_DECLARE(irsony);
-  return send_pulse(START_DURATION);
-}
-int IrSony::send_bit(bool is_one) {
-  LOG_MODULE_DECLARE(irsony);
-  int ret = 0;
-  if (is_one) {
-    ret = send_pulse(ONE_DURATION);
-    if (ret < 0) {
-      return ret;
-    }
+// Switch the carrier for the current element and arm the timer for its end
+void IrSony::next_element() {
+  int duration;
+
+  if (element == 0) {
+    duration = START_DURATION;
+  } else if (element % 2 == 0) {
+    const int bit = element / 2 - 1;
+    duration = (code & (1UL << bit)) ? ONE_DURATION : ZERO_DURATION;
   } else {
-    ret = send_pulse(ZERO_DURATION);
-    if (ret < 0) {
-      return ret;
-    }
+    duration = element == ELEMENTS - 1 ? BASE + FRAME_GAP : BASE;
   }
-  return ret;
-}
-int IrSony::send_code(unsigned long code) {
-  int ret = 0;
-  ret = send_start();
-  if (ret < 0) {
-    return ret;
-  }
-  // Send 20 bits
-  for (int bit = 0; bit < 20; bit++) {
-    ret = send_bit(code & ((unsigned long)1 << bit));
-    if (ret < 0) {
-      return ret;
+
+  if (set_carrier(element % 2 == 0) < 0) {
+    set_carrier(false);
+    busy = false;
+    if (done) {
+      done(-EIO, done_user_data);
+      done = nullptr;
     }
+    return;
   }
-  return ret;
+  k_timer_start(&timer, K_USEC(duration), K_NO_WAIT);
 }
-int IrSony::send_command(unsigned long command) {
-  int ret = 0;
-  unsigned long address = 0x1E3A;
-  LOG_MODULE_DECLARE(irsony);
-  unsigned long code = (unsigned long)address << 7 | command;
-  LOG_INF("send command=0x%08lu code=0x%08lu", command, code);
 
-  for (int i = 0; i < 6; i++) {
-    ret = send_code(code);
-    if (ret < 0) {
-      return ret;
-    }
-    k_busy_wait(11000);
+void IrSony::timer_handler(struct k_timer *timer) {
+  IrSony *ir = (IrSony *)k_timer_user_data_get(timer);
+
+  ir->element++;
+  if (ir->element < ELEMENTS) {
+    ir->next_element();
+    return;
   }
-  return ret;
+
+  ir->repeat++;
+  if (ir->repeat == 1 && ir->done) {
+    ir->done(0, ir->done_user_data);
+    ir->done = nullptr;
+  }
+  if (ir->repeat < REPEATS) {
+    ir->element = 0;
+    ir->next_element();
+    return;
+  }
+  ir->busy = false;
 }
 
 #endif // if exists
@@ -116,25 +97,63 @@ IrSony::IrSony() {
   LOG_MODULE_DECLARE(irsony);
 #if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
   int ret;
+  k_timer_init(&timer, timer_handler, nullptr);
+  k_timer_user_data_set(&timer, this);
   if (!pwm_is_ready_dt(&pwmir_spec)) {
     LOG_ERR("Error: PWM device %s is not ready\n", pwmir_spec.dev->name);
     return;
   }
-  ret = pwm_set_dt(&pwmir_spec, PERIOD_USEC, 0);
-  // pwm_pin_set_usec(pwm, PWM_IR_CHANNEL, PERIOD_USEC, 0, PWM_IR_FLAGS)
+  ret = set_carrier(false);
   if (ret < 0) {
-    LOG_ERR("failed to stop carrier");
     return;
   }
 #endif // if exists
 }
 
-void IrSony::shoot() {
-  LOG_MODULE_DECLARE(irsony);
+bool IrSony::ready() const {
+#if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
+  return pwm_is_ready_dt(&pwmir_spec);
+#else
+  return false;
+#endif // if exists
+}
+
+bool IrSony::is_busy() const {
 #if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
-  int ret = send_command(shutter_code);
+  return busy;
+#else
+  return false;
+#endif // if exists
+}
+
+int IrSony::send_command(unsigned long command, ir_sony_done_cb_t _done,
+                         void *user_data) {
+#if DT_NODE_EXISTS(DT_NODELABEL(rail_pwmir))
+  if (!ready()) {
+    return -ENODEV;
+  }
+  if (busy) {
+    return -EBUSY;
+  }
+  code = address << 7 | command;
+  LOG_DBG("send command=0x%02lx code=0x%05lx", command, code);
+
+  busy = true;
+  done = _done;
+  done_user_data = user_data;
+  repeat = 0;
+  element = 0;
+  next_element();
+  return 0;
+#else
+  return -ENODEV;
+#endif // if exists
+}
+
+int IrSony::shoot(ir_sony_done_cb_t done, void *user_data) {
+  int ret = send_command(shutter_code, done, user_data);
   if (ret < 0) {
     LOG_ERR("failed to send shoot");
   }
-#endif // if exists
-}
\ No newline at end of file
+  return ret;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// How shoot() presses the buttons for one frame
+enum class CaptureProfile {
+  FULL_AF,         // half press, full press, release both: 4 writes per frame
+  SHUTTER_ONLY,    // full press and release: 2 writes per frame, for MF
+  HALF_PRESS_HELD, // half press held over a series, 2 writes per frame
+};
+
+static inline const char *capture_profile_name(CaptureProfile profile) {
+  switch (profile) {
+  case CaptureProfile::FULL_AF:
+    return "full_af";
+  case CaptureProfile::SHUTTER_ONLY:
+    return "shutter_only";
+  case CaptureProfile::HALF_PRESS_HELD:
+    return "half_press_held";
+  }
+  return "unknown";
+}
@@ -6,6 +6,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zephyr/kernel.h>
+
+#include "sony_remote/capture_profile.h"
+
+// Called once a queued command was written, err is 0 or a negative error code
+typedef void (*sony_remote_done_cb_t)(int err, void *user_data);
 
 class SonyRemote {
 public:
@@ -13,6 +19,7 @@ public:
   SonyRemote(const char *target_address); // Constructor with specific BT
                                           // address (ignored)
 
+  void connect();   // no-op
   void startScan(); // no-op
   void stopScan();
   void end();         // no-op
@@ -35,8 +42,36 @@ public:
   void zoomWRelease();
 
   // high level functions:
-  void shoot();
+  int shoot(sony_remote_done_cb_t done = nullptr, void *user_data = nullptr);
+  uint32_t pendingCommands(); // 1 while the modelled writes are running
+  void setCaptureProfile(CaptureProfile profile);
+  CaptureProfile captureProfile() const;
+  int beginSeries();
+  int endSeries();
+  int setLowLatency(bool enable); // no-op
+
+  // Camera status, every shot completes once its writes are done
+  bool hasStatus() const;
+  bool focusAcquired() const;
+  bool shutterActive() const;
+  struct k_poll_signal *captureSignal();
+  int waitCaptureComplete(k_timeout_t timeout);
+
+  static void capture_work_handler(struct k_work *work);
 
 private:
+  static SonyRemote *self_;
+
   bool ready_ = true;
+  struct k_poll_signal capture_signal_;
+
+  // Models the BLE write timing of the real remote
+  CaptureProfile profile_ = CaptureProfile::FULL_AF;
+  bool half_press_held_ = false;
+  int64_t busy_until_ = 0; // uptime in ticks when the queued writes are done
+  struct k_work_delayable capture_work_;
+  sony_remote_done_cb_t done_ = nullptr;
+  void *done_user_data_ = nullptr;
+
+  int64_t queue_writes(unsigned int writes);
 };
@@ -10,11 +10,27 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#include "sony_remote/capture_profile.h"
+
+// Called once a queued command was written, err is 0 or a negative error code.
+// Runs in the Bluetooth stack or the remote's work queue, must not block.
+typedef void (*sony_remote_done_cb_t)(int err, void *user_data);
+
+class SonyRemoteGroup;
+
 class SonyRemote {
 public:
+  // Cameras connected at the same time, each needs its own connection
+  static constexpr size_t MAX_CAMERAS = 4;
+
   SonyRemote();
   SonyRemote(
       const char *target_address); // Constructor with specific BT address
+  // Remotes in order of construction, nullptr past the last one
+  static SonyRemote *get(size_t index);
+  static size_t count();
+
+  void connect();                  // bonded camera directly, else scan
   void startScan();                // start scanning for the camera
   void stopScan();                 // stop scanning for the camera
   void end();                      // disconnect and cleanup
@@ -23,7 +39,8 @@ public:
   char *state();
   void log_state();
 
-  // Common actions (write to 0xFF01)
+  // Common actions (write to 0xFF01). Commands are queued and written one at
+  // a time from the remote's own work queue, none of them blocks.
   void focusDown();
   void focusUp();
   void shutterDown();
@@ -37,7 +54,32 @@ public:
   void zoomWRelease();
 
   // high level functions:
-  void shoot();
+  // Queue a full press of the shutter. @p done is called once the shutter
+  // release was written. Returns -ENOTCONN if not ready, -ENOBUFS if the
+  // queue is full.
+  int shoot(sony_remote_done_cb_t done = nullptr, void *user_data = nullptr);
+  // Button sequence used by shoot(), FULL_AF by default
+  void setCaptureProfile(CaptureProfile profile);
+  CaptureProfile captureProfile() const;
+  // Bracket a series of shots, holds the half press for HALF_PRESS_HELD.
+  // Without a series HALF_PRESS_HELD shoots like FULL_AF.
+  int beginSeries();
+  int endSeries();
+
+  // Shortest connection interval the camera accepts while stacking, relaxed
+  // to the initial one otherwise. Kept across reconnects.
+  int setLowLatency(bool enable);
+  // Commands queued or being written
+  uint32_t pendingCommands();
+
+  // Camera status reported via 0xFF02 notifications
+  bool hasStatus() const;     // subscribed to FF02?
+  bool focusAcquired() const; // last focus report
+  bool shutterActive() const; // exposure in progress
+  // Raised once the camera reports the frame of the last shoot() as done
+  struct k_poll_signal *captureSignal();
+  // Block until the frame of the last shoot() is done, -EAGAIN on timeout
+  int waitCaptureComplete(k_timeout_t timeout);
 
   // callbacks (public because they need to be accessed from C code)
   static void on_connected(struct bt_conn *conn, uint8_t err);
@@ -52,6 +94,15 @@ public:
                              struct bt_gatt_discover_params *params);
   static void on_scan(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
                       struct net_buf_simple *ad);
+  static void on_param_updated(struct bt_conn *conn, uint16_t interval,
+                               uint16_t latency, uint16_t timeout);
+  static void on_phy_updated(struct bt_conn *conn,
+                             struct bt_conn_le_phy_info *param);
+  static void on_subscribed(struct bt_conn *conn, uint8_t err,
+                            struct bt_gatt_subscribe_params *params);
+  static uint8_t on_notify(struct bt_conn *conn,
+                           struct bt_gatt_subscribe_params *params,
+                           const void *data, uint16_t length);
 
   // Security callbacks
   static void auth_cancel(struct bt_conn *conn);
@@ -63,23 +114,70 @@ public:
   // work handler for delayed discovery
   static void discovery_work_handler(struct k_work *work);
 
-  // write completion callback
+  // write completion callbacks
   static void on_write_complete(struct bt_conn *conn, uint8_t err,
                                 struct bt_gatt_write_params *params);
+  static void on_write_sent(struct bt_conn *conn, void *user_data);
+
+  // work handler writing the next queued command
+  static void cmd_work_handler(struct k_work *work);
 
 private:
-  // singleton-style bridge for C callbacks
-  static SonyRemote *self_;
+  friend class SonyRemoteGroup;
+
+  // bridge for C callbacks, looked up by connection or work item
+  static SonyRemote *instances_[MAX_CAMERAS];
+  static size_t num_instances_;
+  static SonyRemote *from_conn(const bt_conn *conn);
+  // Idle remote that takes the camera at @p addr, the one targeting it first
+  static SonyRemote *claim(const bt_addr_le_t *addr,
+                           net_buf_simple *ad = nullptr);
+  static bool in_use(const bt_addr_le_t *addr);
+  static void connect_idle();
+  static bool auto_connecting_; // waiting on the filter accept list
+
+  SonyRemoteGroup *group_ = nullptr; // group shooting together with this one
 
   bt_conn *conn_ = nullptr;
   uint16_t ff01_handle_ = 0;
   uint8_t ff01_properties_ = 0; // Store FF01 characteristic properties
 
+  uint16_t ff02_handle_ = 0;
+  uint16_t ff02_ccc_handle_ = 0; // 0 until subscribed or cached
+
   bt_gatt_discover_params disc_params_{};
-  bt_gatt_subscribe_params sub_params_{}; // reserved if you later use 0xFF02
+  bt_gatt_discover_params ccc_disc_params_{}; // CCC lookup for FF02
+  bt_gatt_subscribe_params sub_params_{};     // FF02 status notifications
   bt_gatt_write_params write_params_{};   // Parameters for write operations
   uint8_t write_buffer_[32]; // Buffer to store command data during write
 
+  // One command on FF01, followed by a gap that a status report can end early
+  struct command {
+    uint8_t data[3];
+    uint8_t len;
+    uint8_t wait_type;  // status report ending the gap, 0 for none
+    uint8_t wait_value; // value of that report
+    uint16_t gap_ms;    // pause before the next command
+    sony_remote_done_cb_t done;
+    void *user_data;
+    SonyRemoteGroup *group; // written together with the group's members
+  };
+  static constexpr size_t CMD_QUEUE_LEN = 16;
+  struct k_msgq cmd_q_;
+  alignas(4) char cmd_q_buf_[CMD_QUEUE_LEN * sizeof(command)];
+  k_work_delayable cmd_work_;
+  command current_{};            // command being written
+  bool write_in_flight_ = false; // only one write at a time
+  uint8_t waiting_type_ = 0;     // status report ending the current gap
+  uint8_t waiting_value_ = 0;
+
+  CaptureProfile profile_ = CaptureProfile::FULL_AF;
+  bool half_press_held_ = false;
+
+  // Link tuning and shutter latency
+  bool low_latency_ = false;
+  uint32_t shoot_start_cycles_ = 0;
+
   k_work_delayable discovery_work_;
 
   // Target camera address (if specified)
@@ -89,10 +187,122 @@ private:
   // Pairing status
   bool is_paired_ = false;
 
+  // Reconnect
+  int64_t link_lost_ms_ = 0;
+
+  // Status reported via FF02
+  bool focus_acquired_ = false;
+  bool shutter_active_ = false;
+  bool capture_pending_ = false;
+  struct k_poll_signal capture_signal_;
+
   // Discovery retry counter
   uint8_t discovery_retry_count_ = 0;
   static constexpr uint8_t MAX_DISCOVERY_RETRIES = 20;
 
   void start_discovery();
+  void tune_connection();
+  bool wants(const bt_addr_le_t *addr, net_buf_simple *ad) const;
+  bool bonded_camera(bt_addr_le_t *addr) const;
+  bool load_handles();
+  void store_handles();
+  void forget_handles();
+  void subscribe_status();
+  void handle_status(uint8_t type, uint8_t value);
+  bool status_reached(uint8_t type, uint8_t value) const;
+  void init_commands();
+  int queue_shoot(sony_remote_done_cb_t done, void *user_data,
+                  SonyRemoteGroup *group);
+  int queue_cmd(const uint8_t *buf, size_t len, uint8_t wait_type = 0,
+                uint8_t wait_value = 0, uint16_t gap_ms = 0,
+                sony_remote_done_cb_t done = nullptr,
+                void *user_data = nullptr, SonyRemoteGroup *group = nullptr);
   void send_cmd(const uint8_t *buf, size_t len);
-};
\ No newline at end of file
+  void send_next();
+  int write_cmd(const uint8_t *buf, size_t len);
+  void finish_cmd(int err);
+  void flush_commands(int err);
+};
+
+/**
+ * @brief Several cameras shot as one, e.g. for stereo stacks.
+ *
+ * Every member runs its half press on its own. The shutter writes are held
+ * back until all members are at that point and then issued back to back, so
+ * each one goes out in the next connection event of its link. With the same
+ * connection interval on all links (setLowLatency()) the remaining skew is
+ * the offset between the links' anchor points.
+ */
+class SonyRemoteGroup {
+public:
+  // Adds @p remote, -ENOMEM if full, -EALREADY if it is in a group
+  int add(SonyRemote *remote);
+  size_t size() const { return count_; }
+  SonyRemote *member(size_t index) const {
+    return index < count_ ? members_[index] : nullptr;
+  }
+  bool ready() const; // any member ready?
+
+  /**
+   * @brief Shoot all ready members.
+   *
+   * @param done called once the shutter release was written to every member
+   * @return 0 on success, -EBUSY while the last group shot is pending,
+   *         -ENOTCONN if no member is ready, -ENOBUFS if a queue is full
+   */
+  int shoot(sony_remote_done_cb_t done = nullptr, void *user_data = nullptr);
+  bool busy() const { return pending_ > 0; }
+  uint32_t pendingCommands();
+
+  void setCaptureProfile(CaptureProfile profile);
+  int beginSeries();
+  int endSeries();
+  int setLowLatency(bool enable);
+
+  // Raised once every member reported the frame of the last shot as done,
+  // nullptr unless all ready members report their status
+  struct k_poll_signal *captureSignal();
+
+  // Of the last shot, relative to the moment the shutter writes were issued.
+  // UINT32_MAX for members that did not take part or did not report.
+  uint32_t sentUs(size_t index) const;
+  uint32_t reportedUs(size_t index) const;
+  // Spread between the first and the last member, sent and reported
+  uint32_t sentSkewUs() const;
+  uint32_t reportedSkewUs() const;
+  void log_skew() const;
+
+private:
+  friend class SonyRemote;
+
+  enum class Member : uint8_t { IDLE, QUEUED, ARMED, FIRED };
+
+  SonyRemote *members_[SonyRemote::MAX_CAMERAS] = {};
+  size_t count_ = 0;
+
+  struct k_spinlock lock_;
+  Member state_[SonyRemote::MAX_CAMERAS] = {};
+  uint8_t waiting_ = 0; // queued members not at the barrier yet
+  uint8_t pending_ = 0; // members whose shutter release is not written yet
+  uint8_t capturing_ = 0;
+  int err_ = 0;
+  sony_remote_done_cb_t done_ = nullptr;
+  void *done_user_data_ = nullptr;
+  struct k_poll_signal capture_signal_;
+  struct k_work fire_work_;
+  bool initialized_ = false;
+
+  uint32_t fire_cycles_ = 0;
+  uint32_t sent_cycles_[SonyRemote::MAX_CAMERAS] = {};
+  uint32_t reported_cycles_[SonyRemote::MAX_CAMERAS] = {};
+
+  int index_of(const SonyRemote *remote) const;
+  void arrive(SonyRemote *remote);
+  void leave(SonyRemote *remote);
+  void fire();
+  static void fire_work_handler(struct k_work *work);
+  void sent(SonyRemote *remote);
+  void reported(SonyRemote *remote);
+  void captured(SonyRemote *remote);
+  static void member_done(int err, void *user_data);
+};
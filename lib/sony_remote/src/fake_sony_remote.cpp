@@ -4,16 +4,29 @@
 
 LOG_MODULE_REGISTER(fake_sony_remote, LOG_LEVEL_INF);
 
+// Every write takes one connection interval, status reports arrive at once
+constexpr uint32_t FAKE_WRITE_US = 7500;
+
+SonyRemote *SonyRemote::self_ = nullptr;
+
 SonyRemote::SonyRemote() {
   LOG_INF("FakeSonyRemote: constructor");
   ready_ = true;
+  self_ = this;
+  k_poll_signal_init(&capture_signal_);
+  k_work_init_delayable(&capture_work_, capture_work_handler);
 }
 
 SonyRemote::SonyRemote(const char *target_address) {
+  self_ = this;
+  k_poll_signal_init(&capture_signal_);
+  k_work_init_delayable(&capture_work_, capture_work_handler);
   LOG_INF("FakeSonyRemote: constructor with target address (ignored): %s",
           target_address ? target_address : "null");
 }
 
+void SonyRemote::connect() { LOG_INF("FakeSonyRemote: connect (no-op)"); }
+
 void SonyRemote::startScan() { LOG_INF("FakeSonyRemote: startScan (no-op)"); }
 
 void SonyRemote::stopScan() { LOG_INF("FakeSonyRemote: stopScan (no-op)"); }
@@ -54,4 +67,88 @@ void SonyRemote::zoomWPress() { LOG_INF("FakeSonyRemote: zoomWPress"); }
 
 void SonyRemote::zoomWRelease() { LOG_INF("FakeSonyRemote: zoomWRelease"); }
 
-void SonyRemote::shoot() { LOG_INF("FakeSonyRemote: shoot"); }
+// Reserve @p writes connection intervals after the writes already queued,
+// returns the uptime in ticks when the last of them is done
+int64_t SonyRemote::queue_writes(unsigned int writes) {
+  busy_until_ = MAX(busy_until_, k_uptime_ticks()) +
+                writes * k_us_to_ticks_ceil64(FAKE_WRITE_US);
+  return busy_until_;
+}
+
+int SonyRemote::shoot(sony_remote_done_cb_t done, void *user_data) {
+  LOG_INF("FakeSonyRemote: shoot (%s)", capture_profile_name(profile_));
+  if (k_work_delayable_is_pending(&capture_work_)) {
+    return -ENOBUFS;
+  }
+
+  const bool half_press =
+      profile_ == CaptureProfile::FULL_AF ||
+      (profile_ == CaptureProfile::HALF_PRESS_HELD && !half_press_held_);
+  k_poll_signal_reset(&capture_signal_);
+  done_ = done;
+  done_user_data_ = user_data;
+  // The frame is done with the shutter release, focus up follows
+  int64_t released = queue_writes(half_press ? 3 : 2);
+  if (half_press) {
+    queue_writes(1);
+  }
+  k_work_schedule(&capture_work_, K_TICKS(released - k_uptime_ticks()));
+  return 0;
+}
+
+void SonyRemote::capture_work_handler(struct k_work *work) {
+  ARG_UNUSED(work);
+  if (self_->done_) {
+    self_->done_(0, self_->done_user_data_);
+  }
+  k_poll_signal_raise(&self_->capture_signal_, 0);
+}
+
+uint32_t SonyRemote::pendingCommands() {
+  return k_uptime_ticks() < busy_until_ ? 1 : 0;
+}
+
+void SonyRemote::setCaptureProfile(CaptureProfile profile) {
+  if (half_press_held_) {
+    endSeries();
+  }
+  profile_ = profile;
+  LOG_INF("FakeSonyRemote: capture profile %s", capture_profile_name(profile));
+}
+
+CaptureProfile SonyRemote::captureProfile() const { return profile_; }
+
+int SonyRemote::beginSeries() {
+  if (profile_ == CaptureProfile::HALF_PRESS_HELD && !half_press_held_) {
+    queue_writes(1);
+    half_press_held_ = true;
+  }
+  return 0;
+}
+
+int SonyRemote::endSeries() {
+  if (half_press_held_) {
+    queue_writes(1);
+    half_press_held_ = false;
+  }
+  return 0;
+}
+
+int SonyRemote::setLowLatency(bool enable) {
+  LOG_INF("FakeSonyRemote: low latency %s", enable ? "on" : "off");
+  return 0;
+}
+
+bool SonyRemote::hasStatus() const { return true; }
+
+bool SonyRemote::focusAcquired() const { return true; }
+
+bool SonyRemote::shutterActive() const { return false; }
+
+struct k_poll_signal *SonyRemote::captureSignal() { return &capture_signal_; }
+
+int SonyRemote::waitCaptureComplete(k_timeout_t timeout) {
+  struct k_poll_event event = K_POLL_EVENT_INITIALIZER(
+      K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &capture_signal_);
+  return k_poll(&event, 1, timeout);
+}
@@ -5,9 +5,15 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/sys/byteorder.h>
 
+#ifdef CONFIG_SETTINGS
+#include <zephyr/settings/settings.h>
+#endif
+
 LOG_MODULE_REGISTER(sony_remote, LOG_LEVEL_INF);
 
-SonyRemote *SonyRemote::self_ = nullptr;
+SonyRemote *SonyRemote::instances_[SonyRemote::MAX_CAMERAS] = {};
+size_t SonyRemote::num_instances_ = 0;
+bool SonyRemote::auto_connecting_ = false;
 
 namespace {
 // Sony command payloads (write to FF01, Write Without Response)
@@ -23,20 +29,41 @@ constexpr uint8_t ZOOM_T_RELEASE[] = {0x02, 0x44, 0x00};
 constexpr uint8_t ZOOM_W_PRESS[] = {0x02, 0x47, 0x10};
 constexpr uint8_t ZOOM_W_RELEASE[] = {0x02, 0x46, 0x00};
 
+// Status reports notified on FF02: {0x02, type, value}
+constexpr uint8_t STATUS_REPORT = 0x02;
+constexpr uint8_t STATUS_FOCUS = 0x3F;
+constexpr uint8_t STATUS_SHUTTER = 0xA0;
+constexpr uint8_t STATUS_RECORDING = 0xD5;
+constexpr uint8_t STATUS_ON = 0x40; // focus acquired, shutter pressed, rec
+constexpr uint8_t STATUS_OFF = 0x20;
+
+// Gap between the button presses of shoot(), cut short by status reports
+constexpr uint16_t SHOOT_STEP_DELAY_MS = 50;
+
+// Connection interval while stacking (7.5-15 ms) and otherwise (30-50 ms)
+const struct bt_le_conn_param FAST_CONN_PARAM =
+    BT_LE_CONN_PARAM_INIT(6, 12, 0, 400);
+const struct bt_le_conn_param IDLE_CONN_PARAM = BT_LE_CONN_PARAM_INIT(
+    BT_GAP_INIT_CONN_INT_MIN, BT_GAP_INIT_CONN_INT_MAX, 0, 400);
+
+// Dedicated work queue writing the queued commands
+constexpr size_t CMD_WORKQ_STACK_SIZE = 1024;
+constexpr int CMD_WORKQ_PRIORITY = K_PRIO_PREEMPT(5);
+
 // // Little-endian bytes for 8000FF00-FF00-FFFF-FFFF-FFFFFFFFFFFF
 // static bt_uuid_128 kSonySvcUuid =
 //     BT_UUID_INIT_128(0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
 //     0xff,
 //                      0x00, 0xff, 0x00, 0xff, 0x00, 0x80);
 
-static bt_uuid_16 kFF01Uuid = BT_UUID_INIT_16(0xFF01);
+static bool check_sony(bt_data *data, void *user) {
+  bool *is_sony = static_cast<bool *>(user);
 
-static bool accept_any(bt_data *data, void * /*user*/) {
   // Look for Sony devices by checking for Sony manufacturer data or device name
   if (data->type == BT_DATA_MANUFACTURER_DATA && data->data_len >= 2) {
     uint16_t company_id = sys_get_le16(data->data);
     if (company_id == 0x012D) { // Sony's company ID
-      return true;
+      *is_sony = true;
     }
   }
 
@@ -45,35 +72,95 @@ static bool accept_any(bt_data *data, void * /*user*/) {
     // Check if device name contains "DSC", "ILCE", "FX", or other Sony camera
     // prefixes
     const char *name = (const char *)data->data;
-    if (data->data_len >= 3) {
-      if (strncmp(name, "DSC", 3) == 0 || strncmp(name, "ILCE", 4) == 0 ||
-          strncmp(name, "FX", 2) == 0) {
-        return true;
-      }
+    if ((data->data_len >= 3 && strncmp(name, "DSC", 3) == 0) ||
+        (data->data_len >= 4 && strncmp(name, "ILCE", 4) == 0) ||
+        (data->data_len >= 2 && strncmp(name, "FX", 2) == 0)) {
+      *is_sony = true;
+    }
+  }
+
+  return !*is_sony; // stop parsing once identified
+}
+
+static bool is_sony_camera(net_buf_simple *ad) {
+  bool is_sony = false;
+  bt_data_parse(ad, check_sony, &is_sony);
+  return is_sony;
+}
+
+// GATT handles of a bonded camera, saved as "sony/<address>" so that a
+// reconnect can skip the discovery
+struct camera_handles {
+  bt_addr_le_t addr;
+  uint16_t ff01_handle;
+  uint8_t ff01_properties;
+  uint16_t ff02_handle;
+  uint16_t ff02_ccc_handle;
+};
+static camera_handles handle_cache[CONFIG_BT_MAX_PAIRED];
+
+// Entry for @p addr, or with @p alloc a free (or the oldest) one
+static camera_handles *find_handles(const bt_addr_le_t *addr, bool alloc) {
+  for (auto &entry : handle_cache) {
+    if (entry.ff01_handle != 0 && bt_addr_le_eq(&entry.addr, addr)) {
+      return &entry;
+    }
+  }
+  if (!alloc) {
+    return nullptr;
+  }
+  for (auto &entry : handle_cache) {
+    if (entry.ff01_handle == 0) {
+      return &entry;
     }
   }
+  return &handle_cache[0];
+}
 
-  LOG_WRN("Device that actually should be rejected by filter, type: %u",
-          data->type);
-  return true; // For now, still accept any device for broader compatibility
+#ifdef CONFIG_SETTINGS
+static void handles_key(const bt_addr_le_t *addr, char *key, size_t len) {
+  snprintk(key, len, "sony/%02x%02x%02x%02x%02x%02x%u", addr->a.val[5],
+           addr->a.val[4], addr->a.val[3], addr->a.val[2], addr->a.val[1],
+           addr->a.val[0], addr->type);
 }
 
+static int handles_set(const char *name, size_t len, settings_read_cb read_cb,
+                       void *cb_arg) {
+  camera_handles entry;
+  if (len != sizeof(entry) ||
+      read_cb(cb_arg, &entry, sizeof(entry)) != sizeof(entry)) {
+    LOG_WRN("Ignoring cached handles %s", name);
+    return -EINVAL;
+  }
+  *find_handles(&entry.addr, true) = entry;
+  return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(sony_remote, "sony", NULL, handles_set, NULL,
+                               NULL);
+#endif
+
 } // namespace
 
+K_THREAD_STACK_DEFINE(sony_remote_workq_stack, CMD_WORKQ_STACK_SIZE);
+static struct k_work_q sony_remote_workq;
+
 SonyRemote::SonyRemote() {
-  self_ = this;
+  if (num_instances_ < MAX_CAMERAS) {
+    instances_[num_instances_++] = this;
+  } else {
+    LOG_ERR("More than %u remotes, callbacks will not reach this one",
+            MAX_CAMERAS);
+  }
   k_work_init_delayable(&discovery_work_, discovery_work_handler);
+  k_poll_signal_init(&capture_signal_);
+  init_commands();
   has_target_addr_ = false;
   is_paired_ = false;
   discovery_retry_count_ = 0;
 }
 
-SonyRemote::SonyRemote(const char *target_address) {
-  self_ = this;
-  k_work_init_delayable(&discovery_work_, discovery_work_handler);
-  is_paired_ = false;
-  discovery_retry_count_ = 0;
-
+SonyRemote::SonyRemote(const char *target_address) : SonyRemote() {
   // Parse the target address string and set has_target_addr_
   if (target_address) {
     // Try parsing as public address first (most common for cameras)
@@ -94,26 +181,173 @@ SonyRemote::SonyRemote(const char *target_address) {
   }
 }
 
+SonyRemote *SonyRemote::get(size_t index) {
+  return index < num_instances_ ? instances_[index] : nullptr;
+}
+
+size_t SonyRemote::count() { return num_instances_; }
+
+SonyRemote *SonyRemote::from_conn(const bt_conn *conn) {
+  for (size_t i = 0; i < num_instances_; i++) {
+    if (conn && instances_[i]->conn_ == conn) {
+      return instances_[i];
+    }
+  }
+  return nullptr;
+}
+
+// Is the camera at @p addr connected to one of the remotes?
+bool SonyRemote::in_use(const bt_addr_le_t *addr) {
+  for (size_t i = 0; i < num_instances_; i++) {
+    const bt_conn *conn = instances_[i]->conn_;
+    if (conn && bt_addr_le_eq(bt_conn_get_dst(conn), addr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Would this remote take the camera at @p addr? @p ad is its advertising
+// data when scanning.
+bool SonyRemote::wants(const bt_addr_le_t *addr, net_buf_simple *ad) const {
+  if (conn_) {
+    return false;
+  }
+  if (has_target_addr_) {
+    return bt_addr_le_eq(addr, &target_addr_);
+  }
+  return !in_use(addr) && (!ad || is_sony_camera(ad));
+}
+
+SonyRemote *SonyRemote::claim(const bt_addr_le_t *addr, net_buf_simple *ad) {
+  SonyRemote *any = nullptr;
+  for (size_t i = 0; i < num_instances_; i++) {
+    SonyRemote *remote = instances_[i];
+    if (!remote->wants(addr, ad)) {
+      continue;
+    }
+    if (remote->has_target_addr_) {
+      return remote;
+    }
+    if (!any) {
+      any = remote;
+    }
+  }
+  return any;
+}
+
+// Connect the remotes without camera, one connection attempt at a time
+void SonyRemote::connect_idle() {
+  for (size_t i = 0; i < num_instances_; i++) {
+    if (!instances_[i]->conn_) {
+      instances_[i]->connect();
+      return;
+    }
+  }
+}
+
+void SonyRemote::init_commands() {
+  static bool workq_started = false;
+  if (!workq_started) {
+    k_work_queue_start(&sony_remote_workq, sony_remote_workq_stack,
+                       K_THREAD_STACK_SIZEOF(sony_remote_workq_stack),
+                       CMD_WORKQ_PRIORITY, nullptr);
+    k_thread_name_set(&sony_remote_workq.thread, "sony_remote");
+    workq_started = true;
+  }
+  k_msgq_init(&cmd_q_, cmd_q_buf_, sizeof(command), CMD_QUEUE_LEN);
+  k_work_init_delayable(&cmd_work_, cmd_work_handler);
+}
+
 void SonyRemote::end() {
+  flush_commands(-ECANCELED);
+#if defined(CONFIG_BT_FILTER_ACCEPT_LIST)
+  if (auto_connecting_) {
+    bt_conn_create_auto_stop();
+    auto_connecting_ = false;
+  }
+#endif
   if (conn_) {
     bt_conn_unref(conn_);
     conn_ = nullptr;
   }
   ff01_handle_ = 0;
+  ff02_handle_ = 0;
+  half_press_held_ = false;
   k_work_cancel_delayable(&discovery_work_);
 }
 
+// Bonded camera to connect to directly, the target if it is bonded,
+// otherwise the first bonded camera with cached handles not in use
+bool SonyRemote::bonded_camera(bt_addr_le_t *addr) const {
+  if (has_target_addr_) {
+    *addr = target_addr_;
+    return bt_le_bond_exists(BT_ID_DEFAULT, &target_addr_);
+  }
+  for (const auto &entry : handle_cache) {
+    if (entry.ff01_handle != 0 && !in_use(&entry.addr) &&
+        bt_le_bond_exists(BT_ID_DEFAULT, &entry.addr)) {
+      *addr = entry.addr;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The controller connects to one camera at a time. Connects directly only if
+// every remote without camera has a bonded one to wait for, otherwise scans
+// and hands each camera found to the remote that wants it.
+void SonyRemote::connect() {
+#if defined(CONFIG_BT_FILTER_ACCEPT_LIST)
+  if (auto_connecting_) {
+    bt_conn_create_auto_stop();
+    auto_connecting_ = false;
+  }
+  bt_le_filter_accept_list_clear();
+  int listed = 0;
+  int err = 0;
+  for (size_t i = 0; i < num_instances_ && !err; i++) {
+    bt_addr_le_t addr;
+    if (instances_[i]->conn_) {
+      continue;
+    }
+    if (!instances_[i]->bonded_camera(&addr)) {
+      err = -ENOENT;
+      break;
+    }
+    err = bt_le_filter_accept_list_add(&addr);
+    if (!err) {
+      char addr_str[BT_ADDR_LE_STR_LEN];
+      bt_addr_le_to_str(&addr, addr_str, sizeof(addr_str));
+      LOG_INF("Waiting for bonded camera %s", addr_str);
+      listed++;
+    }
+  }
+  if (!err && listed > 0) {
+    err = bt_conn_le_create_auto(BT_CONN_LE_CREATE_CONN, &IDLE_CONN_PARAM);
+    if (!err) {
+      auto_connecting_ = true;
+      return;
+    }
+    LOG_WRN("Direct connect failed (%d), scanning instead", err);
+  }
+#endif
+  startScan();
+}
+
 void SonyRemote::startScan() {
   static struct bt_le_scan_param scan_param =
       BT_LE_SCAN_PARAM_INIT(BT_LE_SCAN_TYPE_ACTIVE, BT_LE_SCAN_OPT_NONE,
                             BT_GAP_SCAN_FAST_INTERVAL, BT_GAP_SCAN_FAST_WINDOW);
   int err = bt_le_scan_start(&scan_param, SonyRemote::on_scan);
-  if (err) {
+  if (err == -EALREADY) {
+    LOG_DBG("Already scanning");
+  } else if (err) {
     LOG_ERR("Scan start failed (%d)", err);
   } else {
-    if (self_->has_target_addr_) {
+    if (has_target_addr_) {
       char addr_str[BT_ADDR_LE_STR_LEN];
-      bt_addr_le_to_str(&self_->target_addr_, addr_str, sizeof(addr_str));
+      bt_addr_le_to_str(&target_addr_, addr_str, sizeof(addr_str));
       LOG_INF("Scanning for specific Sony camera: %s", addr_str);
     } else {
       LOG_INF("Scanning for any Sony camera...");
@@ -122,6 +356,12 @@ void SonyRemote::startScan() {
 }
 
 void SonyRemote::stopScan() {
+#if defined(CONFIG_BT_FILTER_ACCEPT_LIST)
+  if (auto_connecting_) {
+    bt_conn_create_auto_stop();
+    auto_connecting_ = false;
+  }
+#endif
   int err = bt_le_scan_stop();
   if (err) {
     LOG_ERR("Scan stop failed (%d)", err);
@@ -139,11 +379,13 @@ bool SonyRemote::ready() const {
 }
 
 char *SonyRemote::state() {
-  static char buffer[128];
+  static char buffer[160];
   snprintf(buffer, sizeof(buffer),
-           "SonyRemote: connected=%s, paired=%s, ff01_handle=0x%04x",
+           "SonyRemote: connected=%s, paired=%s, ff01_handle=0x%04x, "
+           "ff02_handle=0x%04x, focus=%s, shutter=%s",
            conn_ ? "true" : "false", is_paired_ ? "true" : "false",
-           ff01_handle_);
+           ff01_handle_, ff02_handle_, focus_acquired_ ? "true" : "false",
+           shutter_active_ ? "true" : "false");
   return buffer;
 }
 
@@ -165,17 +407,162 @@ void SonyRemote::zoomWRelease() {
   send_cmd(ZOOM_W_RELEASE, sizeof(ZOOM_W_RELEASE));
 }
 
-void SonyRemote::shoot() {
-  int delay = 50;
-  LOG_DBG("shoot ...");
-  focusDown();
-  k_msleep(delay);
-  shutterDown();
-  k_msleep(delay);
-  shutterUp();
-  k_msleep(delay);
-  focusUp();
-  LOG_DBG("... done shooting");
+bool SonyRemote::hasStatus() const { return ready() && ff02_handle_ != 0; }
+
+bool SonyRemote::focusAcquired() const { return focus_acquired_; }
+
+bool SonyRemote::shutterActive() const { return shutter_active_; }
+
+struct k_poll_signal *SonyRemote::captureSignal() { return &capture_signal_; }
+
+int SonyRemote::waitCaptureComplete(k_timeout_t timeout) {
+  struct k_poll_event event = K_POLL_EVENT_INITIALIZER(
+      K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &capture_signal_);
+  return k_poll(&event, 1, timeout);
+}
+
+int SonyRemote::shoot(sony_remote_done_cb_t done, void *user_data) {
+  return queue_shoot(done, user_data, nullptr);
+}
+
+// The shutter press waits for the other members of @p group if given
+int SonyRemote::queue_shoot(sony_remote_done_cb_t done, void *user_data,
+                            SonyRemoteGroup *group) {
+  if (!ready()) {
+    LOG_WRN("Camera not ready, shoot ignored");
+    return -ENOTCONN;
+  }
+
+  // Half press only if it is not held already
+  const bool half_press =
+      profile_ == CaptureProfile::FULL_AF ||
+      (profile_ == CaptureProfile::HALF_PRESS_HELD && !half_press_held_);
+  if (k_msgq_num_free_get(&cmd_q_) < (half_press ? 4 : 2)) {
+    LOG_WRN("Command queue full, shoot ignored");
+    return -ENOBUFS;
+  }
+
+  LOG_DBG("shoot (%s)", capture_profile_name(profile_));
+  shoot_start_cycles_ = k_cycle_get_32();
+  k_poll_signal_reset(&capture_signal_);
+  // Without status reports nobody will report the frame, waiters fall back
+  // to their timeout
+  capture_pending_ = hasStatus();
+  if (half_press) {
+    queue_cmd(FOCUS_DOWN, sizeof(FOCUS_DOWN), STATUS_FOCUS, STATUS_ON,
+              SHOOT_STEP_DELAY_MS);
+  }
+  queue_cmd(SHUTTER_DOWN, sizeof(SHUTTER_DOWN), STATUS_SHUTTER, STATUS_ON,
+            SHOOT_STEP_DELAY_MS, nullptr, nullptr, group);
+  queue_cmd(SHUTTER_UP, sizeof(SHUTTER_UP), STATUS_SHUTTER, STATUS_OFF,
+            half_press ? SHOOT_STEP_DELAY_MS : 0, done, user_data);
+  if (half_press) {
+    queue_cmd(FOCUS_UP, sizeof(FOCUS_UP));
+  }
+  return 0;
+}
+
+void SonyRemote::setCaptureProfile(CaptureProfile profile) {
+  if (half_press_held_) {
+    endSeries();
+  }
+  profile_ = profile;
+  LOG_INF("Capture profile %s", capture_profile_name(profile));
+}
+
+CaptureProfile SonyRemote::captureProfile() const { return profile_; }
+
+int SonyRemote::beginSeries() {
+  if (profile_ != CaptureProfile::HALF_PRESS_HELD || half_press_held_) {
+    return 0;
+  }
+  // The first frame waits for focus like FULL_AF does
+  int err = queue_cmd(FOCUS_DOWN, sizeof(FOCUS_DOWN), STATUS_FOCUS, STATUS_ON,
+                      SHOOT_STEP_DELAY_MS);
+  if (err == 0) {
+    half_press_held_ = true;
+  }
+  return err;
+}
+
+int SonyRemote::setLowLatency(bool enable) {
+  low_latency_ = enable;
+  if (!ready()) {
+    // applied once connected
+    return 0;
+  }
+  int err = bt_conn_le_param_update(
+      conn_, enable ? &FAST_CONN_PARAM : &IDLE_CONN_PARAM);
+  if (err && err != -EALREADY) {
+    LOG_WRN("Connection parameter update failed (%d)", err);
+    return err;
+  }
+  return 0;
+}
+
+int SonyRemote::endSeries() {
+  if (!half_press_held_) {
+    return 0;
+  }
+  half_press_held_ = false;
+  return queue_cmd(FOCUS_UP, sizeof(FOCUS_UP));
+}
+
+uint32_t SonyRemote::pendingCommands() {
+  return k_msgq_num_used_get(&cmd_q_) + (write_in_flight_ ? 1 : 0);
+}
+
+// Has the camera reported @p type with @p value since the last change?
+bool SonyRemote::status_reached(uint8_t type, uint8_t value) const {
+  if (!hasStatus()) {
+    return false;
+  }
+  switch (type) {
+  case STATUS_FOCUS:
+    return focus_acquired_ == (value == STATUS_ON);
+  case STATUS_SHUTTER:
+    return shutter_active_ == (value == STATUS_ON);
+  default:
+    return false;
+  }
+}
+
+void SonyRemote::handle_status(uint8_t type, uint8_t value) {
+  switch (type) {
+  case STATUS_FOCUS:
+    focus_acquired_ = value == STATUS_ON;
+    LOG_DBG("Focus %s", focus_acquired_ ? "acquired" : "lost");
+    break;
+  case STATUS_SHUTTER:
+    shutter_active_ = value == STATUS_ON;
+    LOG_DBG("Shutter %s", shutter_active_ ? "active" : "released");
+    if (shutter_active_ && group_) {
+      group_->reported(this);
+    }
+    if (!shutter_active_ && capture_pending_) {
+      capture_pending_ = false;
+      k_poll_signal_raise(&capture_signal_, 0);
+      if (group_) {
+        group_->captured(this);
+      }
+    }
+    break;
+  case STATUS_RECORDING:
+    LOG_INF("Recording %s", value == STATUS_ON ? "started" : "stopped");
+    break;
+  default:
+    LOG_DBG("Unknown status report 0x%02x 0x%02x", type, value);
+    return;
+  }
+  if (value != STATUS_ON && value != STATUS_OFF) {
+    LOG_DBG("Unexpected status value 0x%02x for 0x%02x", value, type);
+  }
+
+  // End the gap after the current command if this is what it waits for
+  if (waiting_type_ == type && status_reached(type, waiting_value_)) {
+    waiting_type_ = 0;
+    k_work_reschedule_for_queue(&sony_remote_workq, &cmd_work_, K_NO_WAIT);
+  }
 }
 
 void SonyRemote::on_connected(bt_conn *conn, uint8_t err) {
@@ -187,23 +574,37 @@ void SonyRemote::on_connected(bt_conn *conn, uint8_t err) {
     return;
   }
 
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL in on_connected!");
-    return;
+  // Scanned cameras were handed to their remote already, directly
+  // connected ones are claimed now
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    self = claim(bt_conn_get_dst(conn));
   }
-
+  auto_connecting_ = false;
   if (err) {
     LOG_ERR("Connect failed (%u)", err);
+    if (self && self->conn_) {
+      bt_conn_unref(self->conn_);
+      self->conn_ = nullptr;
+    }
+    connect_idle();
     return;
   }
 
   char addr_str[BT_ADDR_LE_STR_LEN];
   bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
+  if (!self) {
+    LOG_WRN("No remote left for %s, disconnecting", addr_str);
+    bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    return;
+  }
   LOG_INF("Connected to %s", addr_str);
 
-  if (self_->conn_)
-    bt_conn_unref(self_->conn_);
-  self_->conn_ = bt_conn_ref(conn);
+  if (self->conn_ != conn) {
+    if (self->conn_)
+      bt_conn_unref(self->conn_);
+    self->conn_ = bt_conn_ref(conn);
+  }
 
   // Check current security level
   bt_security_t sec_level = bt_conn_get_security(conn);
@@ -216,15 +617,17 @@ void SonyRemote::on_connected(bt_conn *conn, uint8_t err) {
     if (pairing_err) {
       LOG_ERR("Failed to start pairing (%d)", pairing_err);
       // Try discovery anyway in case device is already bonded
-      k_work_schedule(&self_->discovery_work_, K_MSEC(1000));
+      k_work_schedule(&self->discovery_work_, K_MSEC(1000));
     }
   } else {
     // Already paired, start discovery immediately
     LOG_INF("Already paired (security level %d), starting discovery...",
             sec_level);
-    self_->is_paired_ = true;
-    self_->start_discovery();
+    self->is_paired_ = true;
+    self->start_discovery();
   }
+
+  connect_idle();
 }
 
 void SonyRemote::on_disconnected(bt_conn *conn, uint8_t reason) {
@@ -236,35 +639,44 @@ void SonyRemote::on_disconnected(bt_conn *conn, uint8_t reason) {
     return;
   }
 
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL in on_disconnected!");
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    // refused by on_connected
     return;
   }
 
   LOG_INF("Disconnected (0x%02x)", reason);
-  if (self_->conn_) {
-    bt_conn_unref(self_->conn_);
-    self_->conn_ = nullptr;
-  }
-  self_->ff01_handle_ = 0;
-  self_->ff01_properties_ = 0;       // Reset properties
-  self_->is_paired_ = false;         // Reset pairing status on disconnect
-  self_->discovery_retry_count_ = 0; // Reset retry counter on disconnect
-  // resume scanning
-  self_->startScan();
+  self->flush_commands(-ENOTCONN);
+  bt_conn_unref(self->conn_);
+  self->conn_ = nullptr;
+  self->ff01_handle_ = 0;
+  self->ff02_handle_ = 0;
+  self->half_press_held_ = false;
+  self->focus_acquired_ = false;
+  self->shutter_active_ = false;
+  self->capture_pending_ = false;
+  self->ff01_properties_ = 0;       // Reset properties
+  self->is_paired_ = false;         // Reset pairing status on disconnect
+  self->discovery_retry_count_ = 0; // Reset retry counter on disconnect
+  self->ff02_ccc_handle_ = 0;
+  self->link_lost_ms_ = k_uptime_get();
+  // connect directly to a bonded camera, scan otherwise
+  self->connect();
 }
 
-uint8_t SonyRemote::on_discover(bt_conn * /*conn*/, const bt_gatt_attr *attr,
+uint8_t SonyRemote::on_discover(bt_conn *conn, const bt_gatt_attr *attr,
                                 bt_gatt_discover_params *params) {
-  // Add safety check for self_ pointer
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL!");
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    LOG_ERR("No remote for discovered connection!");
     return BT_GATT_ITER_STOP;
   }
 
   if (!attr) {
     LOG_DBG("Discovery complete");
     std::memset(params, 0, sizeof(*params));
+    self->subscribe_status();
+    self->tune_connection();
     return BT_GATT_ITER_STOP;
   }
 
@@ -276,11 +688,11 @@ uint8_t SonyRemote::on_discover(bt_conn * /*conn*/, const bt_gatt_attr *attr,
               chrc->value_handle);
 
       if (uuid_val == 0xFF01) {
-        self_->ff01_handle_ = chrc->value_handle;
-        self_->ff01_properties_ = chrc->properties; // Store properties
-        self_->is_paired_ = true; // Set paired flag when FF01 is found
+        self->ff01_handle_ = chrc->value_handle;
+        self->ff01_properties_ = chrc->properties; // Store properties
+        self->is_paired_ = true; // Set paired flag when FF01 is found
         LOG_INF("Found FF01 (handle 0x%04x) - camera is ready!",
-                self_->ff01_handle_);
+                self->ff01_handle_);
 
         // Log the characteristic properties
         LOG_DBG("FF01 properties: 0x%02x", chrc->properties);
@@ -291,20 +703,175 @@ uint8_t SonyRemote::on_discover(bt_conn * /*conn*/, const bt_gatt_attr *attr,
         } else {
           LOG_WRN("Neither Write nor Write Without Response supported");
         }
-
-        std::memset(params, 0, sizeof(*params));
-        return BT_GATT_ITER_STOP;
+      } else if (uuid_val == 0xFF02 &&
+                 (chrc->properties & BT_GATT_CHRC_NOTIFY)) {
+        self->ff02_handle_ = chrc->value_handle;
+        LOG_INF("Found FF02 (handle 0x%04x)", self->ff02_handle_);
       }
     }
   }
   return BT_GATT_ITER_CONTINUE;
 }
 
-uint8_t SonyRemote::on_discover_service(bt_conn * /*conn*/,
+// Ask for 2M PHY and the interval for the current mode
+void SonyRemote::tune_connection() {
+  if (!conn_) {
+    return;
+  }
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+  int err = bt_conn_le_phy_update(conn_, BT_CONN_LE_PHY_PARAM_2M);
+  if (err) {
+    LOG_DBG("PHY update not started (%d)", err);
+  }
+#endif
+  if (low_latency_) {
+    setLowLatency(true);
+  }
+  if (link_lost_ms_ != 0) {
+    LOG_INF("Camera ready %lld ms after the link was lost",
+            k_uptime_get() - link_lost_ms_);
+    link_lost_ms_ = 0;
+  }
+}
+
+bool SonyRemote::load_handles() {
+  const camera_handles *entry = find_handles(bt_conn_get_dst(conn_), false);
+  if (!entry) {
+    return false;
+  }
+  ff01_handle_ = entry->ff01_handle;
+  ff01_properties_ = entry->ff01_properties;
+  ff02_handle_ = entry->ff02_handle;
+  ff02_ccc_handle_ = entry->ff02_ccc_handle;
+  is_paired_ = true;
+  return true;
+}
+
+// Only bonded cameras come back with the same handles
+void SonyRemote::store_handles() {
+  const bt_addr_le_t *dst = bt_conn_get_dst(conn_);
+  if (!bt_le_bond_exists(BT_ID_DEFAULT, dst)) {
+    return;
+  }
+  camera_handles *entry = find_handles(dst, true);
+  entry->addr = *dst;
+  entry->ff01_handle = ff01_handle_;
+  entry->ff01_properties = ff01_properties_;
+  entry->ff02_handle = ff02_handle_;
+  entry->ff02_ccc_handle = ff02_ccc_handle_;
+#ifdef CONFIG_SETTINGS
+  char key[32];
+  handles_key(dst, key, sizeof(key));
+  int err = settings_save_one(key, entry, sizeof(*entry));
+  if (err) {
+    LOG_WRN("Saving handles failed (%d)", err);
+  }
+#endif
+}
+
+void SonyRemote::forget_handles() {
+  const bt_addr_le_t *dst = bt_conn_get_dst(conn_);
+  camera_handles *entry = find_handles(dst, false);
+  if (!entry) {
+    return;
+  }
+  *entry = {};
+#ifdef CONFIG_SETTINGS
+  char key[32];
+  handles_key(dst, key, sizeof(key));
+  settings_delete(key);
+#endif
+}
+
+void SonyRemote::on_param_updated(bt_conn *conn, uint16_t interval,
+                                  uint16_t latency, uint16_t timeout) {
+  char addr_str[BT_ADDR_LE_STR_LEN];
+  bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
+  LOG_INF("Camera %s connection interval %u us, latency %u, timeout %u ms",
+          addr_str, BT_CONN_INTERVAL_TO_US(interval), latency, timeout * 10);
+}
+
+void SonyRemote::on_phy_updated(bt_conn *conn,
+                                struct bt_conn_le_phy_info *param) {
+  char addr_str[BT_ADDR_LE_STR_LEN];
+  bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
+  LOG_INF("Camera %s PHY tx %u rx %u", addr_str, param->tx_phy,
+          param->rx_phy);
+}
+
+void SonyRemote::subscribe_status() {
+  if (!conn_ || ff02_handle_ == 0) {
+    LOG_WRN("No FF02, falling back to fixed shoot() delays");
+    return;
+  }
+
+  sub_params_.notify = SonyRemote::on_notify;
+  sub_params_.value = BT_GATT_CCC_NOTIFY;
+  sub_params_.value_handle = ff02_handle_;
+  sub_params_.subscribe = SonyRemote::on_subscribed;
+  // Let the stack look up the CCC descriptor unless cached
+  sub_params_.ccc_handle = ff02_ccc_handle_;
+  sub_params_.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+  sub_params_.disc_params = &ccc_disc_params_;
+
+  int err = bt_gatt_subscribe(conn_, &sub_params_);
+  if (err == -EALREADY) {
+    LOG_DBG("Already subscribed to FF02");
+    store_handles();
+  } else if (err) {
+    LOG_ERR("FF02 subscribe failed (%d)", err);
+    ff02_handle_ = 0;
+  } else {
+    LOG_INF("Subscribed to FF02 status reports");
+  }
+}
+
+void SonyRemote::on_subscribed(bt_conn *conn, uint8_t err,
+                               bt_gatt_subscribe_params *params) {
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    return;
+  }
+  if (err) {
+    LOG_ERR("FF02 subscription failed (0x%02x)", err);
+    self->forget_handles();
+    return;
+  }
+  if (params->value) {
+    self->ff02_ccc_handle_ = params->ccc_handle;
+    self->store_handles();
+  }
+}
+
+uint8_t SonyRemote::on_notify(bt_conn *conn, bt_gatt_subscribe_params *params,
+                              const void *data, uint16_t length) {
+  if (!data) {
+    LOG_INF("FF02 unsubscribed");
+    params->value_handle = 0;
+    return BT_GATT_ITER_STOP;
+  }
+
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    LOG_ERR("No remote for FF02 notification!");
+    return BT_GATT_ITER_STOP;
+  }
+
+  const uint8_t *buf = static_cast<const uint8_t *>(data);
+  if (length >= 3 && buf[0] == STATUS_REPORT) {
+    self->handle_status(buf[1], buf[2]);
+  } else {
+    LOG_HEXDUMP_DBG(buf, length, "Unhandled FF02 notification");
+  }
+  return BT_GATT_ITER_CONTINUE;
+}
+
+uint8_t SonyRemote::on_discover_service(bt_conn *conn,
                                         const bt_gatt_attr *attr,
                                         bt_gatt_discover_params *params) {
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL!");
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    LOG_ERR("No remote for discovered connection!");
     return BT_GATT_ITER_STOP;
   }
 
@@ -322,14 +889,14 @@ uint8_t SonyRemote::on_discover_service(bt_conn * /*conn*/,
               attr->handle, service->end_handle);
 
       // Now discover characteristics within this service
-      self_->disc_params_ = {};
-      self_->disc_params_.uuid = &kFF01Uuid.uuid;
-      self_->disc_params_.type = BT_GATT_DISCOVER_CHARACTERISTIC;
-      self_->disc_params_.func = SonyRemote::on_discover;
-      self_->disc_params_.start_handle = attr->handle;
-      self_->disc_params_.end_handle = service->end_handle;
-
-      int err = bt_gatt_discover(self_->conn_, &self_->disc_params_);
+      self->disc_params_ = {};
+      self->disc_params_.uuid = nullptr;
+      self->disc_params_.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+      self->disc_params_.func = SonyRemote::on_discover;
+      self->disc_params_.start_handle = attr->handle;
+      self->disc_params_.end_handle = service->end_handle;
+
+      int err = bt_gatt_discover(self->conn_, &self->disc_params_);
       if (err) {
         LOG_ERR("Characteristic discovery failed: %d", err);
       }
@@ -368,10 +935,18 @@ void SonyRemote::start_discovery() {
   // Reset retry counter on successful security level
   discovery_retry_count_ = 0;
 
-  // Only discover the FF01 characteristic directly
-  // Remove the unnecessary primary service discovery to avoid conflicts
+  if (load_handles()) {
+    LOG_INF("Using cached handles FF01 0x%04x, FF02 0x%04x", ff01_handle_,
+            ff02_handle_);
+    subscribe_status();
+    tune_connection();
+    return;
+  }
+
+  // Discover the characteristics directly, FF01 for commands and FF02 for
+  // status reports. Primary service discovery is skipped to avoid conflicts
   disc_params_ = {};
-  disc_params_.uuid = &kFF01Uuid.uuid;
+  disc_params_.uuid = nullptr;
   disc_params_.type = BT_GATT_DISCOVER_CHARACTERISTIC;
   disc_params_.func = SonyRemote::on_discover;
   disc_params_.start_handle = 0x0001;
@@ -385,31 +960,18 @@ void SonyRemote::start_discovery() {
 
 void SonyRemote::on_scan(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
                          net_buf_simple *ad) {
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL in on_scan!");
+  // Remote that takes this camera, if any
+  SonyRemote *self = claim(addr, ad);
+  if (!self) {
     return;
   }
 
-  if (self_->has_target_addr_) {
-    char found_addr_str[BT_ADDR_LE_STR_LEN];
-    char target_addr_str[BT_ADDR_LE_STR_LEN];
-    bt_addr_le_to_str(addr, found_addr_str, sizeof(found_addr_str));
-    bt_addr_le_to_str(&self_->target_addr_, target_addr_str,
-                      sizeof(target_addr_str));
-
-    if (!bt_addr_le_eq(addr, &self_->target_addr_)) {
-      return;
-    }
-  }
-
-  bt_data_parse(ad, accept_any, nullptr);
-
   if (type == BT_GAP_ADV_TYPE_ADV_IND ||
       type == BT_GAP_ADV_TYPE_ADV_DIRECT_IND) {
     char s[BT_ADDR_LE_STR_LEN];
     bt_addr_le_to_str(addr, s, sizeof(s));
 
-    if (self_->has_target_addr_) {
+    if (self->has_target_addr_) {
       LOG_INF("Found target camera %s (RSSI %d), connecting...", s, rssi);
     } else {
       LOG_DBG("Trying to connect %s (RSSI %d)", s, rssi);
@@ -423,30 +985,96 @@ void SonyRemote::on_scan(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
       static struct bt_le_conn_param conn_param = BT_LE_CONN_PARAM_INIT(
           BT_GAP_INIT_CONN_INT_MIN, BT_GAP_INIT_CONN_INT_MAX, 0, 400);
       int err =
-          bt_conn_le_create(addr, &create_param, &conn_param, &self_->conn_);
+          bt_conn_le_create(addr, &create_param, &conn_param, &self->conn_);
       if (err) {
         LOG_ERR("Create conn failed (%d)", err);
-        bt_conn_unref(self_->conn_);
-        self_->conn_ = nullptr;
+        bt_conn_unref(self->conn_);
+        self->conn_ = nullptr;
         k_msleep(300);
 
-        self_->startScan();
+        self->startScan();
       }
     }
   }
 }
 
 void SonyRemote::send_cmd(const uint8_t *buf, size_t len) {
+  queue_cmd(buf, len);
+}
+
+int SonyRemote::queue_cmd(const uint8_t *buf, size_t len, uint8_t wait_type,
+                          uint8_t wait_value, uint16_t gap_ms,
+                          sony_remote_done_cb_t done, void *user_data,
+                          SonyRemoteGroup *group) {
   if (!ready()) {
     LOG_WRN(
         "Camera not ready, command ignored (conn=%p, ff01=0x%04x, paired=%d)",
         conn_, ff01_handle_, is_paired_);
+    return -ENOTCONN;
+  }
+
+  command cmd = {};
+  if (len > sizeof(cmd.data)) {
+    LOG_ERR("Command too large (%d bytes, max %d)", len, sizeof(cmd.data));
+    return -EINVAL;
+  }
+  memcpy(cmd.data, buf, len);
+  cmd.len = len;
+  cmd.wait_type = wait_type;
+  cmd.wait_value = wait_value;
+  cmd.gap_ms = gap_ms;
+  cmd.done = done;
+  cmd.user_data = user_data;
+  cmd.group = group;
+
+  if (k_msgq_put(&cmd_q_, &cmd, K_NO_WAIT) != 0) {
+    LOG_WRN("Command queue full, command 0x%02x 0x%02x dropped", buf[0],
+            buf[1]);
+    return -ENOBUFS;
+  }
+  // Does not shorten a gap that is already running
+  k_work_schedule_for_queue(&sony_remote_workq, &cmd_work_, K_NO_WAIT);
+  return 0;
+}
+
+void SonyRemote::cmd_work_handler(struct k_work *work) {
+  struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+  for (size_t i = 0; i < num_instances_; i++) {
+    if (&instances_[i]->cmd_work_ == dwork) {
+      instances_[i]->send_next();
+      return;
+    }
+  }
+  LOG_ERR("No remote for command work!");
+}
+
+void SonyRemote::send_next() {
+  if (write_in_flight_) {
+    // the write completion schedules the next command
+    return;
+  }
+  waiting_type_ = 0;
+  if (k_msgq_get(&cmd_q_, &current_, K_NO_WAIT) != 0) {
     return;
   }
 
+  write_in_flight_ = true;
+  if (current_.group) {
+    // held back until the group fires
+    current_.group->arrive(this);
+    return;
+  }
+  int err = write_cmd(current_.data, current_.len);
+  if (err) {
+    LOG_ERR("GATT write failed (%d)", err);
+    finish_cmd(err);
+  }
+}
+
+int SonyRemote::write_cmd(const uint8_t *buf, size_t len) {
   if (!conn_ || ff01_handle_ == 0) {
     LOG_ERR("No connection or handle for sending command");
-    return;
+    return -ENOTCONN;
   }
 
   // Log the command being sent
@@ -455,20 +1083,15 @@ void SonyRemote::send_cmd(const uint8_t *buf, size_t len) {
     LOG_DBG("  [%d]: 0x%02x", i, buf[i]);
   }
 
-  // Ensure command fits in our buffer
-  if (len > sizeof(write_buffer_)) {
-    LOG_ERR("Command too large (%d bytes, max %d)", len, sizeof(write_buffer_));
-    return;
-  }
-
-  int err;
   if (ff01_properties_ & BT_GATT_CHRC_WRITE_WITHOUT_RESP) {
     LOG_DBG("Using Write Without Response");
-    err = bt_gatt_write_without_response(conn_, ff01_handle_, buf, len, false);
+    return bt_gatt_write_without_response_cb(conn_, ff01_handle_, buf, len,
+                                             false, SonyRemote::on_write_sent,
+                                             nullptr);
   } else if (ff01_properties_ & BT_GATT_CHRC_WRITE) {
     LOG_DBG("Using Write (with Response)");
 
-    // Copy data to our persistent buffer
+    // Copy data to our persistent buffer, only one write is in flight
     memcpy(write_buffer_, buf, len);
 
     // Set up write parameters for bt_gatt_write using member variable
@@ -478,17 +1101,65 @@ void SonyRemote::send_cmd(const uint8_t *buf, size_t len) {
     write_params_.data = write_buffer_;
     write_params_.length = len;
 
-    err = bt_gatt_write(conn_, &write_params_);
-  } else {
-    LOG_ERR("FF01 characteristic doesn't support write operations");
+    return bt_gatt_write(conn_, &write_params_);
+  }
+
+  LOG_ERR("FF01 characteristic doesn't support write operations");
+  return -ENOTSUP;
+}
+
+// Report the current command and schedule the next one after its gap
+void SonyRemote::finish_cmd(int err) {
+  if (!write_in_flight_) {
     return;
   }
+  write_in_flight_ = false;
+  if (!err && current_.len == sizeof(SHUTTER_DOWN) &&
+      memcmp(current_.data, SHUTTER_DOWN, sizeof(SHUTTER_DOWN)) == 0) {
+    struct bt_conn_info info;
+    uint32_t interval_us = 0;
+    if (conn_ && bt_conn_get_info(conn_, &info) == 0) {
+      interval_us = BT_CONN_INTERVAL_TO_US(info.le.interval);
+    }
+    LOG_INF("Shutter written %u us after shoot (interval %u us)",
+            k_cyc_to_us_floor32(k_cycle_get_32() - shoot_start_cycles_),
+            interval_us);
+  }
+  if (current_.group) {
+    if (err) {
+      current_.group->leave(this);
+    } else {
+      current_.group->sent(this);
+    }
+  }
+  if (current_.done) {
+    current_.done(err, current_.user_data);
+  }
 
-  if (err) {
-    LOG_ERR("GATT write failed (%d)", err);
-  } else {
-    LOG_DBG("Command sent successfully to handle 0x%04x", ff01_handle_);
+  k_timeout_t gap = K_NO_WAIT;
+  if (current_.gap_ms > 0 &&
+      !status_reached(current_.wait_type, current_.wait_value)) {
+    waiting_type_ = current_.wait_type;
+    waiting_value_ = current_.wait_value;
+    gap = K_MSEC(current_.gap_ms);
+  }
+  k_work_reschedule_for_queue(&sony_remote_workq, &cmd_work_, gap);
+}
+
+void SonyRemote::flush_commands(int err) {
+  k_work_cancel_delayable(&cmd_work_);
+  finish_cmd(err);
+  command cmd;
+  while (k_msgq_get(&cmd_q_, &cmd, K_NO_WAIT) == 0) {
+    if (cmd.group) {
+      cmd.group->leave(this);
+    }
+    if (cmd.done) {
+      cmd.done(err, cmd.user_data);
+    }
   }
+  k_work_cancel_delayable(&cmd_work_);
+  waiting_type_ = 0;
 }
 
 void SonyRemote::on_write_complete(bt_conn *conn, uint8_t err,
@@ -498,16 +1169,40 @@ void SonyRemote::on_write_complete(bt_conn *conn, uint8_t err,
   } else {
     LOG_DBG("GATT write completed successfully");
   }
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    return;
+  }
+  self->finish_cmd(err ? -EIO : 0);
+  if (err == BT_ATT_ERR_INVALID_HANDLE) {
+    // Cached handles are stale, e.g. after a firmware update of the camera
+    LOG_WRN("FF01 handle invalid, rediscovering");
+    self->forget_handles();
+    self->ff01_handle_ = 0;
+    self->ff02_handle_ = 0;
+    self->ff02_ccc_handle_ = 0;
+    k_work_schedule(&self->discovery_work_, K_NO_WAIT);
+  }
 }
 
-void SonyRemote::discovery_work_handler(struct k_work *work) {
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL in discovery_work_handler!");
-    return;
+void SonyRemote::on_write_sent(bt_conn *conn, void *user_data) {
+  LOG_DBG("GATT write without response sent");
+  SonyRemote *self = from_conn(conn);
+  if (self) {
+    self->finish_cmd(0);
   }
+}
 
-  LOG_INF("Starting delayed service discovery...");
-  self_->start_discovery();
+void SonyRemote::discovery_work_handler(struct k_work *work) {
+  struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+  for (size_t i = 0; i < num_instances_; i++) {
+    SonyRemote *self = instances_[i];
+    if (&self->discovery_work_ == dwork && self->conn_) {
+      LOG_INF("Starting delayed service discovery...");
+      self->start_discovery();
+      return;
+    }
+  }
 }
 
 void SonyRemote::on_security_changed(bt_conn *conn, bt_security_t level,
@@ -520,8 +1215,9 @@ void SonyRemote::on_security_changed(bt_conn *conn, bt_security_t level,
     return;
   }
 
-  if (!self_) {
-    LOG_ERR("self_ pointer is NULL in on_security_changed!");
+  SonyRemote *self = from_conn(conn);
+  if (!self) {
+    LOG_ERR("No remote for security change!");
     return;
   }
 
@@ -530,13 +1226,13 @@ void SonyRemote::on_security_changed(bt_conn *conn, bt_security_t level,
 
   if (err) {
     LOG_ERR("Security failed: %s level %u err %d", addr_str, level, err);
-    self_->is_paired_ = false;
+    self->is_paired_ = false;
   } else {
     LOG_INF("Security changed: %s level %u", addr_str, level);
     if (level >= BT_SECURITY_L2) {
       LOG_INF("Pairing successful! Starting service discovery...");
-      self_->is_paired_ = true;
-      self_->start_discovery();
+      self->is_paired_ = true;
+      self->start_discovery();
     }
   }
 }
@@ -616,4 +1312,291 @@ enum bt_security_err SonyRemote::auth_pairing_confirm(struct bt_conn *conn) {
   LOG_INF("Confirm pairing for %s", addr);
   // Auto-accept pairing
   return BT_SECURITY_ERR_SUCCESS;
-}
\ No newline at end of file
+}
+int SonyRemoteGroup::add(SonyRemote *remote) {
+  if (remote->group_) {
+    return -EALREADY;
+  }
+  if (count_ >= SonyRemote::MAX_CAMERAS) {
+    return -ENOMEM;
+  }
+  if (!initialized_) {
+    k_poll_signal_init(&capture_signal_);
+    k_work_init(&fire_work_, fire_work_handler);
+    initialized_ = true;
+  }
+  members_[count_++] = remote;
+  remote->group_ = this;
+  return 0;
+}
+
+int SonyRemoteGroup::index_of(const SonyRemote *remote) const {
+  for (size_t i = 0; i < count_; i++) {
+    if (members_[i] == remote) {
+      return i;
+    }
+  }
+  return -ENOENT;
+}
+
+bool SonyRemoteGroup::ready() const {
+  for (size_t i = 0; i < count_; i++) {
+    if (members_[i]->ready()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int SonyRemoteGroup::shoot(sony_remote_done_cb_t done, void *user_data) {
+  k_spinlock_key_t key = k_spin_lock(&lock_);
+  if (pending_ > 0) {
+    k_spin_unlock(&lock_, key);
+    return -EBUSY;
+  }
+  size_t ready = 0;
+  for (size_t i = 0; i < count_; i++) {
+    state_[i] = members_[i]->ready() ? Member::QUEUED : Member::IDLE;
+    sent_cycles_[i] = 0;
+    reported_cycles_[i] = 0;
+    if (state_[i] == Member::QUEUED) {
+      if (k_msgq_num_free_get(&members_[i]->cmd_q_) < 4) {
+        k_spin_unlock(&lock_, key);
+        return -ENOBUFS;
+      }
+      ready++;
+    }
+  }
+  if (ready == 0) {
+    k_spin_unlock(&lock_, key);
+    return -ENOTCONN;
+  }
+  waiting_ = ready;
+  pending_ = ready;
+  capturing_ = 0;
+  err_ = 0;
+  done_ = done;
+  done_user_data_ = user_data;
+  k_poll_signal_reset(&capture_signal_);
+  k_spin_unlock(&lock_, key);
+
+  for (size_t i = 0; i < count_; i++) {
+    if (state_[i] != Member::QUEUED) {
+      continue;
+    }
+    int err = members_[i]->queue_shoot(member_done, this, this);
+    if (err) {
+      LOG_WRN("Camera %u left the group shot (%d)", i, err);
+      leave(members_[i]);
+      member_done(err, this);
+    } else if (members_[i]->capture_pending_) {
+      capturing_++;
+    }
+  }
+  return 0;
+}
+
+// A member's shutter press is up, fire once every queued member is
+void SonyRemoteGroup::arrive(SonyRemote *remote) {
+  int index = index_of(remote);
+  k_spinlock_key_t key = k_spin_lock(&lock_);
+  if (index < 0 || state_[index] != Member::QUEUED) {
+    k_spin_unlock(&lock_, key);
+    return;
+  }
+  state_[index] = Member::ARMED;
+  bool fire_now = --waiting_ == 0;
+  k_spin_unlock(&lock_, key);
+  if (fire_now) {
+    fire();
+  }
+}
+
+// A member will not reach the barrier, e.g. it disconnected. May run in the
+// Bluetooth stack, so the others are fired from the work queue.
+void SonyRemoteGroup::leave(SonyRemote *remote) {
+  int index = index_of(remote);
+  k_spinlock_key_t key = k_spin_lock(&lock_);
+  if (index < 0 || state_[index] == Member::IDLE) {
+    k_spin_unlock(&lock_, key);
+    return;
+  }
+  bool was_queued = state_[index] == Member::QUEUED;
+  state_[index] = Member::IDLE;
+  bool fire_now = was_queued && --waiting_ == 0;
+  k_spin_unlock(&lock_, key);
+  if (fire_now) {
+    k_work_submit_to_queue(&sony_remote_workq, &fire_work_);
+  }
+}
+
+void SonyRemoteGroup::fire_work_handler(struct k_work *work) {
+  CONTAINER_OF(work, SonyRemoteGroup, fire_work_)->fire();
+}
+
+// Issue the held back shutter presses back to back. Runs on the remotes'
+// work queue like every other write.
+void SonyRemoteGroup::fire() {
+  fire_cycles_ = k_cycle_get_32();
+  for (size_t i = 0; i < count_; i++) {
+    if (state_[i] != Member::ARMED) {
+      continue;
+    }
+    state_[i] = Member::FIRED;
+    SonyRemote *remote = members_[i];
+    remote->shoot_start_cycles_ = fire_cycles_;
+    int err = remote->write_cmd(remote->current_.data, remote->current_.len);
+    if (err) {
+      LOG_ERR("Group shutter write to camera %u failed (%d)", i, err);
+      remote->finish_cmd(err);
+    }
+  }
+}
+
+void SonyRemoteGroup::sent(SonyRemote *remote) {
+  int index = index_of(remote);
+  if (index >= 0) {
+    sent_cycles_[index] = k_cycle_get_32();
+  }
+}
+
+void SonyRemoteGroup::reported(SonyRemote *remote) {
+  int index = index_of(remote);
+  if (index >= 0 && state_[index] == Member::FIRED &&
+      reported_cycles_[index] == 0) {
+    reported_cycles_[index] = k_cycle_get_32();
+  }
+}
+
+void SonyRemoteGroup::captured(SonyRemote *remote) {
+  k_spinlock_key_t key = k_spin_lock(&lock_);
+  bool all = capturing_ > 0 && --capturing_ == 0;
+  k_spin_unlock(&lock_, key);
+  if (all) {
+    k_poll_signal_raise(&capture_signal_, 0);
+  }
+}
+
+// Shutter release written to one member
+void SonyRemoteGroup::member_done(int err, void *user_data) {
+  auto *group = static_cast<SonyRemoteGroup *>(user_data);
+  k_spinlock_key_t key = k_spin_lock(&group->lock_);
+  if (err && !group->err_) {
+    group->err_ = err;
+  }
+  bool last = group->pending_ > 0 && --group->pending_ == 0;
+  k_spin_unlock(&group->lock_, key);
+  if (!last) {
+    return;
+  }
+  group->log_skew();
+  if (group->done_) {
+    group->done_(group->err_, group->done_user_data_);
+  }
+}
+
+uint32_t SonyRemoteGroup::pendingCommands() {
+  uint32_t pending = 0;
+  for (size_t i = 0; i < count_; i++) {
+    pending += members_[i]->pendingCommands();
+  }
+  return pending;
+}
+
+void SonyRemoteGroup::setCaptureProfile(CaptureProfile profile) {
+  for (size_t i = 0; i < count_; i++) {
+    members_[i]->setCaptureProfile(profile);
+  }
+}
+
+int SonyRemoteGroup::beginSeries() {
+  int ret = 0;
+  for (size_t i = 0; i < count_; i++) {
+    if (members_[i]->ready()) {
+      int err = members_[i]->beginSeries();
+      ret = ret ? ret : err;
+    }
+  }
+  return ret;
+}
+
+int SonyRemoteGroup::endSeries() {
+  int ret = 0;
+  for (size_t i = 0; i < count_; i++) {
+    int err = members_[i]->endSeries();
+    ret = ret ? ret : err;
+  }
+  return ret;
+}
+
+int SonyRemoteGroup::setLowLatency(bool enable) {
+  int ret = 0;
+  for (size_t i = 0; i < count_; i++) {
+    int err = members_[i]->setLowLatency(enable);
+    ret = ret ? ret : err;
+  }
+  return ret;
+}
+
+struct k_poll_signal *SonyRemoteGroup::captureSignal() {
+  for (size_t i = 0; i < count_; i++) {
+    if (members_[i]->ready() && !members_[i]->hasStatus()) {
+      return nullptr;
+    }
+  }
+  return &capture_signal_;
+}
+
+uint32_t SonyRemoteGroup::sentUs(size_t index) const {
+  if (index >= count_ || sent_cycles_[index] == 0) {
+    return UINT32_MAX;
+  }
+  return k_cyc_to_us_floor32(sent_cycles_[index] - fire_cycles_);
+}
+
+uint32_t SonyRemoteGroup::reportedUs(size_t index) const {
+  if (index >= count_ || reported_cycles_[index] == 0) {
+    return UINT32_MAX;
+  }
+  return k_cyc_to_us_floor32(reported_cycles_[index] - fire_cycles_);
+}
+
+// Spread of @p us over the members that have a value
+static uint32_t spread_us(const SonyRemoteGroup *group,
+                          uint32_t (SonyRemoteGroup::*us)(size_t) const) {
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+  for (size_t i = 0; i < group->size(); i++) {
+    uint32_t value = (group->*us)(i);
+    if (value == UINT32_MAX) {
+      continue;
+    }
+    min = MIN(min, value);
+    max = MAX(max, value);
+  }
+  return min == UINT32_MAX ? 0 : max - min;
+}
+
+uint32_t SonyRemoteGroup::sentSkewUs() const {
+  return spread_us(this, &SonyRemoteGroup::sentUs);
+}
+
+uint32_t SonyRemoteGroup::reportedSkewUs() const {
+  return spread_us(this, &SonyRemoteGroup::reportedUs);
+}
+
+void SonyRemoteGroup::log_skew() const {
+  for (size_t i = 0; i < count_; i++) {
+    if (sentUs(i) == UINT32_MAX) {
+      continue;
+    }
+    if (reportedUs(i) == UINT32_MAX) {
+      LOG_INF("Camera %u: shutter sent +%u us", i, sentUs(i));
+    } else {
+      LOG_INF("Camera %u: shutter sent +%u us, reported +%u us", i, sentUs(i),
+              reportedUs(i));
+    }
+  }
+  LOG_INF("Group skew: sent %u us, reported %u us", sentSkewUs(),
+          reportedSkewUs());
+}
@@ -6,14 +6,23 @@
 
 #define DT_DRV_COMPAT simple_stepper
 
+#include <stdlib.h>
+#include <string.h>
+#ifdef CONFIG_SIMPLE_STEPPER_COUNTER_TIMING
+#include <zephyr/drivers/counter.h>
+#endif
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/stepper.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#include <stepper_with_target/simple_stepper.h>
+
 /* Use Zephyr's step_dir common infrastructure */
 #include "../../../zephyr/drivers/stepper/step_dir/step_dir_stepper_common.h"
 
+#include "simple_stepper_ramp.h"
+
 LOG_MODULE_REGISTER(simple_stepper, CONFIG_STEPPER_LOG_LEVEL);
 
 /**
@@ -23,6 +32,9 @@ struct simple_stepper_config {
   struct step_dir_stepper_common_config common;
   struct gpio_dt_spec en_pin;
   bool invert_pins;
+  uint32_t acceleration;
+  uint32_t jerk;
+  const struct device *step_counter;
 };
 
 /**
@@ -31,6 +43,24 @@ struct simple_stepper_config {
 struct simple_stepper_data {
   struct step_dir_stepper_common_data common;
   bool enabled;
+  struct simple_stepper_ramp ramp;
+  /* target to head for once braking for a reversal has finished */
+  bool retarget_pending;
+  int32_t retarget_position;
+  /* one-shot callback once the stepper passes trigger_position */
+  simple_stepper_position_cb_t trigger_cb;
+  void *trigger_user_data;
+  int32_t trigger_position;
+#ifdef CONFIG_SIMPLE_STEPPER_COUNTER_TIMING
+  struct counter_top_cfg counter_top_cfg;
+  /* a microstep was shorter than one counter tick, warned once */
+  bool counter_too_slow;
+#endif
+#ifdef CONFIG_SIMPLE_STEPPER_TIMING_STATS
+  struct simple_stepper_timing_stats timing_stats;
+  uint32_t last_step_cycles;
+  bool timing_armed;
+#endif
 };
 
 /* Verify that common structs are first in our extended structs */
@@ -63,10 +93,94 @@ static inline int simple_stepper_perform_step(const struct device *dev) {
   return 0;
 }
 
+/* Hand the interval of the next step to the timing source */
+static void simple_stepper_apply_interval(const struct device *dev,
+                                          uint64_t interval_ns) {
+  const struct simple_stepper_config *config = dev->config;
+  struct simple_stepper_data *data = dev->data;
+
+  if (interval_ns == data->common.microstep_interval_ns) {
+    return;
+  }
+  data->common.microstep_interval_ns = interval_ns;
+  (void)config->common.timing_source->update(dev, interval_ns);
+}
+
+#ifdef CONFIG_SIMPLE_STEPPER_TIMING_STATS
+/* Compare the time since the previous step with the interval it was scheduled
+ * for. The first step of a move is skipped, it has no previous step. */
+static void simple_stepper_record_timing(struct simple_stepper_data *data) {
+  const uint32_t now = k_cycle_get_32();
+
+  K_SPINLOCK(&data->common.lock) {
+    struct simple_stepper_timing_stats *stats = &data->timing_stats;
+
+    if (data->timing_armed) {
+      const int64_t actual_ns =
+          (int64_t)k_cyc_to_ns_floor64(now - data->last_step_cycles);
+      const int64_t error =
+          CLAMP(actual_ns - (int64_t)data->common.microstep_interval_ns,
+                INT32_MIN, INT32_MAX);
+
+      if (stats->steps == 0) {
+        stats->min_error_ns = (int32_t)error;
+        stats->max_error_ns = (int32_t)error;
+      } else {
+        stats->min_error_ns = MIN(stats->min_error_ns, (int32_t)error);
+        stats->max_error_ns = MAX(stats->max_error_ns, (int32_t)error);
+      }
+      stats->abs_error_sum_ns += (uint64_t)(error < 0 ? -error : error);
+      stats->steps++;
+    }
+    data->last_step_cycles = now;
+    data->timing_armed = true;
+  }
+}
+
+static inline void
+simple_stepper_disarm_timing(struct simple_stepper_data *data) {
+  data->timing_armed = false;
+}
+#else
+static inline void
+simple_stepper_record_timing(struct simple_stepper_data *data) {
+  ARG_UNUSED(data);
+}
+
+static inline void
+simple_stepper_disarm_timing(struct simple_stepper_data *data) {
+  ARG_UNUSED(data);
+}
+#endif /* CONFIG_SIMPLE_STEPPER_TIMING_STATS */
+
+/* Fire the position trigger once the step just taken reached or passed it */
+static void simple_stepper_check_position_trigger(const struct device *dev) {
+  struct simple_stepper_data *data = dev->data;
+  const simple_stepper_position_cb_t cb = data->trigger_cb;
+
+  if (cb == NULL) {
+    return;
+  }
+
+  const int32_t position = (int32_t)atomic_get(&data->common.actual_position);
+  const bool reached = data->common.direction == STEPPER_DIRECTION_POSITIVE
+                           ? position >= data->trigger_position
+                           : position <= data->trigger_position;
+  if (!reached) {
+    return;
+  }
+
+  /* One-shot, the callback may arm the next position */
+  data->trigger_cb = NULL;
+  cb(dev, position, data->trigger_user_data);
+}
+
 /* Custom timing signal handler that uses our step function with delay */
 static void simple_stepper_handle_timing_signal(const struct device *dev) {
   struct simple_stepper_data *data = dev->data;
 
+  simple_stepper_record_timing(data);
+
   /* Use our custom step function instead of the default one */
   (void)simple_stepper_perform_step(dev);
 
@@ -77,6 +191,8 @@ static void simple_stepper_handle_timing_signal(const struct device *dev) {
     atomic_dec(&data->common.actual_position);
   }
 
+  simple_stepper_check_position_trigger(dev);
+
   /* Decrement step count if in position mode */
   if (data->common.run_mode == STEPPER_RUN_MODE_POSITION) {
     if (atomic_get(&data->common.step_count) > 0) {
@@ -90,16 +206,41 @@ static void simple_stepper_handle_timing_signal(const struct device *dev) {
   const struct simple_stepper_config *config = dev->config;
 
   switch (data->common.run_mode) {
-  case STEPPER_RUN_MODE_POSITION:
-    if (config->common.timing_source->needs_reschedule(dev) &&
-        atomic_get(&data->common.step_count) != 0) {
-      (void)config->common.timing_source->start(dev);
-    } else if (atomic_get(&data->common.step_count) == 0) {
+  case STEPPER_RUN_MODE_POSITION: {
+    const atomic_val_t step_count = atomic_get(&data->common.step_count);
+    if (step_count == 0 && data->retarget_pending) {
+      const int32_t delta =
+          data->retarget_position -
+          (int32_t)atomic_get(&data->common.actual_position);
+
+      data->retarget_pending = false;
+      if (delta != 0) {
+        /* Braked to (nearly) a standstill, start over towards the target */
+        simple_stepper_ramp_reset(&data->ramp);
+        data->common.microstep_interval_ns = simple_stepper_ramp_next_interval(
+            &data->ramp, (uint32_t)abs(delta) - 1);
+        (void)step_dir_stepper_common_move_by(dev, delta);
+        break;
+      }
+    }
+    if (step_count == 0) {
+      simple_stepper_ramp_reset(&data->ramp);
       stepper_trigger_callback(dev, STEPPER_EVENT_STEPS_COMPLETED);
       config->common.timing_source->stop(dev);
+      break;
+    }
+    simple_stepper_apply_interval(
+        dev, simple_stepper_ramp_next_interval(
+                 &data->ramp, (uint32_t)abs((int32_t)step_count) - 1));
+    if (config->common.timing_source->needs_reschedule(dev)) {
+      (void)config->common.timing_source->start(dev);
     }
     break;
+  }
   case STEPPER_RUN_MODE_VELOCITY:
+    simple_stepper_apply_interval(
+        dev, simple_stepper_ramp_next_interval(&data->ramp,
+                                               SIMPLE_STEPPER_RAMP_UNBOUNDED));
     if (config->common.timing_source->needs_reschedule(dev)) {
       (void)config->common.timing_source->start(dev);
     }
@@ -119,6 +260,113 @@ static void simple_stepper_work_handler(struct k_work *work) {
   simple_stepper_handle_timing_signal(data->common.dev);
 }
 
+#ifdef CONFIG_SIMPLE_STEPPER_COUNTER_TIMING
+/* Counter top interrupt, steps straight from the ISR */
+static void simple_stepper_counter_top_isr(const struct device *counter,
+                                           void *user_data) {
+  ARG_UNUSED(counter);
+
+  simple_stepper_handle_timing_signal((const struct device *)user_data);
+}
+
+static int simple_stepper_counter_init(const struct device *dev) {
+  const struct simple_stepper_config *config = dev->config;
+  struct simple_stepper_data *data = dev->data;
+
+  if (!device_is_ready(config->step_counter)) {
+    LOG_ERR("Step counter device is not ready");
+    return -ENODEV;
+  }
+
+  data->counter_top_cfg.callback = simple_stepper_counter_top_isr;
+  data->counter_top_cfg.user_data = (void *)dev;
+  data->counter_top_cfg.flags = 0;
+  data->counter_top_cfg.ticks =
+      counter_us_to_ticks(config->step_counter, USEC_PER_SEC);
+
+  return 0;
+}
+
+static int simple_stepper_counter_update(const struct device *dev,
+                                         const uint64_t microstep_interval_ns) {
+  const struct simple_stepper_config *config = dev->config;
+  struct simple_stepper_data *data = dev->data;
+  int ret;
+
+  if (microstep_interval_ns == 0) {
+    return -EINVAL;
+  }
+
+  const uint32_t frequency = counter_get_frequency(config->step_counter);
+  const uint64_t ticks =
+      DIV_ROUND_UP((uint64_t)frequency * microstep_interval_ns, NSEC_PER_SEC);
+  if ((uint64_t)frequency * microstep_interval_ns < NSEC_PER_SEC &&
+      !data->counter_too_slow) {
+    /* Stepped once per tick instead, slower than commanded */
+    data->counter_too_slow = true;
+    LOG_WRN("%s: %llu ns per microstep is below one tick of %s at %u Hz",
+            dev->name, (unsigned long long)microstep_interval_ns,
+            config->step_counter->name, frequency);
+  }
+  data->counter_top_cfg.ticks = (uint32_t)CLAMP(
+      ticks, 1, counter_get_max_top_value(config->step_counter));
+
+  /* Called from the top interrupt for every ramp step, resetting the counter
+   * there starts the next interval right at this step */
+  ret = counter_set_top_value(config->step_counter, &data->counter_top_cfg);
+  if (ret != 0) {
+    LOG_ERR("%s: Failed to set counter top value (error: %d)", dev->name,
+            ret);
+    return ret;
+  }
+
+  return 0;
+}
+
+static int simple_stepper_counter_start(const struct device *dev) {
+  const struct simple_stepper_config *config = dev->config;
+  int ret;
+
+  ret = counter_start(config->step_counter);
+  if (ret != 0 && ret != -EALREADY) {
+    LOG_ERR("%s: Failed to start counter (error: %d)", dev->name, ret);
+    return ret;
+  }
+
+  return 0;
+}
+
+static bool simple_stepper_counter_needs_reschedule(const struct device *dev) {
+  ARG_UNUSED(dev);
+
+  /* The counter keeps firing on its own */
+  return false;
+}
+
+static int simple_stepper_counter_stop(const struct device *dev) {
+  const struct simple_stepper_config *config = dev->config;
+  int ret;
+
+  ret = counter_stop(config->step_counter);
+  if (ret != 0) {
+    LOG_ERR("%s: Failed to stop counter (error: %d)", dev->name, ret);
+    return ret;
+  }
+
+  return 0;
+}
+
+/* Timing source for nodes with a step-counter, replaces the work queue */
+static const struct stepper_timing_source_api
+    simple_stepper_counter_timing_source_api = {
+        .init = simple_stepper_counter_init,
+        .update = simple_stepper_counter_update,
+        .start = simple_stepper_counter_start,
+        .needs_reschedule = simple_stepper_counter_needs_reschedule,
+        .stop = simple_stepper_counter_stop,
+};
+#endif /* CONFIG_SIMPLE_STEPPER_COUNTER_TIMING */
+
 static int simple_stepper_enable(const struct device *dev) {
   const struct simple_stepper_config *config = dev->config;
   struct simple_stepper_data *data = dev->data;
@@ -174,13 +422,67 @@ static int simple_stepper_disable(const struct device *dev) {
   return 0;
 }
 
+/* Move the end point of a ramped move in progress without stopping. If the new
+ * target is behind the point where the stepper can come to rest, brake first
+ * and head for the target from there. Called with the lock held. */
+static void simple_stepper_retarget(const struct device *dev,
+                                    int32_t micro_steps) {
+  struct simple_stepper_data *data = dev->data;
+  const int32_t sign =
+      data->common.direction == STEPPER_DIRECTION_POSITIVE ? 1 : -1;
+  const int32_t braking_steps =
+      (int32_t)MAX(simple_stepper_ramp_braking_steps(&data->ramp), 1);
+
+  if (micro_steps * sign >= braking_steps) {
+    data->retarget_pending = false;
+    atomic_set(&data->common.step_count, micro_steps);
+    return;
+  }
+
+  data->retarget_position =
+      (int32_t)atomic_get(&data->common.actual_position) + micro_steps;
+  data->retarget_pending = true;
+  atomic_set(&data->common.step_count, sign * braking_steps);
+}
+
 static int simple_stepper_move_by(const struct device *dev,
                                   int32_t micro_steps) {
+  struct simple_stepper_data *data = dev->data;
+  bool retargeted = false;
+
+  if (data->ramp.cruise_interval_ns == 0) {
+    LOG_ERR("Step interval not set");
+    return -EINVAL;
+  }
+
+  K_SPINLOCK(&data->common.lock) {
+    if (simple_stepper_ramp_enabled(&data->ramp) &&
+        !simple_stepper_ramp_is_idle(&data->ramp) &&
+        data->common.run_mode == STEPPER_RUN_MODE_POSITION) {
+      simple_stepper_retarget(dev, micro_steps);
+      retargeted = true;
+    } else {
+      /* From standstill, the common code picks up the interval of the first
+       * step */
+      data->retarget_pending = false;
+      simple_stepper_ramp_reset(&data->ramp);
+      simple_stepper_disarm_timing(data);
+      data->common.microstep_interval_ns = simple_stepper_ramp_next_interval(
+          &data->ramp, (uint32_t)abs(micro_steps) - 1);
+    }
+  }
+
+  if (retargeted) {
+    return 0;
+  }
   return step_dir_stepper_common_move_by(dev, micro_steps);
 }
 
 static int simple_stepper_move_to(const struct device *dev, int32_t value) {
-  return step_dir_stepper_common_move_to(dev, value);
+  struct simple_stepper_data *data = dev->data;
+
+  return simple_stepper_move_by(
+      dev, value - (int32_t)atomic_get(&data->common.actual_position));
 }
 
 static int simple_stepper_set_reference_position(const struct device *dev,
@@ -207,16 +509,102 @@ static int simple_stepper_set_event_callback(const struct device *dev,
 static int
 simple_stepper_set_microstep_interval(const struct device *dev,
                                       uint64_t microstep_interval_ns) {
+  struct simple_stepper_data *data = dev->data;
+
+  if (microstep_interval_ns == 0) {
+    LOG_ERR("Step interval cannot be zero");
+    return -EINVAL;
+  }
+
+  K_SPINLOCK(&data->common.lock) {
+    simple_stepper_ramp_set_cruise(&data->ramp, microstep_interval_ns);
+  }
+
+  /* While ramping, the planner moves towards the new cruise interval itself */
+  if (simple_stepper_ramp_enabled(&data->ramp) &&
+      !simple_stepper_ramp_is_idle(&data->ramp)) {
+    return 0;
+  }
+
   return step_dir_stepper_common_set_microstep_interval(dev,
                                                         microstep_interval_ns);
 }
 
+int simple_stepper_set_motion_limits(const struct device *dev, uint32_t accel,
+                                     uint32_t jerk) {
+  struct simple_stepper_data *data = dev->data;
+
+  K_SPINLOCK(&data->common.lock) {
+    simple_stepper_ramp_set_limits(&data->ramp, accel, jerk);
+  }
+  LOG_DBG("Motion limits: accel=%u steps/s^2, jerk=%u steps/s^3", accel, jerk);
+
+  return 0;
+}
+
+int simple_stepper_get_motion_limits(const struct device *dev, uint32_t *accel,
+                                     uint32_t *jerk) {
+  struct simple_stepper_data *data = dev->data;
+
+  *accel = data->ramp.accel;
+  *jerk = data->ramp.jerk;
+
+  return 0;
+}
+
+int simple_stepper_set_position_trigger(const struct device *dev,
+                                        int32_t position,
+                                        simple_stepper_position_cb_t cb,
+                                        void *user_data) {
+  struct simple_stepper_data *data = dev->data;
+
+  K_SPINLOCK(&data->common.lock) {
+    data->trigger_position = position;
+    data->trigger_user_data = user_data;
+    data->trigger_cb = cb;
+  }
+
+  return 0;
+}
+
+int simple_stepper_get_timing_stats(const struct device *dev,
+                                    struct simple_stepper_timing_stats *stats) {
+#ifdef CONFIG_SIMPLE_STEPPER_TIMING_STATS
+  struct simple_stepper_data *data = dev->data;
+
+  K_SPINLOCK(&data->common.lock) { *stats = data->timing_stats; }
+
+  return 0;
+#else
+  ARG_UNUSED(dev);
+  ARG_UNUSED(stats);
+
+  return -ENOTSUP;
+#endif
+}
+
+int simple_stepper_reset_timing_stats(const struct device *dev) {
+#ifdef CONFIG_SIMPLE_STEPPER_TIMING_STATS
+  struct simple_stepper_data *data = dev->data;
+
+  K_SPINLOCK(&data->common.lock) {
+    memset(&data->timing_stats, 0, sizeof(data->timing_stats));
+  }
+
+  return 0;
+#else
+  ARG_UNUSED(dev);
+
+  return -ENOTSUP;
+#endif
+}
+
 static int simple_stepper_run(const struct device *dev,
                               enum stepper_direction direction) {
   struct simple_stepper_data *data = dev->data;
   const struct simple_stepper_config *config = dev->config;
 
-  if (data->common.microstep_interval_ns == 0) {
+  if (data->ramp.cruise_interval_ns == 0) {
     LOG_ERR("Step interval not set");
     return -EINVAL;
   }
@@ -224,6 +612,11 @@ static int simple_stepper_run(const struct device *dev,
   K_SPINLOCK(&data->common.lock) {
     data->common.run_mode = STEPPER_RUN_MODE_VELOCITY;
     data->common.direction = direction;
+    data->retarget_pending = false;
+    simple_stepper_ramp_reset(&data->ramp);
+    simple_stepper_disarm_timing(data);
+    data->common.microstep_interval_ns = simple_stepper_ramp_next_interval(
+        &data->ramp, SIMPLE_STEPPER_RAMP_UNBOUNDED);
     config->common.timing_source->update(dev,
                                          data->common.microstep_interval_ns);
     config->common.timing_source->start(dev);
@@ -239,6 +632,9 @@ static int simple_stepper_stop(const struct device *dev) {
   K_SPINLOCK(&data->common.lock) {
     config->common.timing_source->stop(dev);
     data->common.run_mode = STEPPER_RUN_MODE_HOLD;
+    data->retarget_pending = false;
+    simple_stepper_ramp_reset(&data->ramp);
+    simple_stepper_disarm_timing(data);
   }
 
   return 0;
@@ -259,6 +655,9 @@ static int simple_stepper_init(const struct device *dev) {
     return ret;
   }
 
+  simple_stepper_ramp_set_limits(&data->ramp, config->acceleration,
+                                 config->jerk);
+
   /* Override the work handler to use our custom timing signal handler */
   k_work_init_delayable(&data->common.stepper_dwork,
                         simple_stepper_work_handler);
@@ -292,7 +691,10 @@ static int simple_stepper_init(const struct device *dev) {
     data->enabled = true;
   }
 
-  LOG_INF("Simple stepper initialized");
+  LOG_INF("Simple stepper initialized (accel=%u steps/s^2, jerk=%u "
+          "steps/s^3, timing=%s)",
+          config->acceleration, config->jerk,
+          config->step_counter ? config->step_counter->name : "workqueue");
 
   return 0;
 }
@@ -311,6 +713,15 @@ static const struct stepper_driver_api simple_stepper_api = {
     .stop = simple_stepper_stop,
 };
 
+#ifdef CONFIG_SIMPLE_STEPPER_COUNTER_TIMING
+#define SIMPLE_STEPPER_TIMING_SOURCE(inst)                                     \
+  COND_CODE_1(DT_INST_NODE_HAS_PROP(inst, step_counter),                       \
+              (&simple_stepper_counter_timing_source_api),                     \
+              (&step_work_timing_source_api))
+#else
+#define SIMPLE_STEPPER_TIMING_SOURCE(inst) (&step_work_timing_source_api)
+#endif
+
 /* Device instantiation macro */
 #define SIMPLE_STEPPER_DEVICE(inst)                                            \
   static struct simple_stepper_data simple_stepper_data_##inst = {             \
@@ -319,8 +730,15 @@ static const struct stepper_driver_api simple_stepper_api = {
                                                                                \
   static const struct simple_stepper_config simple_stepper_config_##inst = {   \
       .common = STEP_DIR_STEPPER_DT_INST_COMMON_CONFIG_INIT(inst),             \
+      /* Our timing sources dispatch to simple_stepper_handle_timing_signal */ \
+      .common.timing_source = SIMPLE_STEPPER_TIMING_SOURCE(inst),              \
       .en_pin = GPIO_DT_SPEC_INST_GET_OR(inst, en_gpios, {0}),                 \
       .invert_pins = DT_INST_PROP(inst, invert_pins),                          \
+      .acceleration = DT_INST_PROP(inst, acceleration),                        \
+      .jerk = DT_INST_PROP(inst, jerk),                                        \
+      .step_counter = COND_CODE_1(                                             \
+          DT_INST_NODE_HAS_PROP(inst, step_counter),                           \
+          (DEVICE_DT_GET(DT_INST_PHANDLE(inst, step_counter))), (NULL)),       \
   };                                                                           \
                                                                                \
   DEVICE_DT_INST_DEFINE(inst, simple_stepper_init, NULL,                       \
@@ -0,0 +1,169 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Acceleration and jerk limited step timing for the simple stepper driver
+ *
+ * The profile is advanced once per step. Without a jerk limit, v^2 grows by
+ * 2 * a per step, which yields an exact trapezoidal profile. With a jerk
+ * limit the acceleration itself is slewed by jerk * dt per step, giving an
+ * S-curve. Braking starts as soon as the remaining steps are needed to come
+ * to a stop.
+ */
+
+#include "simple_stepper_ramp.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#define MSTEP_PER_STEP 1000ULL
+/* interval_ns = MSTEP_NS / v with v in mstep/s */
+#define MSTEP_NS ((uint64_t)NSEC_PER_SEC * MSTEP_PER_STEP)
+
+static uint64_t isqrt64(uint64_t x) {
+  uint64_t res = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (x >= res + bit) {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return res;
+}
+
+static void set_velocity(struct simple_stepper_ramp *ramp, uint64_t v) {
+  ramp->v = v;
+  ramp->v2 = v * v;
+}
+
+static void update_derived(struct simple_stepper_ramp *ramp) {
+  if (ramp->cruise_interval_ns == 0) {
+    ramp->v_cruise = 0;
+    ramp->v_min = 0;
+    return;
+  }
+  ramp->v_cruise = MAX(MSTEP_NS / ramp->cruise_interval_ns, 1ULL);
+  /* v^2 = 2 * a * s for the first step (s = 1) from standstill */
+  ramp->v_min = MIN(isqrt64(2ULL * ramp->accel * MSTEP_PER_STEP *
+                            MSTEP_PER_STEP),
+                    ramp->v_cruise);
+  ramp->v_min = MAX(ramp->v_min, 1ULL);
+}
+
+/* velocity change in mstep/s while bringing the acceleration a back to 0 */
+static uint64_t settle_velocity(const struct simple_stepper_ramp *ramp,
+                                int64_t a) {
+  if (ramp->jerk == 0 || a == 0) {
+    return 0;
+  }
+  const uint64_t abs_a = a < 0 ? -a : a;
+  return (abs_a * abs_a * MSTEP_PER_STEP) / (2ULL * ramp->jerk);
+}
+
+void simple_stepper_ramp_set_limits(struct simple_stepper_ramp *ramp,
+                                    uint32_t accel, uint32_t jerk) {
+  ramp->accel = accel;
+  ramp->jerk = jerk;
+  update_derived(ramp);
+}
+
+void simple_stepper_ramp_set_cruise(struct simple_stepper_ramp *ramp,
+                                    uint64_t cruise_interval_ns) {
+  ramp->cruise_interval_ns = cruise_interval_ns;
+  update_derived(ramp);
+}
+
+void simple_stepper_ramp_reset(struct simple_stepper_ramp *ramp) {
+  set_velocity(ramp, 0);
+  ramp->a = 0;
+}
+
+uint32_t
+simple_stepper_ramp_braking_steps(const struct simple_stepper_ramp *ramp) {
+  if (ramp->accel == 0 || ramp->v == 0) {
+    return 0;
+  }
+
+  uint64_t v = ramp->v;
+  uint64_t steps = 0;
+  if (ramp->jerk > 0 && ramp->a > 0) {
+    /* a running acceleration has to be ramped down first, which takes
+     * t = a / j and still gains a^2 / 2j of velocity */
+    const uint64_t a = ramp->a;
+    const uint64_t a2_j = (a * a) / ramp->jerk;
+    steps += (v * a) / (ramp->jerk * MSTEP_PER_STEP) +
+             (a2_j * a) / (3ULL * ramp->jerk);
+    v += (a2_j * MSTEP_PER_STEP) / 2;
+  }
+
+  steps += (v * v) / (2ULL * ramp->accel * MSTEP_PER_STEP * MSTEP_PER_STEP);
+  if (ramp->jerk > 0) {
+    /* the deceleration itself is ramped in and out at the jerk limit */
+    steps += (v * ramp->accel) / (2ULL * ramp->jerk * MSTEP_PER_STEP);
+  }
+  return (uint32_t)MIN(steps, (uint64_t)UINT32_MAX - 1);
+}
+
+uint64_t simple_stepper_ramp_next_interval(struct simple_stepper_ramp *ramp,
+                                           uint32_t steps_remaining) {
+  if (ramp->accel == 0 || ramp->cruise_interval_ns == 0) {
+    return ramp->cruise_interval_ns;
+  }
+
+  if (ramp->v == 0) {
+    /* first step of a move from standstill */
+    set_velocity(ramp, ramp->v_min);
+    ramp->a = 0;
+    return MSTEP_NS / ramp->v;
+  }
+
+  const bool braking =
+      steps_remaining <= simple_stepper_ramp_braking_steps(ramp);
+  const uint64_t v_goal = braking ? ramp->v_min : ramp->v_cruise;
+  const int64_t accel = ramp->accel;
+
+  /* accelerate towards the goal velocity, but start easing off early enough
+   * to arrive there with zero acceleration when jerk limited */
+  const uint64_t settle = settle_velocity(ramp, ramp->a);
+  int64_t a_target = 0;
+  if (ramp->v < v_goal) {
+    a_target = (ramp->a > 0 && v_goal - ramp->v <= settle) ? 0 : accel;
+  } else if (ramp->v > v_goal) {
+    a_target = (ramp->a < 0 && ramp->v - v_goal <= settle) ? 0 : -accel;
+  }
+
+  if (ramp->jerk == 0) {
+    ramp->a = a_target;
+  } else {
+    const uint64_t dt_ns = MSTEP_NS / ramp->v;
+    const int64_t da =
+        MAX((int64_t)((ramp->jerk * dt_ns) / NSEC_PER_SEC), (int64_t)1);
+    if (ramp->a < a_target) {
+      ramp->a = MIN(ramp->a + da, a_target);
+    } else if (ramp->a > a_target) {
+      ramp->a = MAX(ramp->a - da, a_target);
+    }
+  }
+
+  const int64_t v2 =
+      (int64_t)ramp->v2 +
+      2 * ramp->a * (int64_t)(MSTEP_PER_STEP * MSTEP_PER_STEP);
+  uint64_t v_next = v2 > 0 ? isqrt64((uint64_t)v2) : 0;
+
+  /* never overshoot the goal velocity, settle there instead */
+  if ((ramp->v <= v_goal && v_next > v_goal) ||
+      (ramp->v >= v_goal && v_next < v_goal)) {
+    v_next = v_goal;
+    ramp->a = 0;
+  }
+  set_velocity(ramp, MAX(v_next, ramp->v_min));
+
+  return MSTEP_NS / ramp->v;
+}
@@ -0,0 +1,94 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Acceleration and jerk limited step timing for the simple stepper driver
+ */
+
+#ifndef SIMPLE_STEPPER_RAMP_H_
+#define SIMPLE_STEPPER_RAMP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Remaining step count to pass in velocity mode, where there is no end point
+ * to brake for */
+#define SIMPLE_STEPPER_RAMP_UNBOUNDED UINT32_MAX
+
+/**
+ * @brief Motion profile of one stepper.
+ *
+ * Velocities are tracked in milli-microsteps per second (mstep/s) so that the
+ * per-step update stays in integer arithmetic and is cheap enough to be run
+ * from the timing signal handler.
+ */
+struct simple_stepper_ramp {
+  /* limits */
+  uint32_t accel; /* microsteps/s^2, 0 disables ramping */
+  uint32_t jerk;  /* microsteps/s^3, 0 means unlimited (trapezoidal) */
+  uint64_t cruise_interval_ns;
+
+  /* derived from the limits */
+  uint64_t v_cruise; /* mstep/s */
+  uint64_t v_min;    /* mstep/s reached by the first step from standstill */
+
+  /* state */
+  uint64_t v;  /* current velocity in mstep/s, 0 at standstill */
+  uint64_t v2; /* v squared, kept to avoid a sqrt per update */
+  int64_t a;   /* current acceleration in microsteps/s^2 */
+};
+
+static inline bool
+simple_stepper_ramp_enabled(const struct simple_stepper_ramp *ramp) {
+  return ramp->accel > 0;
+}
+
+static inline bool
+simple_stepper_ramp_is_idle(const struct simple_stepper_ramp *ramp) {
+  return ramp->v == 0;
+}
+
+/**
+ * @brief Set acceleration (microsteps/s^2) and jerk (microsteps/s^3) limits.
+ */
+void simple_stepper_ramp_set_limits(struct simple_stepper_ramp *ramp,
+                                    uint32_t accel, uint32_t jerk);
+
+/**
+ * @brief Set the step interval used once the ramp has reached full speed.
+ */
+void simple_stepper_ramp_set_cruise(struct simple_stepper_ramp *ramp,
+                                    uint64_t cruise_interval_ns);
+
+/**
+ * @brief Forget the current velocity, the next move starts from standstill.
+ */
+void simple_stepper_ramp_reset(struct simple_stepper_ramp *ramp);
+
+/**
+ * @brief Number of steps needed to come to a standstill from the current
+ * velocity and acceleration.
+ */
+uint32_t
+simple_stepper_ramp_braking_steps(const struct simple_stepper_ramp *ramp);
+
+/**
+ * @brief Advance the profile by one step and return the interval to the next
+ * step.
+ *
+ * @param ramp profile to advance
+ * @param steps_remaining steps left in the move after the upcoming one, or
+ *        SIMPLE_STEPPER_RAMP_UNBOUNDED in velocity mode
+ * @return interval in ns, equal to the cruise interval if ramping is disabled
+ */
+uint64_t simple_stepper_ramp_next_interval(struct simple_stepper_ramp *ramp,
+                                           uint32_t steps_remaining);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMPLE_STEPPER_RAMP_H_ */
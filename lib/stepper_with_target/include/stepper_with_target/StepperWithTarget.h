@@ -25,6 +25,9 @@ struct stepper_with_target_status {
   int32_t target_position;
 };
 
+/* Called from the step timing context, must not block */
+typedef void (*position_trigger_cb_t)(void *user_data);
+
 /* Enum for speeds, fast, medium, slow */
 enum class StepperSpeed { FAST, MEDIUM, SLOW };
 
@@ -34,13 +37,19 @@ class StepperWithTarget {
   int32_t target_position = 0;
   bool enabled = false;
   int64_t last_motion_ms = 0;
+  struct k_sem motion_done;
+  position_trigger_cb_t trigger_cb = nullptr;
+  void *trigger_user_data = nullptr;
 
   int pitch_per_rev_nm = 0;
   int pulses_per_rev = 0;
+  uint32_t accel_steps_per_s2 = 0;
 
   static void event_callback_wrapper(const struct device *dev,
                                      const enum stepper_event event,
                                      void *user_data);
+  static void position_trigger_wrapper(const struct device *dev,
+                                       int32_t position, void *user_data);
 
   int32_t go_relative(int32_t dist);
   void set_target_position(int32_t _target_position);
@@ -60,20 +69,64 @@ public:
   int disable();
   void start();
   void pause();
+
+  /**
+   * @brief Stop immediately and drop the rest of the move.
+   *
+   * Safe to call from any context, including ISRs and the Bluetooth RX
+   * thread. The target is set to where the stepper came to rest so that
+   * nothing resumes the aborted move.
+   *
+   * @return 0 on success, negative error code from stepper_stop() otherwise
+   */
+  int hard_stop();
   void note_motion_start();
   void note_motion_stop();
   void wait_and_pause();
 
+  /**
+   * @brief Block until the current move has ended.
+   *
+   * Woken from the stepper event callback, so this returns as soon as the
+   * driver reports the move as completed or stopped.
+   *
+   * @param timeout maximum time to wait
+   * @return 0 if the stepper stopped at its target, -ECANCELED if it stopped
+   *         elsewhere, -EAGAIN on timeout
+   */
+  int wait_for_target(k_timeout_t timeout);
+
+  /**
+   * @brief Semaphore given whenever a move ends, to k_poll on together with
+   * other events. Take it via wait_for_target(K_NO_WAIT).
+   */
+  struct k_sem *motion_done_sem() { return &motion_done; }
+
   int get_position();
   int32_t get_position_nm();
 
   int set_speed(StepperSpeed speed);
+  /* Speed of a preset, for estimates */
+  uint32_t speed_nm_per_s(StepperSpeed speed) const;
   int set_speed_rpm(int rpm);
+  int set_speed_nm_per_s(uint32_t nm_per_s);
+  int set_motion_limits_nm(int32_t accel_nm_per_s2, int32_t jerk_nm_per_s3);
+  bool has_motion_limits() const { return accel_steps_per_s2 > 0; }
 
   int32_t go_relative_nm(int32_t dist);
   void set_target_position_nm(int32_t _target_position);
   int32_t get_target_position_nm();
 
+  /**
+   * @brief Call @p cb once the stepper reaches or passes a position.
+   *
+   * One-shot, @p cb may arm the next position. Needs the simple-stepper
+   * driver, returns -ENOTSUP otherwise.
+   */
+  int set_position_trigger_nm(int32_t position_nm, position_trigger_cb_t cb,
+                              void *user_data);
+  int clear_position_trigger();
+
   bool step_towards_target();
   bool is_enabled() const { return enabled; }
   bool is_moving_now() const { return is_moving; }
@@ -84,8 +137,6 @@ public:
   const struct stepper_with_target_status get_status();
 };
 
-void start_stepper(StepperWithTarget *_started_stepper_ptr);
-
 static double nm_as_um(int nm) { return nm / 1000.0; }
 
 #endif // STEPPERWITHTARGET_H_
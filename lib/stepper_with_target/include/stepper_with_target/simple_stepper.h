@@ -0,0 +1,108 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Extensions of the stepper API specific to the simple-stepper driver
+ */
+
+#ifndef STEPPER_WITH_TARGET_SIMPLE_STEPPER_H_
+#define STEPPER_WITH_TARGET_SIMPLE_STEPPER_H_
+
+#include <stdint.h>
+#include <zephyr/device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Callback for simple_stepper_set_position_trigger().
+ *
+ * Runs in the context of the step timing, i.e. in the counter ISR or on the
+ * system workqueue, so it must not block.
+ *
+ * @param dev simple-stepper device
+ * @param position position of the step that fired the trigger
+ * @param user_data user data passed when arming the trigger
+ */
+typedef void (*simple_stepper_position_cb_t)(const struct device *dev,
+                                             int32_t position,
+                                             void *user_data);
+
+/**
+ * @brief Deviation of the actual step intervals from the scheduled ones.
+ *
+ * Collected per step when CONFIG_SIMPLE_STEPPER_TIMING_STATS is enabled. A
+ * positive error means the step came late.
+ */
+struct simple_stepper_timing_stats {
+  uint32_t steps;
+  int32_t min_error_ns;
+  int32_t max_error_ns;
+  uint64_t abs_error_sum_ns;
+};
+
+/**
+ * @brief Set the acceleration and jerk limits used to ramp moves.
+ *
+ * Takes effect from the next step on, also for a move in progress.
+ *
+ * @param dev simple-stepper device
+ * @param accel acceleration limit in microsteps/s^2, 0 disables ramping
+ * @param jerk jerk limit in microsteps/s^3, 0 for a trapezoidal profile
+ * @return 0 on success, negative error code on failure
+ */
+int simple_stepper_set_motion_limits(const struct device *dev, uint32_t accel,
+                                     uint32_t jerk);
+
+/**
+ * @brief Get the acceleration and jerk limits used to ramp moves.
+ *
+ * @param dev simple-stepper device
+ * @param accel acceleration limit in microsteps/s^2
+ * @param jerk jerk limit in microsteps/s^3
+ * @return 0 on success, negative error code on failure
+ */
+int simple_stepper_get_motion_limits(const struct device *dev, uint32_t *accel,
+                                     uint32_t *jerk);
+
+/**
+ * @brief Arm a one-shot callback for the step that reaches a position.
+ *
+ * The callback fires on the first step that reaches or passes @p position in
+ * the direction of travel. It may arm the next position itself, which allows
+ * a list of positions to be followed during a single move.
+ *
+ * @param dev simple-stepper device
+ * @param position position in microsteps
+ * @param cb callback, NULL disarms the trigger
+ * @param user_data passed to @p cb
+ * @return 0 on success, negative error code on failure
+ */
+int simple_stepper_set_position_trigger(const struct device *dev,
+                                        int32_t position,
+                                        simple_stepper_position_cb_t cb,
+                                        void *user_data);
+
+/**
+ * @brief Get the step timing statistics collected since the last reset.
+ *
+ * @param dev simple-stepper device
+ * @param stats copy of the statistics
+ * @return 0 on success, -ENOTSUP if CONFIG_SIMPLE_STEPPER_TIMING_STATS is off
+ */
+int simple_stepper_get_timing_stats(const struct device *dev,
+                                    struct simple_stepper_timing_stats *stats);
+
+/**
+ * @brief Reset the step timing statistics.
+ *
+ * @param dev simple-stepper device
+ * @return 0 on success, -ENOTSUP if CONFIG_SIMPLE_STEPPER_TIMING_STATS is off
+ */
+int simple_stepper_reset_timing_stats(const struct device *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STEPPER_WITH_TARGET_SIMPLE_STEPPER_H_ */
@@ -1,4 +1,7 @@
 #include "stepper_with_target/StepperWithTarget.h"
+#ifdef CONFIG_SIMPLE_STEPPER
+#include "stepper_with_target/simple_stepper.h"
+#endif
 
 LOG_MODULE_REGISTER(stepper_with_target, LOG_LEVEL_INF);
 
@@ -9,6 +12,7 @@ StepperWithTarget::StepperWithTarget(const struct device *dev,
   pitch_per_rev_nm = _pitch_per_rev_mm * 1000000;
   pulses_per_rev = _pulses_per_rev;
   last_motion_ms = k_uptime_get();
+  k_sem_init(&motion_done, 0, 1);
 
   if (!device_is_ready(stepper_dev)) {
     LOG_ERR("Stepper device is not ready");
@@ -34,11 +38,20 @@ StepperWithTarget::StepperWithTarget(const struct device *dev,
     LOG_WRN("Failed to set step interval: %d", ret);
   }
 
+#ifdef CONFIG_SIMPLE_STEPPER
+  // Limits default to the devicetree configuration of the driver
+  uint32_t jerk;
+  if (simple_stepper_get_motion_limits(stepper_dev, &accel_steps_per_s2,
+                                       &jerk) < 0) {
+    accel_steps_per_s2 = 0;
+  }
+#endif
+
   LOG_INF("%s initialized with pitch_per_rev=%.3fum, pulses_per_rev=%d",
           __FUNCTION__, nm_as_um(pitch_per_rev_nm), pulses_per_rev);
 }
 
-int StepperWithTarget::set_speed(StepperSpeed speed) {
+static int preset_rpm(StepperSpeed speed) {
   int rpm = 10;
   switch (speed) {
   case StepperSpeed::FAST:
@@ -51,7 +64,15 @@ int StepperWithTarget::set_speed(StepperSpeed speed) {
     rpm = 5;
     break;
   }
-  return set_speed_rpm(rpm);
+  return rpm;
+}
+
+int StepperWithTarget::set_speed(StepperSpeed speed) {
+  return set_speed_rpm(preset_rpm(speed));
+}
+
+uint32_t StepperWithTarget::speed_nm_per_s(StepperSpeed speed) const {
+  return (uint64_t)preset_rpm(speed) * pitch_per_rev_nm / 60;
 }
 
 int StepperWithTarget::set_speed_rpm(int rpm) {
@@ -85,6 +106,52 @@ int StepperWithTarget::set_speed_rpm(int rpm) {
   return ret;
 }
 
+int StepperWithTarget::set_speed_nm_per_s(uint32_t nm_per_s) {
+  if (nm_per_s == 0) {
+    LOG_WRN("Requested speed must be > 0");
+    return -EINVAL;
+  }
+
+  // interval = (pitch_per_rev_nm / pulses_per_rev) / speed
+  uint64_t interval_ns = (NSEC_PER_SEC * (uint64_t)pitch_per_rev_nm) /
+                         ((uint64_t)pulses_per_rev * nm_per_s);
+  if (interval_ns == 0) {
+    interval_ns = 1; // best-effort clamp
+  }
+
+  int ret = stepper_set_microstep_interval(stepper_dev, interval_ns);
+  if (ret < 0) {
+    LOG_WRN("Failed to set speed: %d", ret);
+  } else {
+    LOG_INF("Stepper speed set to %.3fum/s (interval %llu ns)",
+            nm_as_um(nm_per_s), interval_ns);
+  }
+  return ret;
+}
+
+int StepperWithTarget::set_motion_limits_nm(int32_t accel_nm_per_s2,
+                                            int32_t jerk_nm_per_s3) {
+  if (accel_nm_per_s2 < 0 || jerk_nm_per_s3 < 0) {
+    LOG_WRN("Motion limits must not be negative");
+    return -EINVAL;
+  }
+#ifdef CONFIG_SIMPLE_STEPPER
+  uint32_t accel = nm_to_steps(accel_nm_per_s2);
+  uint32_t jerk = nm_to_steps(jerk_nm_per_s3);
+  int ret = simple_stepper_set_motion_limits(stepper_dev, accel, jerk);
+  if (ret < 0) {
+    LOG_WRN("Failed to set motion limits: %d", ret);
+    return ret;
+  }
+  accel_steps_per_s2 = accel;
+  LOG_INF("Motion limits set to %.3fum/s^2, %.3fum/s^3 (%u, %u steps)",
+          nm_as_um(accel_nm_per_s2), nm_as_um(jerk_nm_per_s3), accel, jerk);
+  return 0;
+#else
+  return -ENOTSUP;
+#endif
+}
+
 void StepperWithTarget::event_callback_wrapper(const struct device *dev,
                                                const enum stepper_event event,
                                                void *user_data) {
@@ -109,6 +176,38 @@ void StepperWithTarget::event_callback_wrapper(const struct device *dev,
   }
 }
 
+void StepperWithTarget::position_trigger_wrapper(const struct device *dev,
+                                                 int32_t position,
+                                                 void *user_data) {
+  ARG_UNUSED(dev);
+  ARG_UNUSED(position);
+  StepperWithTarget *instance = static_cast<StepperWithTarget *>(user_data);
+
+  position_trigger_cb_t cb = instance->trigger_cb;
+  instance->trigger_cb = nullptr;
+  if (cb) {
+    cb(instance->trigger_user_data);
+  }
+}
+
+int StepperWithTarget::set_position_trigger_nm(int32_t position_nm,
+                                               position_trigger_cb_t cb,
+                                               void *user_data) {
+#ifdef CONFIG_SIMPLE_STEPPER
+  trigger_cb = cb;
+  trigger_user_data = user_data;
+  return simple_stepper_set_position_trigger(
+      stepper_dev, nm_to_steps(position_nm),
+      cb ? position_trigger_wrapper : nullptr, this);
+#else
+  return -ENOTSUP;
+#endif
+}
+
+int StepperWithTarget::clear_position_trigger() {
+  return set_position_trigger_nm(0, nullptr, nullptr);
+}
+
 char *StepperWithTarget::state() {
   int32_t pos = get_position();
   static char buffer[128];
@@ -150,16 +249,43 @@ void StepperWithTarget::pause() {
   note_motion_stop();
 }
 
+int StepperWithTarget::hard_stop() {
+  uint32_t start = k_cycle_get_32();
+  int ret = stepper_stop(stepper_dev);
+  uint32_t stop_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+  if (ret < 0) {
+    LOG_ERR("Failed to stop stepper: %d", ret);
+    return ret;
+  }
+
+  target_position = get_position();
+  note_motion_stop();
+  LOG_INF("Hard stop at %d within %u us", target_position, stop_us);
+  return 0;
+}
+
 void StepperWithTarget::wait_and_pause() {
   LOG_DBG("wait..., currently at %d -> %d", get_position(),
           get_target_position());
-  while (!is_in_target_position() && is_moving) {
-    k_sleep(K_MSEC(100));
+  int ret = wait_for_target(K_FOREVER);
+  if (ret < 0) {
+    LOG_DBG("stopped off target: %d", ret);
   }
   pause();
   LOG_DBG("...pause");
 }
 
+int StepperWithTarget::wait_for_target(k_timeout_t timeout) {
+  k_timepoint_t end = sys_timepoint_calc(timeout);
+
+  while (is_moving) {
+    if (k_sem_take(&motion_done, sys_timepoint_timeout(end)) != 0) {
+      return -EAGAIN;
+    }
+  }
+  return is_in_target_position() ? 0 : -ECANCELED;
+}
+
 int StepperWithTarget::get_position() {
   int32_t pos;
   int ret = stepper_get_actual_position(stepper_dev, &pos);
@@ -188,12 +314,15 @@ int32_t StepperWithTarget::get_target_position() { return target_position; }
 
 void StepperWithTarget::note_motion_start() {
   last_motion_ms = k_uptime_get();
+  k_sem_reset(&motion_done);
   is_moving = true;
 }
 
+// Also called from the event callback, possibly in ISR context
 void StepperWithTarget::note_motion_stop() {
   last_motion_ms = k_uptime_get();
   is_moving = false;
+  k_sem_give(&motion_done);
 }
 
 int64_t StepperWithTarget::last_motion_timestamp_ms() const {
@@ -269,29 +398,3 @@ const struct stepper_with_target_status StepperWithTarget::get_status() {
       .target_position = target_position,
   };
 }
-
-StepperWithTarget *started_stepper_ptr;
-
-void stepper_work_handler(struct k_work *work) {
-  ARG_UNUSED(work);
-  if (started_stepper_ptr == NULL) {
-    return;
-  }
-  started_stepper_ptr->step_towards_target();
-}
-K_WORK_DEFINE(stepper_work, stepper_work_handler);
-
-void stepper_expiry_function(struct k_timer *timer_id) {
-  ARG_UNUSED(timer_id);
-  k_work_submit(&stepper_work);
-}
-K_TIMER_DEFINE(stepper_timer, stepper_expiry_function, NULL);
-
-void start_stepper(StepperWithTarget *_started_stepper_ptr) {
-  if (_started_stepper_ptr == NULL) {
-    return;
-  }
-  started_stepper_ptr = _started_stepper_ptr;
-  started_stepper_ptr->start();
-  k_timer_start(&stepper_timer, K_USEC(20), K_USEC(20));
-}